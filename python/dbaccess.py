@@ -1,5 +1,7 @@
 import math, os, sqlite3
+from contextlib import contextmanager
 from datetime import datetime
+from urllib.request import pathname2url
 
 
 def get_timestamp(date):
@@ -7,52 +9,110 @@ def get_timestamp(date):
     return math.trunc(datetime.combine(date, datetime.min.time()).timestamp() * 1000)
 
 
-def _generate_orders_select(status_int, previous_id, last_id):
+def _generate_orders_select(orders_table, status_int, previous_id, last_id):
     range_clause = "id > {}".format(previous_id)
     if (last_id):
         range_clause = "{} AND id <= {}".format(range_clause, last_id)
-    return "SELECT * FROM Orders WHERE status = {} AND {}".format(status_int, range_clause)
+    return "SELECT * FROM {} WHERE status = {} AND {}".format(orders_table, status_int, range_clause)
 
 
 class Database(object):
 
-    def __init__(self, sqlitefile):
-        if os.path.exists(sqlitefile):
-            self.sqlitefile = sqlitefile
-        else:
-            raise Exception("Cannot find provided sqlite file: {}.".format(sqlitefile))
+    def __init__(self, sqlitefile, archivefile = None):
+        """ archivefile is the database where the bot moves the fulfilled orders and their fragments """
+        for path in (sqlitefile, archivefile):
+            if path and not os.path.exists(path):
+                raise Exception("Cannot find provided sqlite file: {}.".format(path))
+        self.sqlitefile = sqlitefile
+        self.archivefile = archivefile
+        self._snapshot = None
+
+
+    def _connect(self):
+        """ Read-only connections never take the write lock, nor checkpoint the WAL when closed,
+            so the exports do not delay the bot transactions """
+        def uri(path):
+            return "file:{}?mode=ro".format(pathname2url(os.path.abspath(path)))
+
+        # isolation_level None lets snapshot() control the transaction
+        conn = sqlite3.connect(uri(self.sqlitefile), uri=True, isolation_level=None)
+        conn.execute("PRAGMA query_only = ON;")
+        if self.archivefile:
+            conn.execute("ATTACH DATABASE ? AS archive;", (uri(self.archivefile),))
+        return conn
+
+
+    @contextmanager
+    def _connection(self):
+        if self._snapshot:
+            yield self._snapshot
+            return
+        conn = self._connect()
+        try:
+            yield conn
+        finally:
+            conn.close()
+
+
+    @contextmanager
+    def snapshot(self):
+        """ All the reads in the with block see the same state of the database,
+            whatever the bot commits meanwhile """
+        if self._snapshot:
+            yield self
+            return
+        with self._connection() as conn:
+            conn.execute("BEGIN;")
+            self._snapshot = conn
+            try:
+                yield self
+            finally:
+                self._snapshot = None
+                conn.execute("COMMIT;")
+
+
+    def _table(self, name):
+        """ The rows of table name, including the archived rows """
+        if self.archivefile:
+            # UNION removes the rows present in both databases while an archival is interrupted
+            return "(SELECT * FROM {0} UNION SELECT * FROM archive.{0})".format(name)
+        return name
 
 
     def get_orders_period(self, begin_day, end_day):
-        with sqlite3.connect(self.sqlitefile) as conn:
+        with self._connection() as conn:
             cursor = conn.cursor()
-            cursor.execute("SELECT * FROM Orders WHERE status = 4 AND fulfill_time >= {} AND fulfill_time < {};"\
-                    .format(get_timestamp(begin_day), get_timestamp(end_day)))
+            cursor.execute("SELECT * FROM {} WHERE status = 4 AND fulfill_time >= {} AND fulfill_time < {};"\
+                    .format(self._table("Orders"), get_timestamp(begin_day), get_timestamp(end_day)))
             return cursor.fetchall()
 
 
     def get_orders_idrange(self, previous_id, last_id = None):
         status_int = 4 # Fulfilled
-        with sqlite3.connect(self.sqlitefile) as conn:
+        with self._connection() as conn:
             cursor = conn.cursor()
-            cursor.execute(_generate_orders_select(status_int, previous_id, last_id))
+            # The caller relies on the last row being the last order
+            cursor.execute(_generate_orders_select(self._table("Orders"), status_int, previous_id, last_id)
+                           + " ORDER BY id")
             return cursor.fetchall()
 
 
     def get_fragments(self, previous_order_id, last_order_id):
         status_int = 4 # Fulfilled
-        with sqlite3.connect(self.sqlitefile) as conn:
+        with self._connection() as conn:
             cursor = conn.cursor()
-            cursor.execute("SELECT f.* FROM Fragments f INNER JOIN ({}) o "
+            cursor.execute("SELECT f.* FROM {} f INNER JOIN ({}) o "
                            "WHERE f.composed_order = o.id;"
-                            .format(_generate_orders_select(status_int,
+                            .format(self._table("Fragments"),
+                                    _generate_orders_select(self._table("Orders"),
+                                                            status_int,
                                                             previous_order_id,
                                                             last_order_id)))
             return cursor.fetchall()
 
 
     def get_balances_after_time(self, previous_time):
-        with sqlite3.connect(self.sqlitefile) as conn:
+        with self._connection() as conn:
             cursor = conn.cursor()
             cursor.execute("SELECT * FROM Balances WHERE time > {};"\
                     .format(previous_time))
@@ -61,7 +121,7 @@ class Database(object):
 
     def count_launch_period(self, previous_time, last_time):
         """ Count launches that occured during the provided interval (previous_time, last_time] """
-        with sqlite3.connect(self.sqlitefile) as conn:
+        with self._connection() as conn:
             cursor = conn.cursor()
             cursor.execute("SELECT Count() FROM Launches WHERE time > {} AND time <= {};"\
                     .format(previous_time, last_time))
@@ -71,12 +71,15 @@ def main():
     parser.add_argument("sqlitefile", help="SQLite3 database file.")
     parser.add_argument("tokenfile", help="The file containing user access tokens.")
     parser.add_argument("spreadsheet", help="The ID of the Google spreadhseet.")
+    parser.add_argument("--archive", help="SQLite3 archive database file, if the bot archives orders.")
     args = parser.parse_args()
 
-    database = dbaccess.Database(args.sqlitefile)
+    database = dbaccess.Database(args.sqlitefile, args.archive)
     sheet_api = gsheet.Spreadsheet(args.tokenfile, args.spreadsheet)
-    last_order_id = append_orders(sheet_api, database)
-    append_fragments(sheet_api, database, last_order_id)
+    # The fragments must be read from the same state as the orders
+    with database.snapshot():
+        last_order_id = append_orders(sheet_api, database)
+        append_fragments(sheet_api, database, last_order_id)
     append_balances(sheet_api, database)
 
 
@@ -0,0 +1,316 @@
+#include "Backtest.h"
+
+#include <tradebot/Configuration.h>
+#include <tradebot/Logging.h>
+
+#include <binance/Api.h>
+
+#include <limits>
+
+
+namespace ad {
+namespace backtest {
+
+
+using tradebot::marketdata::AggregateTrade;
+using tradebot::marketdata::gFixedPointScale;
+
+
+namespace {
+
+
+    Decimal toDecimal(std::int64_t aFixedPoint)
+    {
+        return Decimal{aFixedPoint} / gFixedPointScale;
+    }
+
+
+    /// \return The smallest fixed point value not below aValue.
+    std::int64_t ceilFixedPoint(Decimal aValue)
+    {
+        Decimal scaled = aValue * gFixedPointScale;
+        auto result = scaled.convert_to<std::int64_t>();
+        return (Decimal{result} < scaled) ? result + 1 : result;
+    }
+
+
+    binance::Api makeOfflineApi()
+    {
+        // No request is ever sent: the simulator fills the orders.
+        return binance::Api{Json{
+            {"server", "test"},
+            {"apikey", ""},
+            {"secretkey", ""},
+        }};
+    }
+
+
+} // anonymous namespace
+
+
+FokSimulator::FokSimulator(Options aOptions) :
+    options{std::move(aOptions)}
+{}
+
+
+void FokSimulator::onTrade(const AggregateTrade & aTrade)
+{
+    latestTrade = aTrade;
+    latestPriceCurrent = false;
+}
+
+
+std::optional<tradebot::FulfilledOrder> FokSimulator::fillLimitFokOrder(tradebot::Order & aOrder,
+                                                                        Decimal aLimitPrice)
+{
+    if (! latestPriceCurrent)
+    {
+        latestPrice = toDecimal(latestTrade.price);
+        latestPriceCurrent = true;
+    }
+
+    aOrder.activationTime = latestTrade.tradeTime;
+    aOrder.exchangeId = nextExchangeId++;
+
+    bool crossed = (aOrder.side == tradebot::Side::Sell) ? (latestPrice >= aLimitPrice)
+                                                         : (latestPrice <= aLimitPrice);
+    bool liquid = options.liquidityFactor <= 0
+                  || aOrder.baseAmount <= toDecimal(latestTrade.quantity) * options.liquidityFactor;
+    if (! crossed || ! liquid)
+    {
+        expired = true;
+        return {};
+    }
+
+    Decimal quoteAmount = aOrder.baseAmount * aLimitPrice;
+    tradebot::Fulfillment fulfillment{
+        aOrder.baseAmount,
+        quoteAmount,
+        (aOrder.side == tradebot::Side::Sell ? quoteAmount : aOrder.baseAmount) * options.commission,
+        (aOrder.side == tradebot::Side::Sell ? aOrder.quote : aOrder.base),
+        latestTrade.tradeTime,
+        1,
+    };
+    Json status{
+        {"status", "FILLED"},
+        {"executedQty", to_str(aOrder.baseAmount)},
+        {"price", to_str(aLimitPrice)},
+        {"transactTime", latestTrade.tradeTime},
+    };
+
+    filled.push_back(tradebot::fulfill(aOrder, status, fulfillment));
+    return filled.back();
+}
+
+
+std::vector<tradebot::FulfilledOrder> FokSimulator::takeFilled()
+{
+    return std::exchange(filled, {});
+}
+
+
+Backtest::Options Backtest::readOptions(const Json & aBacktestConfig)
+{
+    auto readDecimal = [](const Json & aJson, const char * aKey, Decimal aDefault)
+    {
+        return Decimal{aJson.value(aKey, to_str(aDefault))};
+    };
+
+    const Json filtersConfig = aBacktestConfig.value("filters", Json::object());
+
+    Options options;
+    options.filters.price.tickSize =
+        readDecimal(filtersConfig, "priceTickSize", options.filters.price.tickSize);
+    options.filters.amount.tickSize =
+        readDecimal(filtersConfig, "amountTickSize", options.filters.amount.tickSize);
+    options.filters.amount.minimum =
+        readDecimal(filtersConfig, "minimumAmount", options.filters.amount.minimum);
+    options.filters.minimumNotional =
+        readDecimal(filtersConfig, "minimumNotional", options.filters.minimumNotional);
+    options.simulation.commission =
+        readDecimal(aBacktestConfig, "commission", options.simulation.commission);
+    options.simulation.liquidityFactor =
+        readDecimal(aBacktestConfig, "liquidityFactor", options.simulation.liquidityFactor);
+    options.samplePeriod = std::chrono::minutes{aBacktestConfig.value("samplePeriodMinutes", 60)};
+    return options;
+}
+
+
+Backtest::Backtest(const Json & aConfig, Options aOptions) :
+    options{std::move(aOptions)},
+    trader{
+        "backtest",
+        tradebot::Pair{aConfig.at("base"), aConfig.at("quote")},
+        tradebot::Database{":memory:"},
+        tradebot::Exchange{makeOfflineApi()},
+    },
+    tracker{tradebot::makeLadder(aConfig.at("ladder"))}
+{
+    auto fokSimulator = std::make_unique<FokSimulator>(options.simulation);
+    simulator = fokSimulator.get();
+    trader.exchange.simulator = std::move(fokSimulator);
+
+    trader.spawner = tradebot::makeStableDownSpread(aConfig.at("spawner"),
+                                                    tracker.ladder,
+                                                    options.filters.amount.tickSize);
+
+    for (tradebot::Fragment & fragment
+         : tradebot::makeInitialFragments(aConfig, tracker.ladder, trader.pair, options.filters))
+    {
+        trader.database.insert(fragment);
+    }
+
+    tracker.reset();
+    updateBounds();
+}
+
+
+void Backtest::replay(const AggregateTrade * aBegin, const AggregateTrade * aEnd)
+{
+    for (; aBegin != aEnd; ++aBegin)
+    {
+        onTrade(*aBegin);
+    }
+}
+
+
+void Backtest::onTrade(const AggregateTrade & aTrade)
+{
+    latestTrade = aTrade;
+    if (aTrade.tradeTime >= nextSample)
+    {
+        if (nextSample != 0)
+        {
+            sample(aTrade.tradeTime);
+        }
+        nextSample = aTrade.tradeTime - (aTrade.tradeTime % options.samplePeriod.count())
+                     + options.samplePeriod.count();
+    }
+
+    // Fast path: the vast majority of trades do not change the interval,
+    // there is no need to convert their price to Decimal.
+    if (aTrade.price >= lowerBound && aTrade.price < upperBound)
+    {
+        return;
+    }
+
+    if (auto interval = tracker.update(toDecimal(aTrade.price)))
+    {
+        simulator->onTrade(aTrade);
+        onIntervalChange(*interval);
+    }
+    updateBounds();
+}
+
+
+void Backtest::onIntervalChange(Interval aInterval)
+{
+    ++intervalChanges;
+    {
+        trade::ScopedTimer timer{intervalChangeCost};
+        trader.makeAndFillProfitableOrders(aInterval,
+                                           options.filters,
+                                           [this]
+                                           {
+                                               return ! simulator->takeExpired();
+                                           });
+    }
+
+    for (const tradebot::FulfilledOrder & order : simulator->takeFilled())
+    {
+        if (order.side == tradebot::Side::Sell)
+        {
+            ++filledSellOrders;
+            takenHomeQuote += trader.database.sumTakenHome(order);
+        }
+        else
+        {
+            ++filledBuyOrders;
+            takenHomeBase += trader.database.sumTakenHome(order);
+        }
+    }
+}
+
+
+void Backtest::updateBounds()
+{
+    if (tracker.lowerBound == tracker.ladder.crend() || tracker.lowerBound == tracker.ladder.crbegin())
+    {
+        // Out of the ladder: always go through the tracker.
+        lowerBound = std::numeric_limits<std::int64_t>::max();
+        upperBound = std::numeric_limits<std::int64_t>::min();
+    }
+    else
+    {
+        lowerBound = ceilFixedPoint(*tracker.lowerBound);
+        upperBound = ceilFixedPoint(*(tracker.lowerBound - 1));
+    }
+}
+
+
+void Backtest::sample(MillisecondsSinceEpoch aTime)
+{
+    samples.push_back(Sample{
+        aTime,
+        toDecimal(latestTrade.price),
+        trader.database.countUnassociatedFragments(tradebot::Side::Sell, trader.pair),
+        trader.database.countUnassociatedFragments(tradebot::Side::Buy, trader.pair),
+        intervalChanges,
+        filledSellOrders,
+        filledBuyOrders,
+        takenHomeQuote,
+        takenHomeBase,
+    });
+}
+
+
+void Backtest::finish()
+{
+    sample(latestTrade.tradeTime);
+}
+
+
+void Backtest::writeSamples(std::ostream & aOut) const
+{
+    aOut << "time,price,sell_fragments,buy_fragments,interval_changes,"
+            "filled_sell_orders,filled_buy_orders,taken_home_quote,taken_home_base\n";
+    for (const Sample & sample : samples)
+    {
+        aOut << sample.time << ','
+             << to_str(sample.price) << ','
+             << sample.sellFragments << ','
+             << sample.buyFragments << ','
+             << sample.intervalChanges << ','
+             << sample.filledSellOrders << ','
+             << sample.filledBuyOrders << ','
+             << to_str(sample.takenHomeQuote) << ','
+             << to_str(sample.takenHomeBase) << '\n';
+    }
+}
+
+
+void Backtest::logSummary() const
+{
+    trade::Histogram::Summary cost = intervalChangeCost.summarize();
+    spdlog::info("Backtest on {}: {} interval changes, {} sell and {} buy orders filled ({} FOK expired).",
+                 trader.pair.symbol(),
+                 intervalChanges,
+                 filledSellOrders,
+                 filledBuyOrders,
+                 trader.fokCounters->expired.load());
+    spdlog::info("Taken home: {} {} and {} {}.",
+                 takenHomeQuote,
+                 trader.pair.quote,
+                 takenHomeBase,
+                 trader.pair.base);
+    spdlog::info("Interval change cost (us): mean {:.1f}, p50 {}, p99 {}, max {}, total {} ms.",
+                 cost.mean,
+                 cost.p50,
+                 cost.p99,
+                 cost.max,
+                 intervalChangeCost.sum() / 1000);
+}
+
+
+} // namespace backtest
+} // namespace ad
@@ -0,0 +1,150 @@
+#pragma once
+
+
+#include <tradebot/Exchange.h>
+#include <tradebot/SymbolFilters.h>
+#include <tradebot/Trader.h>
+#include <tradebot/marketdata/AggregateTrade.h>
+
+#include <trademath/Histogram.h>
+#include <trademath/IntervalTracker.h>
+
+#include <ostream>
+#include <utility>
+#include <vector>
+
+
+namespace ad {
+namespace backtest {
+
+
+/// \brief Fill limit FOK orders against the latest replayed trade.
+///
+/// A sell order fills if the latest trade price is at or above its limit price,
+/// a buy order if the latest trade price is at or below its limit price.
+/// Orders fill at their limit price, which is conservative (the exchange might fill at a better price).
+class FokSimulator : public tradebot::OrderSimulator
+{
+public:
+    struct Options
+    {
+        /// \brief Proportion of the exchanged amount taken as commission
+        /// (in quote for sell orders, in base for buy orders).
+        Decimal commission{"0.001"};
+        /// \brief If strictly positive, orders larger than this factor times the quantity
+        /// of the latest trade expire (a crude model of the available liquidity).
+        Decimal liquidityFactor{0};
+    };
+
+    explicit FokSimulator(Options aOptions);
+
+    void onTrade(const tradebot::marketdata::AggregateTrade & aTrade);
+
+    std::optional<tradebot::FulfilledOrder> fillLimitFokOrder(tradebot::Order & aOrder,
+                                                              Decimal aLimitPrice) override;
+
+    /// \brief Since the market does not move while orders are handled, an expired order
+    /// would expire again: the trader predicate uses this to stop retrying.
+    ///
+    /// \return True if the latest attempt expired, once: the retry loop of the expired order
+    /// is interrupted, but the next order (e.g. on the other side) is still attempted.
+    bool takeExpired()
+    { return std::exchange(expired, false); }
+
+    /// \brief Return the orders filled since the previous call.
+    std::vector<tradebot::FulfilledOrder> takeFilled();
+
+private:
+    Options options;
+    tradebot::marketdata::AggregateTrade latestTrade{};
+    Decimal latestPrice{0};
+    bool latestPriceCurrent{false};
+    bool expired{false};
+    long nextExchangeId{1};
+    std::vector<tradebot::FulfilledOrder> filled;
+};
+
+
+/// \brief State of the backtest at a point in (replayed) time.
+struct Sample
+{
+    MillisecondsSinceEpoch time;
+    Decimal price;
+    std::size_t sellFragments;
+    std::size_t buyFragments;
+    std::size_t intervalChanges;
+    std::uint64_t filledSellOrders;
+    std::uint64_t filledBuyOrders;
+    Decimal takenHomeQuote;
+    Decimal takenHomeBase;
+};
+
+
+/// \brief Replay recorded aggregate trades through an `IntervalTracker`, a `Trader` and its spawner,
+/// as the production bot would handle them live.
+///
+/// The trader uses an in-memory database and a FokSimulator.
+class Backtest
+{
+public:
+    struct Options
+    {
+        tradebot::SymbolFilters filters;
+        FokSimulator::Options simulation;
+        /// \brief Period of the samples, in replayed time.
+        std::chrono::milliseconds samplePeriod{std::chrono::hours{1}};
+    };
+
+    /// \brief Read the options from the optional `backtest` section of a configuration.
+    ///
+    /// The exchange is not queried, so the symbol filters are read from this section.
+    static Options readOptions(const Json & aBacktestConfig);
+
+    /// \param aConfig A production bot configuration (ladder, spawner and initial fragments).
+    Backtest(const Json & aConfig, Options aOptions);
+
+    void replay(const tradebot::marketdata::AggregateTrade * aBegin,
+                const tradebot::marketdata::AggregateTrade * aEnd);
+
+    /// \brief Record a final sample, at the latest replayed trade.
+    void finish();
+
+    void writeSamples(std::ostream & aOut) const;
+
+    void logSummary() const;
+
+    const std::vector<Sample> & getSamples() const
+    { return samples; }
+
+    /// \brief Duration of handling each interval change (placing, filling and spawning), in microseconds.
+    const trade::Histogram & getIntervalChangeCost() const
+    { return intervalChangeCost; }
+
+private:
+    void onTrade(const tradebot::marketdata::AggregateTrade & aTrade);
+    void onIntervalChange(Interval aInterval);
+    /// \brief Update the fixed point bounds of the current interval, used to skip trades not changing it.
+    void updateBounds();
+    void sample(MillisecondsSinceEpoch aTime);
+
+    Options options;
+    tradebot::Trader trader;
+    FokSimulator * simulator;
+    trade::IntervalTracker tracker;
+
+    std::int64_t lowerBound;
+    std::int64_t upperBound;
+    tradebot::marketdata::AggregateTrade latestTrade{};
+    MillisecondsSinceEpoch nextSample{0};
+    std::size_t intervalChanges{0};
+    std::uint64_t filledSellOrders{0};
+    std::uint64_t filledBuyOrders{0};
+    Decimal takenHomeQuote{0};
+    Decimal takenHomeBase{0};
+    trade::Histogram intervalChangeCost;
+    std::vector<Sample> samples;
+};
+
+
+} // namespace backtest
+} // namespace ad
@@ -0,0 +1,183 @@
+#include "Sweep.h"
+
+#include <tradebot/Logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+
+namespace ad {
+namespace backtest {
+
+
+Sweep::Sweep(Json aBaseConfig, const Json & aSweepConfig, Backtest::Options aOptions) :
+    baseConfig{std::move(aBaseConfig)},
+    options{std::move(aOptions)},
+    threadCount{aSweepConfig.value("threads", std::size_t{0})}
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (const auto & [pointer, values] : aSweepConfig.at("parameters").items())
+    {
+        if (! values.is_array() || values.empty())
+        {
+            spdlog::critical("Sweep parameter '{}' must list at least one value.", pointer);
+            throw std::invalid_argument{"Sweep parameter values must be a non-empty array."};
+        }
+
+        SweepParameter parameter{Json::json_pointer{pointer}, values.get<std::vector<Json>>()};
+        if (! baseConfig.contains(parameter.pointer))
+        {
+            spdlog::critical("Sweep parameter '{}' is not present in the base configuration.", pointer);
+            throw std::invalid_argument{"Sweep parameters must override existing configuration values."};
+        }
+        combinationCount *= parameter.values.size();
+        parameters.push_back(std::move(parameter));
+    }
+}
+
+
+Json Sweep::getParameters(std::size_t aCombination) const
+{
+    // Mixed radix decomposition of the combination index, the first parameter varying fastest.
+    Json result = Json::object();
+    for (const SweepParameter & parameter : parameters)
+    {
+        result[parameter.pointer.to_string()] = parameter.values[aCombination % parameter.values.size()];
+        aCombination /= parameter.values.size();
+    }
+    return result;
+}
+
+
+Json Sweep::getConfiguration(std::size_t aCombination) const
+{
+    Json config = baseConfig;
+    for (const auto & [pointer, value] : getParameters(aCombination).items())
+    {
+        config[Json::json_pointer{pointer}] = value;
+    }
+    return config;
+}
+
+
+SweepResult Sweep::evaluate(std::size_t aCombination, const std::vector<TradeRange> & aTrades) const
+{
+    SweepResult result{aCombination, getParameters(aCombination)};
+    try
+    {
+        Backtest backtest{getConfiguration(aCombination), options};
+        for (const auto & [begin, end] : aTrades)
+        {
+            backtest.replay(begin, end);
+        }
+        backtest.finish();
+
+        const Sample & final = backtest.getSamples().back();
+        result.score = final.takenHomeQuote + final.takenHomeBase * final.price;
+        result.final = final;
+        result.meanIntervalChangeCost = backtest.getIntervalChangeCost().summarize().mean;
+    }
+    catch (std::exception & aException)
+    {
+        result.error = aException.what();
+    }
+    return result;
+}
+
+
+std::vector<SweepResult> Sweep::run(const std::vector<TradeRange> & aTrades) const
+{
+    std::vector<SweepResult> results(combinationCount);
+    std::atomic<std::size_t> nextCombination{0};
+
+    // Each worker picks the next combination until all are evaluated:
+    // the run durations vary with the parameters, so a static partition would leave threads idle.
+    auto work = [&]()
+    {
+        for (std::size_t combination = nextCombination++;
+             combination < combinationCount;
+             combination = nextCombination++)
+        {
+            results[combination] = evaluate(combination, aTrades);
+            if (results[combination].error)
+            {
+                spdlog::warn("Combination {} failed: {}.", combination, *results[combination].error);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t threadId = 0; threadId != std::min(threadCount, combinationCount); ++threadId)
+    {
+        threads.emplace_back(work);
+    }
+    for (std::thread & thread : threads)
+    {
+        thread.join();
+    }
+
+    std::stable_sort(results.begin(), results.end(),
+                     [](const SweepResult & aLhs, const SweepResult & aRhs)
+                     {
+                        if (aLhs.error || aRhs.error)
+                        {
+                            return ! aLhs.error && aRhs.error;
+                        }
+                        return aLhs.score > aRhs.score;
+                     });
+    return results;
+}
+
+
+void Sweep::writeRanking(std::ostream & aOut, const std::vector<SweepResult> & aResults)
+{
+    aOut << "rank,combination,score,taken_home_quote,taken_home_base,final_price,"
+            "sell_fragments,buy_fragments,interval_changes,filled_sell_orders,filled_buy_orders,"
+            "mean_interval_change_cost_us,parameters,error\n";
+
+    // Parameters are written as a quoted JSON object, doubling the embedded quotes.
+    auto quote = [](std::string aValue)
+    {
+        std::string result{'"'};
+        for (char character : aValue)
+        {
+            result += (character == '"') ? std::string{"\"\""} : std::string{character};
+        }
+        return result + '"';
+    };
+
+    std::size_t rank = 1;
+    for (const SweepResult & result : aResults)
+    {
+        aOut << rank++ << ',' << result.combination << ',';
+        if (result.final)
+        {
+            const Sample & final = *result.final;
+            aOut << to_str(result.score) << ','
+                 << to_str(final.takenHomeQuote) << ','
+                 << to_str(final.takenHomeBase) << ','
+                 << to_str(final.price) << ','
+                 << final.sellFragments << ','
+                 << final.buyFragments << ','
+                 << final.intervalChanges << ','
+                 << final.filledSellOrders << ','
+                 << final.filledBuyOrders << ','
+                 << result.meanIntervalChangeCost << ',';
+        }
+        else
+        {
+            aOut << ",,,,,,,,,,";
+        }
+        aOut << quote(result.parameters.dump()) << ','
+             << quote(result.error.value_or("")) << '\n';
+    }
+}
+
+
+} // namespace backtest
+} // namespace ad
@@ -0,0 +1,101 @@
+#pragma once
+
+
+#include "Backtest.h"
+
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace ad {
+namespace backtest {
+
+
+/// \brief A contiguous range of recorded trades (e.g. a memory-mapped archive).
+using TradeRange = std::pair<const tradebot::marketdata::AggregateTrade *,
+                             const tradebot::marketdata::AggregateTrade *>;
+
+
+/// \brief A configuration value to sweep: the JSON pointer of the value
+/// in the production bot configuration, and the alternatives to evaluate.
+struct SweepParameter
+{
+    Json::json_pointer pointer;
+    std::vector<Json> values;
+};
+
+
+/// \brief Outcome of the backtest of one combination of the sweep parameters.
+struct SweepResult
+{
+    std::size_t combination;
+    /// \brief Object mapping each parameter pointer to its value in this combination.
+    Json parameters;
+    /// \brief Set if the backtest could not run (e.g. the initial fragments do not fit the ladder).
+    std::optional<std::string> error;
+    /// \brief The taken home amounts, valued in quote at the final price.
+    Decimal score{0};
+    /// \brief State at the end of the replay.
+    std::optional<Sample> final;
+    double meanIntervalChangeCost{0.};
+};
+
+
+/// \brief Evaluate all the combinations of a set of configuration parameters,
+/// each by a backtest isolated in its own trader (and in-memory database),
+/// running in parallel over a fixed number of threads.
+///
+/// The sweep configuration has the form:
+///
+///     {
+///         "threads": 0,
+///         "parameters": {
+///             "/ladder/factor": ["1.015", "1.021"],
+///             "/spawner/spreader/proportions": [["0.5", "0.5"], ["0.3", "0.4", "0.3"]]
+///         }
+///     }
+///
+/// where each key is a JSON pointer into the production bot configuration.
+/// A `threads` value of 0 uses all the hardware threads.
+class Sweep
+{
+public:
+    Sweep(Json aBaseConfig, const Json & aSweepConfig, Backtest::Options aOptions);
+
+    /// \brief Number of combinations (the product of the number of values of each parameter).
+    std::size_t size() const
+    { return combinationCount; }
+
+    std::size_t getThreadCount() const
+    { return threadCount; }
+
+    /// \brief The production bot configuration for combination `aCombination`.
+    Json getConfiguration(std::size_t aCombination) const;
+
+    /// \brief Parameter values of combination `aCombination`, keyed by their pointer.
+    Json getParameters(std::size_t aCombination) const;
+
+    /// \brief Backtest each combination over the trade ranges, replayed in order.
+    ///
+    /// \attention The trade ranges are read concurrently, they must stay valid until this returns.
+    /// \return The results, ranked by decreasing score (failed combinations last).
+    std::vector<SweepResult> run(const std::vector<TradeRange> & aTrades) const;
+
+    static void writeRanking(std::ostream & aOut, const std::vector<SweepResult> & aResults);
+
+private:
+    SweepResult evaluate(std::size_t aCombination, const std::vector<TradeRange> & aTrades) const;
+
+    Json baseConfig;
+    Backtest::Options options;
+    std::vector<SweepParameter> parameters;
+    std::size_t combinationCount{1};
+    std::size_t threadCount;
+};
+
+
+} // namespace backtest
+} // namespace ad
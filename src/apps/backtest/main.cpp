@@ -0,0 +1,150 @@
+#include "Backtest.h"
+#include "Sweep.h"
+
+#include <tradebot/Logging.h>
+#include <tradebot/marketdata/TradeArchive.h>
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include <cstdlib>
+
+
+using namespace ad;
+
+
+void printUsage(const std::string aCommand)
+{
+    std::cerr << "Usage: " << aCommand << " config-path report-path archive [archive...]\n"
+              << "       " << aCommand << " sweep sweep-path config-path ranking-path archive [archive...]\n"
+        ;
+}
+
+
+/// \brief Read the configuration and set the log level from its `backtest` section.
+Json readConfig(const std::string & aPath)
+{
+    Json config = Json::parse(std::ifstream{aPath});
+    // Logging each order would dominate the run time.
+    spdlog::set_level(spdlog::level::from_str(
+        config.value("backtest", Json::object()).value("logLevel", "warn")));
+    return config;
+}
+
+
+std::vector<std::unique_ptr<tradebot::marketdata::TradeFileReader>>
+openArchives(char * aBegin[], char * aEnd[])
+{
+    std::vector<std::unique_ptr<tradebot::marketdata::TradeFileReader>> readers;
+    for (; aBegin != aEnd; ++aBegin)
+    {
+        readers.push_back(std::make_unique<tradebot::marketdata::TradeFileReader>(*aBegin));
+    }
+    return readers;
+}
+
+
+int runBacktest(const std::string & aConfigPath, const std::string & aReportPath, char * aBegin[], char * aEnd[])
+{
+    Json config = readConfig(aConfigPath);
+    backtest::Backtest backtest{
+        config,
+        backtest::Backtest::readOptions(config.value("backtest", Json::object()))
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t tradeCount = 0;
+    for (const auto & reader : openArchives(aBegin, aEnd))
+    {
+        backtest.replay(reader->begin(), reader->end());
+        tradeCount += reader->size();
+    }
+    backtest.finish();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    std::ofstream report{aReportPath};
+    backtest.writeSamples(report);
+
+    spdlog::set_level(spdlog::level::info);
+    spdlog::info("Replayed {} trades in {} ms.",
+                 tradeCount,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+    backtest.logSummary();
+    return EXIT_SUCCESS;
+}
+
+
+int runSweep(const std::string & aSweepPath,
+             const std::string & aConfigPath,
+             const std::string & aRankingPath,
+             char * aBegin[], char * aEnd[])
+{
+    Json config = readConfig(aConfigPath);
+    backtest::Sweep sweep{
+        config,
+        Json::parse(std::ifstream{aSweepPath}),
+        backtest::Backtest::readOptions(config.value("backtest", Json::object()))
+    };
+
+    // The archives are mapped once, and replayed concurrently by all the backtests.
+    auto readers = openArchives(aBegin, aEnd);
+    std::vector<backtest::TradeRange> trades;
+    for (const auto & reader : readers)
+    {
+        trades.emplace_back(reader->begin(), reader->end());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<backtest::SweepResult> results = sweep.run(trades);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    std::ofstream ranking{aRankingPath};
+    backtest::Sweep::writeRanking(ranking, results);
+
+    spdlog::set_level(spdlog::level::info);
+    spdlog::info("Evaluated {} combinations on {} threads in {} s.",
+                 sweep.size(),
+                 sweep.getThreadCount(),
+                 std::chrono::duration_cast<std::chrono::seconds>(elapsed).count());
+    for (std::size_t rank = 0; rank != std::min<std::size_t>(results.size(), 5); ++rank)
+    {
+        if (! results[rank].error)
+        {
+            spdlog::info("#{} scores {} with {}.",
+                         rank + 1,
+                         results[rank].score,
+                         results[rank].parameters.dump());
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char * argv[])
+{
+    try
+    {
+        if (argc >= 6 && argv[1] == std::string{"sweep"})
+        {
+            return runSweep(argv[2], argv[3], argv[4], argv + 5, argv + argc);
+        }
+        else if (argc >= 4 && argv[1] != std::string{"sweep"})
+        {
+            return runBacktest(argv[1], argv[2], argv + 3, argv + argc);
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    catch (std::exception & aException)
+    {
+        spdlog::critical("Uncaught exception: {}", aException.what());
+        return EXIT_FAILURE;
+    }
+}
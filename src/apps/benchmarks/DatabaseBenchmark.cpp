@@ -0,0 +1,97 @@
+#include "DatabaseBenchmark.h"
+
+#include <tradebot/Database.h>
+
+#include <filesystem>
+#include <string>
+
+
+namespace ad {
+namespace benchmark {
+
+
+namespace {
+
+
+    void removeDatabase(const std::filesystem::path & aPath)
+    {
+        for (const char * suffix : {"", "-wal", "-shm"})
+        {
+            std::filesystem::remove(aPath.string() + suffix);
+        }
+    }
+
+
+    void benchmarkProfile(const std::string & aProfile,
+                          std::size_t aFragmentCount,
+                          std::size_t aRepetitions,
+                          std::vector<Measure> & aMeasures)
+    {
+        const std::filesystem::path path =
+            std::filesystem::temp_directory_path() / ("tradebot-benchmark-" + aProfile + ".sqlite");
+        removeDatabase(path);
+
+        {
+            const tradebot::Pair pair{"DOGE", "BUSD"};
+            const Decimal rate{"0.25"};
+            tradebot::Database database{path.string(), {}, tradebot::makeDatabaseProfile(aProfile)};
+
+            std::size_t inserted = 0;
+            auto insertFragment = [&]()
+            {
+                database.insert(tradebot::Fragment{
+                    pair.base,
+                    pair.quote,
+                    Decimal{"10"} + Decimal{inserted % 100} / 7,
+                    rate + Decimal{inserted % 20} / 100,
+                    (inserted % 2) ? tradebot::Side::Buy : tradebot::Side::Sell,
+                });
+                ++inserted;
+            };
+            aMeasures.push_back(measure(aProfile + ", insert fragment", aFragmentCount, insertFragment));
+
+            aMeasures.push_back(measure(aProfile + ", sum profitable fragments", aRepetitions, [&]()
+            {
+                database.sumProfitableFragments(tradebot::Side::Sell, Decimal{"1"}, pair);
+            }));
+
+            aMeasures.push_back(measure(aProfile + ", prepare and discard order", aRepetitions, [&]()
+            {
+                tradebot::Order order = database.prepareOrder("benchmark", tradebot::Side::Sell, rate, pair);
+                database.discardOrder(order);
+            }));
+
+            tradebot::Order order = database.prepareOrder("benchmark", tradebot::Side::Sell, rate, pair);
+            aMeasures.push_back(measure(aProfile + ", update order", aRepetitions, [&]()
+            {
+                order.status = (order.status == tradebot::Order::Status::Sending) ?
+                    tradebot::Order::Status::Active : tradebot::Order::Status::Sending;
+                database.update(order);
+            }));
+
+            aMeasures.push_back(measure(aProfile + ", fragment totals", aRepetitions, [&]()
+            {
+                database.getFragmentTotals(tradebot::Side::Buy, pair);
+            }));
+        }
+
+        removeDatabase(path);
+    }
+
+
+} // anonymous namespace
+
+
+std::vector<Measure> benchmarkDatabase(std::size_t aFragmentCount, std::size_t aRepetitions)
+{
+    std::vector<Measure> measures;
+    for (const std::string profile : {"default", "durable", "fast"})
+    {
+        benchmarkProfile(profile, aFragmentCount, aRepetitions, measures);
+    }
+    return measures;
+}
+
+
+} // namespace benchmark
+} // namespace ad
@@ -0,0 +1,21 @@
+#pragma once
+
+
+#include "Measure.h"
+
+#include <cstddef>
+#include <vector>
+
+
+namespace ad {
+namespace benchmark {
+
+
+/// \brief Measure the statements of the trading loop on a database file, for each database profile.
+///
+/// \param aFragmentCount The number of unassociated fragments in the database.
+std::vector<Measure> benchmarkDatabase(std::size_t aFragmentCount, std::size_t aRepetitions);
+
+
+} // namespace benchmark
+} // namespace ad
@@ -0,0 +1,40 @@
+#pragma once
+
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <utility>
+
+
+namespace ad {
+namespace benchmark {
+
+
+struct Measure
+{
+    std::string name;
+    std::chrono::nanoseconds total;
+    std::size_t iterations;
+};
+
+
+/// \brief Time `aIterations` successive calls to `aFunction`.
+template <class T_function>
+Measure measure(std::string aName, std::size_t aIterations, T_function && aFunction)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t iteration = 0; iteration != aIterations; ++iteration)
+    {
+        aFunction();
+    }
+    return {
+        std::move(aName),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start),
+        aIterations,
+    };
+}
+
+
+} // namespace benchmark
+} // namespace ad
@@ -0,0 +1,132 @@
+#include "SpawnBenchmark.h"
+
+#include <tradebot/Database.h>
+#include <tradebot/Spawner.h>
+#include <tradebot/spawners/StableDownSpread.h>
+
+#include <trademath/Function.h>
+#include <trademath/Ladder.h>
+#include <trademath/Spawn.h>
+#include <trademath/Spreaders.h>
+
+
+namespace ad {
+namespace benchmark {
+
+
+namespace {
+
+
+    std::vector<tradebot::Fragment> makeFragments(std::size_t aCount,
+                                                  tradebot::Side aSide,
+                                                  Decimal aRate,
+                                                  long aSpawningOrder)
+    {
+        std::vector<tradebot::Fragment> fragments;
+        for (std::size_t fragmentId = 0; fragmentId != aCount; ++fragmentId)
+        {
+            fragments.push_back(tradebot::Fragment{
+                "DOGE",
+                "BUSD",
+                Decimal{"10"} + Decimal{fragmentId % 100} / 7,
+                aRate,
+                aSide,
+                0,
+                aSpawningOrder,
+            });
+        }
+        return fragments;
+    }
+
+
+    tradebot::FulfilledOrder makeFulfilled(tradebot::Side aSide, Decimal aRate)
+    {
+        tradebot::FulfilledOrder order;
+        order.traderName = "benchmark";
+        order.base = "DOGE";
+        order.quote = "BUSD";
+        order.fragmentsRate = aRate;
+        order.side = aSide;
+        order.status = tradebot::Order::Status::Fulfilled;
+        order.executionRate = aRate;
+        return order;
+    }
+
+
+} // anonymous namespace
+
+
+std::vector<Measure> benchmarkSpawn(std::size_t aFragmentCount, std::size_t aRepetitions)
+{
+    const trade::Ladder ladder = trade::makeLadder(Decimal{"0.1"}, Decimal{"1.01"}, 400, Decimal{"0.0001"});
+
+    tradebot::spawner::StableDownSpread<trade::ProportionSpreader> spawner{
+        trade::ProportionSpreader{
+            ladder,
+            trade::ProportionsMap{
+                {ladder.back(), {Decimal{"0.1"}, Decimal{"0.2"}, Decimal{"0.3"}, Decimal{"0.4"}}},
+            },
+            Decimal{"0.01"},
+        },
+        Decimal{"0.4"},
+        Decimal{"0.2"},
+        Decimal{"0.3"},
+    };
+
+    // The parent sell order of the subsequent buy fragments.
+    tradebot::Database database{":memory:"};
+    tradebot::Order parent = makeFulfilled(tradebot::Side::Sell, ladder.at(300));
+    database.insert(parent);
+
+    tradebot::FulfilledOrder sellOrder = makeFulfilled(tradebot::Side::Sell, ladder.at(250));
+    std::vector<tradebot::Fragment> initialSells =
+        makeFragments(aFragmentCount, tradebot::Side::Sell, ladder.at(250), -1);
+    tradebot::FulfilledOrder buyOrder = makeFulfilled(tradebot::Side::Buy, ladder.at(200));
+    std::vector<tradebot::Fragment> subsequentBuys =
+        makeFragments(aFragmentCount, tradebot::Side::Buy, ladder.at(200), parent.id);
+
+    tradebot::SpawnBuffer buffer;
+    auto spawnOrder = [&](bool aStatic,
+                          std::vector<tradebot::Fragment> & aFragments,
+                          const tradebot::FulfilledOrder & aOrder)
+    {
+        return [&, aStatic]()
+        {
+            buffer.clear();
+            tradebot::ParentOrders parents{database};
+            if (aStatic)
+            {
+                spawner.computeOrderSpawns(aFragments, aOrder, parents, buffer);
+            }
+            else
+            {
+                // The default implementation, making a virtual call per fragment.
+                spawner.SpawnerBase::computeOrderSpawns(aFragments, aOrder, parents, buffer);
+            }
+            buffer.consolidate();
+        };
+    };
+
+    trade::Function<> erasedFunction{[](Decimal aValue) -> Decimal { return log(aValue); }};
+    trade::Function deducedFunction{[](Decimal aValue) -> Decimal { return log(aValue); }};
+    auto integrate = [&](auto aFunction)
+    {
+        return [&ladder, aFunction]()
+        {
+            trade::spawnIntegration(trade::Base{Decimal{"1000"}}, ladder.begin(), ladder.end(), aFunction);
+        };
+    };
+
+    return {
+        measure("initial sells, virtual dispatch", aRepetitions, spawnOrder(false, initialSells, sellOrder)),
+        measure("initial sells, batched spread", aRepetitions, spawnOrder(true, initialSells, sellOrder)),
+        measure("subsequent buys, virtual dispatch", aRepetitions, spawnOrder(false, subsequentBuys, buyOrder)),
+        measure("subsequent buys, static dispatch", aRepetitions, spawnOrder(true, subsequentBuys, buyOrder)),
+        measure("integration, std::function", aRepetitions, integrate(erasedFunction)),
+        measure("integration, deduced primitive", aRepetitions, integrate(deducedFunction)),
+    };
+}
+
+
+} // namespace benchmark
+} // namespace ad
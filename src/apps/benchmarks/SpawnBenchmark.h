@@ -0,0 +1,22 @@
+#pragma once
+
+
+#include "Measure.h"
+
+#include <cstddef>
+#include <vector>
+
+
+namespace ad {
+namespace benchmark {
+
+
+/// \brief Compare the per-fragment virtual dispatch of spawners to their static dispatch,
+/// and type-erased to deduced integration functions.
+///
+/// \param aFragmentCount The number of fragments composing each filled order.
+std::vector<Measure> benchmarkSpawn(std::size_t aFragmentCount, std::size_t aRepetitions);
+
+
+} // namespace benchmark
+} // namespace ad
@@ -0,0 +1,66 @@
+#include "DatabaseBenchmark.h"
+#include "SpawnBenchmark.h"
+
+#include <spdlog/spdlog.h>
+
+#include <iostream>
+#include <string>
+
+#include <cstdlib>
+
+
+using namespace ad;
+
+
+void printUsage(const std::string aCommand)
+{
+    std::cerr << "Usage: " << aCommand << " spawn [fragment-count] [repetitions]\n"
+              << "       " << aCommand << " database [fragment-count] [repetitions]\n"
+        ;
+}
+
+
+void report(const std::vector<benchmark::Measure> & aMeasures)
+{
+    for (const benchmark::Measure & measure : aMeasures)
+    {
+        std::cout << measure.name << ": "
+                  << measure.total.count() / 1000 / measure.iterations << " us per iteration"
+                  << " (" << measure.iterations << " iterations)\n";
+    }
+}
+
+
+int main(int argc, char * argv[])
+{
+    try
+    {
+        // Logging would dominate the measures.
+        spdlog::set_level(spdlog::level::warn);
+
+        if (argc >= 2 && argv[1] == std::string{"spawn"})
+        {
+            std::size_t fragmentCount = (argc >= 3) ? std::stoul(argv[2]) : 1000;
+            std::size_t repetitions = (argc >= 4) ? std::stoul(argv[3]) : 20;
+            report(benchmark::benchmarkSpawn(fragmentCount, repetitions));
+            return EXIT_SUCCESS;
+        }
+        else if (argc >= 2 && argv[1] == std::string{"database"})
+        {
+            std::size_t fragmentCount = (argc >= 3) ? std::stoul(argv[2]) : 1000;
+            std::size_t repetitions = (argc >= 4) ? std::stoul(argv[3]) : 200;
+            report(benchmark::benchmarkDatabase(fragmentCount, repetitions));
+            return EXIT_SUCCESS;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    catch (std::exception & aException)
+    {
+        spdlog::critical("Uncaught exception: {}", aException.what());
+        return EXIT_FAILURE;
+    }
+}
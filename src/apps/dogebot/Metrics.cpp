@@ -0,0 +1,293 @@
+#include "Metrics.h"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <mutex>
+#include <optional>
+
+
+namespace ad {
+namespace trade {
+
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+
+namespace {
+
+
+    void writeLabels(std::ostream & aOut, const PrometheusText::Labels & aLabels)
+    {
+        if (aLabels.empty())
+        {
+            return;
+        }
+
+        aOut << '{';
+        for (std::size_t index = 0; index != aLabels.size(); ++index)
+        {
+            aOut << (index == 0 ? "" : ",")
+                 << aLabels[index].first << "=\"" << PrometheusText::escape(aLabels[index].second) << '"';
+        }
+        aOut << '}';
+    }
+
+
+} // anonymous namespace
+
+
+PrometheusText::PrometheusText()
+{
+    // Large enough to write counters exactly (default precision is 6 significant digits).
+    out.precision(15);
+}
+
+
+PrometheusText & PrometheusText::declare(const std::string & aName,
+                                         const std::string & aType,
+                                         const std::string & aHelp)
+{
+    out << "# HELP " << aName << ' ' << aHelp << '\n'
+        << "# TYPE " << aName << ' ' << aType << '\n';
+    return *this;
+}
+
+
+PrometheusText & PrometheusText::sample(const std::string & aName, double aValue, const Labels & aLabels)
+{
+    out << aName;
+    writeLabels(out, aLabels);
+    out << ' ' << aValue << '\n';
+    return *this;
+}
+
+
+PrometheusText & PrometheusText::summary(const std::string & aName,
+                                         const Histogram & aHistogram,
+                                         const Labels & aLabels)
+{
+    static const std::array<std::pair<const char *, double>, 4> gQuantiles{{
+        {"0.5", 50.},
+        {"0.9", 90.},
+        {"0.99", 99.},
+        {"0.999", 99.9},
+    }};
+
+    for (auto [quantile, percentile] : gQuantiles)
+    {
+        Labels labels{aLabels};
+        labels.emplace_back("quantile", quantile);
+        sample(aName, static_cast<double>(aHistogram.valueAtPercentile(percentile)), labels);
+    }
+    sample(aName + "_sum", static_cast<double>(aHistogram.sum()), aLabels);
+    sample(aName + "_count", static_cast<double>(aHistogram.count()), aLabels);
+    return *this;
+}
+
+
+std::string PrometheusText::escape(const std::string & aLabelValue)
+{
+    std::string result;
+    result.reserve(aLabelValue.size());
+    for (char character : aLabelValue)
+    {
+        switch(character)
+        {
+            case '\\':
+                result += "\\\\";
+                break;
+            case '"':
+                result += "\\\"";
+                break;
+            case '\n':
+                result += "\\n";
+                break;
+            default:
+                result += character;
+        }
+    }
+    return result;
+}
+
+
+struct MetricsServer::Impl : public std::enable_shared_from_this<MetricsServer::Impl>
+{
+    Impl(net::io_context & aContext, Render aRender) :
+        acceptor{net::make_strand(aContext)},
+        render{std::move(aRender)}
+    {}
+
+    void listen(const std::string & aAddress, unsigned short aPort);
+    void accept();
+
+    /// \return The metrics, or an empty optional if the server is stopped.
+    std::optional<std::string> renderMetrics();
+
+    void stop();
+
+    tcp::acceptor acceptor;
+    std::mutex renderMutex;
+    Render render;
+};
+
+
+/// \brief Serve a single request on a connection, then close it.
+class MetricsServer::Session : public std::enable_shared_from_this<MetricsServer::Session>
+{
+public:
+    Session(tcp::socket && aSocket, std::shared_ptr<MetricsServer::Impl> aServer) :
+        stream{std::move(aSocket)},
+        server{std::move(aServer)}
+    {}
+
+    void start()
+    {
+        stream.expires_after(std::chrono::seconds{10});
+        http::async_read(stream, buffer, request,
+                         beast::bind_front_handler(&Session::onRead, shared_from_this()));
+    }
+
+private:
+    void onRead(beast::error_code aErrorCode, std::size_t /*aBytes*/)
+    {
+        if (aErrorCode)
+        {
+            if (aErrorCode != http::error::end_of_stream)
+            {
+                spdlog::debug("Metrics request read error: {}.", aErrorCode.message());
+            }
+            return;
+        }
+
+        response.version(request.version());
+        response.keep_alive(false);
+        response.set(http::field::server, "dogebot");
+
+        if (request.method() != http::verb::get || request.target() != "/metrics")
+        {
+            response.result(http::status::not_found);
+            response.set(http::field::content_type, "text/plain");
+            response.body() = "Metrics are served at '/metrics'.\n";
+        }
+        else if (std::optional<std::string> metrics = server->renderMetrics())
+        {
+            response.result(http::status::ok);
+            response.set(http::field::content_type, "text/plain; version=0.0.4");
+            response.body() = std::move(*metrics);
+        }
+        else
+        {
+            response.result(http::status::service_unavailable);
+        }
+        response.prepare_payload();
+
+        http::async_write(stream, response,
+                          beast::bind_front_handler(&Session::onWrite, shared_from_this()));
+    }
+
+    void onWrite(beast::error_code aErrorCode, std::size_t /*aBytes*/)
+    {
+        if (aErrorCode)
+        {
+            spdlog::debug("Metrics response write error: {}.", aErrorCode.message());
+        }
+        beast::error_code ignored;
+        stream.socket().shutdown(tcp::socket::shutdown_send, ignored);
+    }
+
+    beast::tcp_stream stream;
+    beast::flat_buffer buffer;
+    http::request<http::empty_body> request;
+    http::response<http::string_body> response;
+    std::shared_ptr<MetricsServer::Impl> server;
+};
+
+
+void MetricsServer::Impl::listen(const std::string & aAddress, unsigned short aPort)
+{
+    tcp::endpoint endpoint{net::ip::make_address(aAddress), aPort};
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(net::socket_base::reuse_address(true));
+    acceptor.bind(endpoint);
+    acceptor.listen(net::socket_base::max_listen_connections);
+    spdlog::info("Serving metrics on 'http://{}:{}/metrics'.", aAddress, acceptor.local_endpoint().port());
+}
+
+
+void MetricsServer::Impl::accept()
+{
+    acceptor.async_accept(
+        net::make_strand(acceptor.get_executor()),
+        [self = shared_from_this()](beast::error_code aErrorCode, tcp::socket aSocket)
+        {
+            if (aErrorCode == net::error::operation_aborted)
+            {
+                spdlog::debug("Metrics server stopped accepting connections.");
+                return;
+            }
+            else if (aErrorCode)
+            {
+                spdlog::error("Metrics server accept error: {}. Will try to go on.", aErrorCode.message());
+            }
+            else
+            {
+                std::make_shared<Session>(std::move(aSocket), self)->start();
+            }
+            self->accept();
+        });
+}
+
+
+std::optional<std::string> MetricsServer::Impl::renderMetrics()
+{
+    std::lock_guard<std::mutex> lock{renderMutex};
+    if (render)
+    {
+        return render();
+    }
+    return {};
+}
+
+
+void MetricsServer::Impl::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{renderMutex};
+        render = nullptr;
+    }
+    net::post(acceptor.get_executor(), [self = shared_from_this()]()
+    {
+        beast::error_code ignored;
+        self->acceptor.close(ignored);
+    });
+}
+
+
+MetricsServer::MetricsServer(net::io_context & aContext,
+                             const std::string & aAddress,
+                             unsigned short aPort,
+                             Render aRender) :
+    impl{std::make_shared<Impl>(aContext, std::move(aRender))}
+{
+    impl->listen(aAddress, aPort);
+    impl->accept();
+}
+
+
+MetricsServer::~MetricsServer()
+{
+    impl->stop();
+}
+
+
+} // namespace trade
+} // namespace ad
@@ -0,0 +1,79 @@
+#pragma once
+
+
+#include <trademath/Histogram.h>
+
+#include <boost/asio/io_context.hpp>
+
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace ad {
+namespace trade {
+
+
+/// \brief Assemble metrics in Prometheus text exposition format (version 0.0.4).
+class PrometheusText
+{
+public:
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    PrometheusText();
+
+    /// \brief Write the HELP and TYPE lines, once per metric name.
+    PrometheusText & declare(const std::string & aName, const std::string & aType, const std::string & aHelp);
+
+    /// \brief Write a single sample, the metric must have been declared before.
+    PrometheusText & sample(const std::string & aName, double aValue, const Labels & aLabels = {});
+
+    /// \brief Write a histogram as a summary (quantiles, sum and count) of a declared metric.
+    PrometheusText & summary(const std::string & aName,
+                             const Histogram & aHistogram,
+                             const Labels & aLabels = {});
+
+    std::string str() const
+    { return out.str(); }
+
+    static std::string escape(const std::string & aLabelValue);
+
+private:
+    std::ostringstream out;
+};
+
+
+/// \brief Minimal HTTP listener serving the text returned by a callback on `GET /metrics`.
+///
+/// All connections are handled on the provided io_context, and closed after each response.
+class MetricsServer
+{
+    struct Impl;
+    class Session;
+
+public:
+    using Render = std::function<std::string(void)>;
+
+    /// \param aAddress Address to listen on, it should usually be a loopback address.
+    MetricsServer(boost::asio::io_context & aContext,
+                  const std::string & aAddress,
+                  unsigned short aPort,
+                  Render aRender);
+
+    /// \brief Stop listening. Requests still in flight after destruction are answered with an error,
+    /// the render callback is not invoked anymore.
+    ~MetricsServer();
+
+private:
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer & operator = (const MetricsServer &) = delete;
+
+    std::shared_ptr<Impl> impl;
+};
+
+
+} // namespace trade
+} // namespace ad
@@ -1,11 +1,14 @@
 #include "ProductionBot.h"
 
+#include "Metrics.h"
+
 #include <tradebot/Exchange.h>
 #include <tradebot/Logging.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/asio/post.hpp>
 
+#include <algorithm>
 #include <cstdlib>
 
 
@@ -21,49 +24,6 @@ namespace trade {
 static const std::chrono::milliseconds gProdbotReceiveWindow{15000};
 
 
-std::optional<Interval> IntervalTracker::update(Decimal aLatestPrice)
-{
-    trade::Ladder::const_reverse_iterator newLowerBound =
-        std::find_if(ladder.crbegin(), ladder.crend(), [&, this](auto stop)
-            {
-                return stop <= aLatestPrice;
-            });
-
-    if (   newLowerBound == ladder.crend()
-        || newLowerBound == ladder.crbegin())
-    {
-        if (ladder.size())
-        {
-            spdlog::warn("Price {} is out of the ladder interval [{}, {}].",
-                    aLatestPrice,
-                    ladder.front(),
-                    ladder.back());
-        }
-        else
-        {
-            spdlog::critical("Empty ladder is not allowed in an interval tracker.");
-            throw std::runtime_error{"The interval tracker ladder is empty."};
-        }
-    }
-
-    if (newLowerBound != std::exchange(lowerBound, newLowerBound))
-    {
-        return Interval{lowerBound == ladder.crend()   ? *(lowerBound-1) : *lowerBound,
-                        lowerBound == ladder.crbegin() ?     *lowerBound : *(lowerBound-1)};
-    }
-    else
-    {
-        return {};
-    }
-}
-
-
-void IntervalTracker::reset()
-{
-    lowerBound = ladder.crend();
-}
-
-
 void StatsWriter::start()
 {
     initializeAndCatchUp();
@@ -127,19 +87,117 @@ void StatsWriter::onTimer(const boost::system::error_code & aErrorCode)
 }
 
 
+void LatencyWriter::start()
+{
+    timer.expires_after(period);
+    async_wait();
+}
+
+
+void LatencyWriter::async_wait()
+{
+    timer.async_wait(std::bind(&LatencyWriter::onTimer, this, std::placeholders::_1));
+}
+
+
+void LatencyWriter::onTimer(const boost::system::error_code & aErrorCode)
+{
+    if (aErrorCode == boost::asio::error::operation_aborted)
+    {
+        spdlog::debug("Latency timer aborted.");
+        return;
+    }
+    else if (aErrorCode)
+    {
+        spdlog::error("Error on latency timer: {}. Will try to go on.", aErrorCode.message());
+    }
+    else
+    {
+        trader.latency->dump();
+    }
+
+    timer.expires_after(period);
+    async_wait();
+}
+
+
+void ArchiveWriter::start()
+{
+    timer.expires_after(period);
+    async_wait();
+}
+
+
+void ArchiveWriter::async_wait()
+{
+    timer.async_wait(std::bind(&ArchiveWriter::onTimer, this, std::placeholders::_1));
+}
+
+
+void ArchiveWriter::onTimer(const boost::system::error_code & aErrorCode)
+{
+    if (aErrorCode == boost::asio::error::operation_aborted)
+    {
+        spdlog::debug("Archive timer aborted.");
+        return;
+    }
+    else if (aErrorCode)
+    {
+        spdlog::error("Error on archive timer: {}. Will try to go on.", aErrorCode.message());
+    }
+    else
+    {
+        // A single batch per period, so the main loop is never held for long.
+        try
+        {
+            std::size_t archived = trader.database.archiveFulfilledOrders(batchSize);
+            if (archived != 0)
+            {
+                spdlog::info("Archived {} fulfilled orders.", archived);
+            }
+        }
+        catch (std::exception & aException)
+        {
+            // Archival is not critical to trading, the same batch is archived again next period.
+            spdlog::error("Cannot archive fulfilled orders: {}", aException.what());
+        }
+    }
+
+    timer.expires_after(period);
+    async_wait();
+}
+
+
 void ProductionBot::onAggregateTrade(Json aMessage)
 {
+    tradebot::stats::LatencyTrace trace = trader.latency->receive(aMessage.at("E").get<MillisecondsSinceEpoch>());
     Decimal latestPrice{aMessage.at("p").get<std::string>()};
+    ++tradeMessages;
+
+    if (recorder)
+    {
+        try
+        {
+            recorder->record(aMessage);
+        }
+        catch (std::exception & aException)
+        {
+            // Recording is not critical to trading, the message is still handled.
+            spdlog::error("Cannot record aggregate trade: {}", aException.what());
+        }
+    }
 
     if (auto optionalInterval = tracker.update(latestPrice))
     {
+        ++intervalChanges;
         spdlog::info("Latest price {} changed the current ladder interval.",
                 latestPrice);
         // This executes on the stream thread, increment each time an interval change is detected
         ++intervalChangeSemaphore;
 
-        boost::asio::post(mainLoop.getContext(), [this, latestPrice, interval=*optionalInterval]()
+        boost::asio::post(mainLoop.getContext(), [this, latestPrice, interval=*optionalInterval, trace]()
                 {
+                    trader.latency->begin(trace);
                     spdlog::info("Start handling new interval [{}, {}].",
                                  interval.front, interval.back);
                     // Matches the increment, with a decrement occuring in the main thread
@@ -154,23 +212,172 @@ void ProductionBot::onAggregateTrade(Json aMessage)
                             [this]
                             {
                                 return intervalChangeSemaphore == 0;
-                            });
+                            },
+                            findPlan(interval));
+                    trader.latency->end();
+                    refreshFragmentCounts();
+
+                    plans.clear();
+                    if (speculativePlans)
+                    {
+                        // Posted, so a pending interval change is handled first.
+                        boost::asio::post(mainLoop.getContext(), [this, interval]()
+                                {
+                                    planAdjacentIntervals(interval);
+                                });
+                    }
                 });
     }
 }
 
+void ProductionBot::refreshFragmentCounts()
+{
+    sellFragments = trader.database.countUnassociatedFragments(tradebot::Side::Sell, trader.pair);
+    buyFragments = trader.database.countUnassociatedFragments(tradebot::Side::Buy, trader.pair);
+}
+
+
+void ProductionBot::planAdjacentIntervals(Interval aInterval)
+{
+    if (intervalChangeSemaphore != 0 || aInterval.front == aInterval.back)
+    {
+        // Either the interval already changed again, so the plans would not be used,
+        // or the price is out of the ladder.
+        return;
+    }
+
+    const Ladder & ladder = tracker.ladder;
+    auto front = std::lower_bound(ladder.begin(), ladder.end(), aInterval.front);
+    if (front == ladder.end() || *front != aInterval.front)
+    {
+        return;
+    }
+    std::size_t index = front - ladder.begin();
+
+    auto plan = [this](Decimal aFront, Decimal aBack)
+    {
+        plans.push_back(trader.planProfitableOrders({aFront, aBack}, symbolFilters));
+    };
+
+    if (index + 2 < ladder.size())
+    {
+        plan(ladder[index + 1], ladder[index + 2]);
+    }
+    if (index > 0)
+    {
+        plan(ladder[index - 1], ladder[index]);
+    }
+}
+
+
+const tradebot::OrderPlan * ProductionBot::findPlan(Interval aInterval) const
+{
+    auto found = std::find_if(plans.begin(), plans.end(), [&](const tradebot::OrderPlan & aPlan)
+            {
+                return aPlan.interval.front == aInterval.front
+                       && aPlan.interval.back == aInterval.back;
+            });
+    return (found != plans.end()) ? &*found : nullptr;
+}
+
+
+std::string ProductionBot::renderMetrics() const
+{
+    PrometheusText text;
+
+    text.declare("dogebot_trade_messages_total", "counter", "Aggregate trade messages received.")
+        .sample("dogebot_trade_messages_total", tradeMessages.load());
+    text.declare("dogebot_interval_changes_total", "counter", "Ladder interval changes detected.")
+        .sample("dogebot_interval_changes_total", intervalChanges.load());
+
+    const tradebot::stats::FokCounters & fok = *trader.fokCounters;
+    text.declare("dogebot_fok_placed_total", "counter", "Limit FOK orders sent to the exchange.")
+        .sample("dogebot_fok_placed_total", fok.placed.load());
+    text.declare("dogebot_fok_expired_total", "counter", "Limit FOK orders expired by the exchange.")
+        .sample("dogebot_fok_expired_total", fok.expired.load());
+    text.declare("dogebot_fok_filled_total", "counter", "Limit FOK orders filled by the exchange.")
+        .sample("dogebot_fok_filled_total", fok.filled.load());
+    text.declare("dogebot_fok_deferred_total", "counter",
+                 "Waits for a book update instead of sending a FOK order the visible book could not fill.")
+        .sample("dogebot_fok_deferred_total", fok.deferred.load());
+    text.declare("dogebot_fok_throttled_total", "counter",
+                 "Limit FOK orders which waited for the order rate limiter.")
+        .sample("dogebot_fok_throttled_total", fok.throttled.load());
+
+    const binance::Api::Metrics & rest = trader.exchange.restApi.getMetrics();
+    text.declare("dogebot_rest_latency_microseconds", "summary", "REST request latency per endpoint.");
+    rest.latencies.forEach([&text](const std::string & aLabel, const Histogram & aHistogram)
+        {
+            // Labels are "VERB /endpoint"
+            std::size_t separator = aLabel.find(' ');
+            text.summary("dogebot_rest_latency_microseconds",
+                         aHistogram,
+                         {{"method", aLabel.substr(0, separator)},
+                          {"endpoint", aLabel.substr(separator + 1)}});
+        });
+    text.declare("dogebot_rest_used_weight", "gauge", "Request weight used in the current minute (-1 if unknown).")
+        .sample("dogebot_rest_used_weight", rest.usedWeight.load());
+    text.declare("dogebot_rest_errors_total", "counter", "REST responses with a status other than 200.")
+        .sample("dogebot_rest_errors_total", rest.errors.load());
+
+    text.declare("dogebot_db_statement_latency_microseconds", "summary", "Database statement latency.");
+    trader.database.getStatementLatencies().forEach(
+        [&text](const std::string & aLabel, const Histogram & aHistogram)
+        {
+            text.summary("dogebot_db_statement_latency_microseconds", aHistogram, {{"statement", aLabel}});
+        });
+
+    text.declare("dogebot_fragments", "gauge", "Fragments not associated to an order, per side.")
+        .sample("dogebot_fragments", sellFragments.load(), {{"side", "sell"}})
+        .sample("dogebot_fragments", buyFragments.load(), {{"side", "buy"}});
+
+    return text.str();
+}
+
+
 void ProductionBot::connectMarketStream()
 {
+    // The market stream handles reconnections by itself (including the 24h server-side close),
+    // so there is no reconnection to handle here.
     trader.exchange.openMarketStream(boost::to_lower_copy(trader.pair.symbol()) + "@aggTrade",
                                      std::bind(&ProductionBot::onAggregateTrade,
                                                this,
                                                std::placeholders::_1),
-                                     [this]()
+                                     []()
                                      {
-                                        boost::asio::post(mainLoop.getContext(),
-                                                          std::bind(&ProductionBot::connectMarketStream,
-                                                                    this));
-                                     });
+                                        // Trades missed during the gap are not replayed: the next trade is tracked
+                                        // from the last known interval, crossings reverting within the gap are lost.
+                                        spdlog::warn("Market stream reconnected with a potential gap in aggregate trades.");
+                                     },
+                                     marketStreamOptions);
+}
+
+
+void ProductionBot::connectBookStream()
+{
+    if (! orderBook)
+    {
+        return;
+    }
+
+    // The book only has to be fresh, not complete: a single connection is enough,
+    // while it is down the book gets stale and FOK orders are sent without deferral.
+    bool isBookTicker = bookStreamName.find("@bookTicker") != std::string::npos;
+    trader.exchange.openCombinedMarketStream(
+        {{
+            bookStreamName,
+            [book = orderBook, isBookTicker](Json aMessage)
+            {
+                isBookTicker ? book->onBookTicker(aMessage) : book->onPartialDepth(aMessage);
+            }
+        }},
+        [this]()
+        {
+            spdlog::warn("Book stream closed unexpectedly, reconnecting.");
+            // Not reconnected from the closing stream's own callback, which would destroy it.
+            boost::asio::post(mainLoop.getContext(), [this](){ connectBookStream(); });
+        });
+    trader.orderBook = orderBook;
 }
 
 
@@ -178,10 +385,20 @@ int ProductionBot::run()
 {
     trader.exchange.restApi.setReceiveWindow(gProdbotReceiveWindow);
     trader.cleanup();
+    refreshFragmentCounts();
 
     stats.start();
+    latencyWriter.period = latencyDumpPeriod;
+    latencyWriter.start();
+    if (archiveBatchSize)
+    {
+        archiveWriter.period = archivePeriod;
+        archiveWriter.batchSize = *archiveBatchSize;
+        archiveWriter.start();
+    }
 
     tracker.reset();
+    connectBookStream();
     connectMarketStream();
 
     mainLoop.run();
@@ -4,10 +4,15 @@
 #include "EventLoop.h"
 
 #include <tradebot/Order.h>
+#include <tradebot/Stream.h>
 #include <tradebot/Trader.h>
+#include <tradebot/marketdata/OrderBook.h>
+#include <tradebot/marketdata/Recorder.h>
 
 #include <trademath/Interval.h>
+#include <trademath/IntervalTracker.h>
 
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/system_timer.hpp>
 
 
@@ -15,18 +20,6 @@ namespace ad {
 namespace trade {
 
 
-struct IntervalTracker
-{
-    /// \return `true` if the latest price made the interval change.
-    std::optional<Interval> update(Decimal aLatestPrice);
-
-    void reset();
-
-    trade::Ladder ladder;
-    trade::Ladder::const_reverse_iterator lowerBound{ladder.crend()};
-};
-
-
 /// \brief Hardcoded to dump stats everyday at midnight
 struct StatsWriter
 {
@@ -49,23 +42,101 @@ public:
 };
 
 
+/// \brief Periodically dump (then reset) the trader latency histograms.
+struct LatencyWriter
+{
+    void start();
+
+private:
+    void async_wait();
+
+    void onTimer(const boost::system::error_code & aErrorCode);
+
+public:
+    tradebot::Trader & trader;
+    boost::asio::steady_timer timer;
+    std::chrono::seconds period{60};
+};
+
+
+/// \brief Periodically move a batch of fulfilled orders to the archive database,
+/// so the main database only grows with the live state.
+struct ArchiveWriter
+{
+    void start();
+
+private:
+    void async_wait();
+
+    void onTimer(const boost::system::error_code & aErrorCode);
+
+public:
+    tradebot::Trader & trader;
+    boost::asio::steady_timer timer;
+    std::chrono::seconds period{60};
+    std::size_t batchSize{100};
+};
+
+
 struct ProductionBot
 {
     void connectMarketStream();
 
+    /// \brief Open the stream maintaining `orderBook`, if it is configured.
+    void connectBookStream();
+
     int run();
 
     void onAggregateTrade(Json aMessage);
 
+    /// \brief Update the fragment counts exposed as metrics, from the main loop.
+    void refreshFragmentCounts();
+
+    /// \brief Plan the orders of the intervals directly above and below `aInterval`,
+    /// so the next crossing does not have to query the fragments. From the main loop.
+    void planAdjacentIntervals(Interval aInterval);
+
+    /// \return The plan computed for `aInterval`, or `nullptr`.
+    const tradebot::OrderPlan * findPlan(Interval aInterval) const;
+
+    /// \brief Render the bot metrics in Prometheus text format.
+    ///
+    /// Only reads atomics and histograms, so it is safe to call from any thread.
+    std::string renderMetrics() const;
+
     tradebot::Trader trader;
     IntervalTracker tracker;
+    tradebot::RollingStream::Options marketStreamOptions{};
+    std::chrono::seconds latencyDumpPeriod{60};
+    /// \brief If set, fulfilled orders are archived by batches of this size, each `archivePeriod`.
+    /// Requires the trader database to be opened with an archive.
+    std::optional<std::size_t> archiveBatchSize;
+    std::chrono::seconds archivePeriod{60};
+    /// \brief If present, records the aggregate trades received on the market stream.
+    std::optional<tradebot::marketdata::Recorder> recorder;
+    /// \brief If set, the visible book is maintained from `bookStreamName` (either `@bookTicker`
+    /// or a partial `@depth` stream), and the trader defers FOK orders it could not fill.
+    std::shared_ptr<tradebot::marketdata::OrderBook> orderBook;
+    std::string bookStreamName;
+    /// \brief If set, the orders of the adjacent intervals are planned after each interval change.
+    bool speculativePlans{false};
 
     // Automatically initialized
     std::atomic<int> intervalChangeSemaphore{0};
+    std::atomic<std::uint64_t> tradeMessages{0};
+    std::atomic<std::uint64_t> intervalChanges{0};
+    std::atomic<std::size_t> sellFragments{0};
+    std::atomic<std::size_t> buyFragments{0};
+    /// \brief Only accessed from the main loop.
+    std::vector<tradebot::OrderPlan> plans;
     tradebot::SymbolFilters symbolFilters{trader.queryFilters()};
     EventLoop mainLoop;
     StatsWriter stats{trader,
                       boost::asio::system_timer{mainLoop.getContext()}};
+    LatencyWriter latencyWriter{trader,
+                                boost::asio::steady_timer{mainLoop.getContext()}};
+    ArchiveWriter archiveWriter{trader,
+                                boost::asio::steady_timer{mainLoop.getContext()}};
 };
 
 
@@ -1,14 +1,14 @@
+#include "Metrics.h"
 #include "NaiveBot.h"
 #include "ProductionBot.h"
 
 #include <binance/Api.h>
 
+#include <tradebot/Configuration.h>
 #include <tradebot/Exchange.h>
-#include <tradebot/spawners/StableDownSpread.h>
+#include <tradebot/ThreadPool.h>
 #include <tradebot/Trader.h>
 
-#include <trademath/Spreaders.h>
-
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/rotating_file_sink.h>
@@ -147,16 +147,14 @@ int runProductionBot(int argc, char * argv[], const std::string & aSecretsFile,
 
     tradebot::Pair pair{aConfig.at("base"), aConfig.at("quote")};
     //Decimal amount{aConfig.at("amount")};
-    Decimal firstStop{aConfig.at("ladder").at("firstStop").get<std::string>()};
-    Decimal factor{aConfig.at("ladder").at("factor").get<std::string>()};
-    int stopCount = std::stoi(aConfig.at("ladder").at("stopCount").get<std::string>());
     Decimal effectivePriceTickSize{aConfig.at("ladder").at("priceTickSize").get<std::string>()};
-    Decimal internalTickSize{aConfig.at("ladder").value("internalTickSize", "0")};
-    Decimal priceOffset{aConfig.at("ladder").at("priceOffset").get<std::string>()};
     const std::string botName =
         aConfig.at("bot").value("name", "productionbot") + '_' + std::to_string(getTimestamp());
 
     Json spawnerConfig = aConfig.at("spawner");
+    // Optional archival of the fulfilled orders, to keep the main database to the live state
+    Json archiveConfig = aConfig.value("archive", Json::object());
+    Json databaseConfig = aConfig.value("database", Json::object());
 
     spdlog::info("Starting bot '{}' to trade {}.",
                  botName,
@@ -165,12 +163,17 @@ int runProductionBot(int argc, char * argv[], const std::string & aSecretsFile,
     //
     // Ladder
     //
-    trade::Ladder ladder = trade::makeLadder(firstStop,
-                                             factor,
-                                             stopCount,
-                                             effectivePriceTickSize,
-                                             internalTickSize,
-                                             priceOffset);
+    trade::Ladder ladder = tradebot::makeLadder(aConfig.at("ladder"));
+
+    //
+    // Executor, shared by the streams and their timers
+    //
+    // Must outlive the bot.
+    Json executorConfig = aConfig.value("executor", Json::object());
+    tradebot::ThreadPool executor{
+        executorConfig.value("threads", std::size_t{1}),
+        executorConfig.value("cpus", std::vector<int>{}),
+    };
 
     //
     // Production Bot
@@ -179,9 +182,12 @@ int runProductionBot(int argc, char * argv[], const std::string & aSecretsFile,
         tradebot::Trader{
             botName,
             pair,
-            tradebot::Database{databasePath},
+            tradebot::Database{databasePath,
+                               archiveConfig.empty() ? std::string{} : archiveConfig.at("path").get<std::string>(),
+                               tradebot::makeDatabaseOptions(databaseConfig)},
             tradebot::Exchange{
                 binance::Api{std::ifstream{aSecretsFile}},
+                &executor,
             },
         },
         trade::IntervalTracker{
@@ -189,6 +195,66 @@ int runProductionBot(int argc, char * argv[], const std::string & aSecretsFile,
         },
     };
 
+    // Optional permessage-deflate on the market stream
+    if (Json compression = aConfig.value("marketStream", Json::object()).value("compression", Json::object());
+        ! compression.empty())
+    {
+        net::WebSocket::Compression & settings = bot.marketStreamOptions.compression;
+        settings.enabled = compression.value("enabled", true);
+        settings.windowBits = compression.value("windowBits", settings.windowBits);
+        settings.memoryLevel = compression.value("memoryLevel", settings.memoryLevel);
+        settings.compressionLevel = compression.value("compressionLevel", settings.compressionLevel);
+        settings.noContextTakeover = compression.value("noContextTakeover", settings.noContextTakeover);
+    }
+
+    // Period of the latency histograms dump
+    bot.latencyDumpPeriod =
+        std::chrono::seconds{aConfig.value("latency", Json::object()).value("dumpPeriodSeconds", 60)};
+
+    if (! archiveConfig.empty())
+    {
+        bot.archiveBatchSize = archiveConfig.value("batchSize", std::size_t{100});
+        bot.archivePeriod = std::chrono::seconds{archiveConfig.value("periodSeconds", 60)};
+    }
+
+    // Optional writer thread, for the database writes that do not have to be durable immediately
+    if (databaseConfig.value("deferredWrites", false))
+    {
+        bot.trader.database.startWriter();
+    }
+
+    // Optional recording of the aggregate trades
+    if (Json recorderConfig = aConfig.value("recorder", Json::object()); ! recorderConfig.empty())
+    {
+        bot.recorder.emplace(recorderConfig.at("directory").get<std::string>(), pair.symbol());
+    }
+
+    // Optional visible book, to avoid sending FOK orders that would expire
+    if (Json bookConfig = aConfig.value("orderBook", Json::object()); ! bookConfig.empty())
+    {
+        bot.orderBook = std::make_shared<tradebot::marketdata::OrderBook>(
+            std::chrono::milliseconds{bookConfig.value("maximumAgeMilliseconds", 2000)});
+        bot.bookStreamName = (bookConfig.value("source", "bookTicker") == "depth") ?
+            tradebot::marketdata::OrderBook::getPartialDepthStreamName(pair.symbol(),
+                                                                       bookConfig.value("depthLevels", 5))
+            : tradebot::marketdata::OrderBook::getBookTickerStreamName(pair.symbol());
+        bot.trader.fokDeferral = std::chrono::milliseconds{bookConfig.value("deferralMilliseconds", 100)};
+    }
+
+    Json ordersConfig = aConfig.value("orders", Json::object());
+    // Order rate limit, by default at most 50 orders in any 10 seconds
+    bot.trader.orderRateLimiter = std::make_shared<tradebot::RateLimiter>(
+        ordersConfig.value("maxPerSecond", 4.),
+        ordersConfig.value("burst", 10.));
+    // Optional concurrent sending of the orders of an interval
+    if (std::size_t concurrency = ordersConfig.value("concurrency", std::size_t{1});
+        concurrency > 1)
+    {
+        bot.trader.orderDispatcher = std::make_unique<tradebot::ThreadPool>(concurrency);
+    }
+    // Optional planning of the orders of the adjacent intervals, ahead of crossings
+    bot.speculativePlans = ordersConfig.value("speculativePlans", false);
+
     // Sanity check:
     tradebot::SymbolFilters filters = bot.trader.exchange.queryFilters(pair);
     if (effectivePriceTickSize < filters.price.tickSize)
@@ -201,37 +267,28 @@ int runProductionBot(int argc, char * argv[], const std::string & aSecretsFile,
     //
     // spawner::StableDownSpread
     //
-    trade::ProportionsMap proportionsMap;
-    Decimal previousMaxRate{0};
-    // Copy the values read from the spawnerConfig["spreader"]["proporitions"] in `proportions`.
-    for(auto & ratedProportions : spawnerConfig.at("spreader").at("proportions").items())
+    bot.trader.spawner = tradebot::makeStableDownSpread(spawnerConfig,
+                                                        ladder,
+                                                        bot.trader.queryFilters().amount.tickSize);
+
+    // Orders are only sent at the ladder stops, serialise them ahead of time.
+    bot.trader.exchange.prepareLimitFokTemplates(pair, ladder);
+
+    //
+    // Metrics endpoint (optional), served from the executor
+    //
+    std::optional<trade::MetricsServer> metricsServer;
+    if (Json metricsConfig = aConfig.value("metrics", Json::object()); ! metricsConfig.empty())
     {
-        Decimal maxRate = Decimal{ratedProportions.key()};
-        if(maxRate <= previousMaxRate)
-        {
-            spdlog::critical("Proportion for rate limit {} coming after rate limit {}.", maxRate, previousMaxRate);
-            throw std::invalid_argument{"Proportions rate must be strictly increasing."};
-        }
-        previousMaxRate = maxRate;
-        proportionsMap.push_back({maxRate, {}});
-        std::transform(ratedProportions.value().begin(),
-                       ratedProportions.value().end(),
-                       std::back_inserter(proportionsMap.back().second),
-                       [](const std::string & aValue){ return Decimal{aValue}; });
+        metricsServer.emplace(executor.getContext(),
+                              metricsConfig.value("address", "127.0.0.1"),
+                              metricsConfig.value("port", static_cast<unsigned short>(9464)),
+                              [&bot]()
+                              {
+                                  return bot.renderMetrics();
+                              });
     }
 
-    bot.trader.spawner =
-        std::make_unique<tradebot::spawner::StableDownSpread<trade::ProportionSpreader>>(
-            trade::ProportionSpreader{
-                ladder,
-                proportionsMap,
-                bot.trader.queryFilters().amount.tickSize,
-            },
-            Decimal{spawnerConfig.at("takeHomeFactorInitialSell").get<std::string>()},
-            Decimal{spawnerConfig.at("takeHomeFactorSubsequentSell").get<std::string>()},
-            Decimal{spawnerConfig.at("takeHomeFactorSubsequentBuy").get<std::string>()}
-        );
-
     //
     // Run
     //
@@ -1,11 +1,10 @@
+#include <tradebot/Configuration.h>
 #include <tradebot/Database.h>
 #include <tradebot/Exchange.h>
 #include <tradebot/Logging.h>
 
-#include <trademath/Function.h>
+#include <trademath/FilterUtilities.h>
 #include <trademath/Ladder.h>
-#include <trademath/Spawn.h>
-#include <trademath/DecimalLog.h>
 
 #include <fstream>
 #include <iostream>
@@ -29,15 +28,7 @@ int main(int argc, char * argv[])
 
     Json config = Json::parse(std::ifstream{argv[3]});
     tradebot::Pair pair{config.at("base"), config.at("quote")};
-    Decimal amount{config.at("amount").get<std::string>()};
-    Decimal firstStop{config.at("ladder").at("firstStop").get<std::string>()};
-    Decimal factor{config.at("ladder").at("factor").get<std::string>()};
-    int stopCount = std::stoi(config.at("ladder").at("stopCount").get<std::string>());
     Decimal effectivePriceTickSize{config.at("ladder").at("priceTickSize").get<std::string>()};
-    Decimal internalTickSize{config.at("ladder").value("internalTickSize", "0")};
-    Decimal priceOffset{config.at("ladder").at("priceOffset").get<std::string>()};
-    std::size_t spawnBeginOffset{config.at("initial").at("spawnBeginOffset")};
-    std::size_t spawnEndOffset{config.at("initial").at("spawnEndOffset")};
 
     tradebot::Exchange exchange{binance::Api{std::ifstream{secretsfile}}};
     tradebot::SymbolFilters filters = exchange.queryFilters(pair);
@@ -49,12 +40,7 @@ int main(int argc, char * argv[])
         throw std::invalid_argument{"The configured price tick size is below exhanges price tick size."};
     }
 
-    trade::Ladder ladder = trade::makeLadder(firstStop,
-                                             factor,
-                                             stopCount,
-                                             effectivePriceTickSize,
-                                             internalTickSize,
-                                             priceOffset);
+    trade::Ladder ladder = tradebot::makeLadder(config.at("ladder"));
 
     // Sanity check
     {
@@ -77,76 +63,23 @@ int main(int argc, char * argv[])
     }
 
     spdlog::info("Making a ladder with {} stops on interval [{}, {}], tick size {}.",
-            stopCount,
+            ladder.size(),
             ladder.front(),
             ladder.back(),
             effectivePriceTickSize);
 
-    trade::Function initialDistribution{
-        [](Decimal aValue) -> Decimal
-        {
-            return log(aValue);
-        }
-    };
-
-    auto spawnBegin = ladder.begin() + spawnBeginOffset;
-    auto spawnEnd = ladder.end() - spawnEndOffset;
-
-    Decimal integral = initialDistribution.integrate(*spawnBegin, *(spawnEnd-1));
-    Decimal ratio = amount/integral; // Not rounded to 8 digits, to give more precision over the spawn integration
-    spdlog::debug("Integration produces {}, target is {}, so the factor is {}.",
-                 integral,
-                 amount,
-                 ratio);
-
-    auto [spawns, spawnedAmount] =
-        trade::spawnIntegration(trade::Base{ratio}, spawnBegin, spawnEnd, initialDistribution);
-
-    if (! isEqual(spawnedAmount, amount))
-    {
-        spdlog::critical("Spawned amount {} is different from requested amount {}.",
-                to_str(spawnedAmount),
-                to_str(amount));
-        return EXIT_FAILURE;
-    }
+    std::vector<tradebot::Fragment> fragments =
+        tradebot::makeInitialFragments(config, ladder, pair, filters);
 
     tradebot::Database database{databasePath};
     Decimal sumBefore = database.sumAllFragments();
-    Decimal remainder{0};
-    for (const auto & spawn : spawns)
+    for (tradebot::Fragment & fragment : fragments)
     {
-        // Carry-on the remainder from previous amount insertion
-        Decimal baseAmount;
-        std::tie(baseAmount, remainder) =
-            trade::computeTickFilter(spawn.base + remainder, filters.amount.tickSize);
-
-        if (! tradebot::testAmount(filters, baseAmount, spawn.rate))
-        {
-            spdlog::warn("Spawned fragment for {} {} at rate {} does not pass amount filters.",
-                         baseAmount,
-                         pair.base,
-                         spawn.rate);
-        }
-
-        if (! tradebot::testPrice(filters, spawn.rate))
-        {
-            spdlog::warn("Spawned fragment for {} {} at rate {} does not pass price filters.",
-                         baseAmount,
-                         pair.base,
-                         spawn.rate);
-        }
-
-        database.insert(tradebot::Fragment{
-            pair.base,
-            pair.quote,
-            baseAmount,
-            spawn.rate,
-            tradebot::Side::Sell,
-        });
+        database.insert(fragment);
     }
 
     spdlog::info("Successfully spawned {} fragments, changing the total sum of fragments in DB for {}.",
-        spawns.size(),
+        fragments.size(),
         database.sumAllFragments() - sumBefore
     );
 
@@ -0,0 +1,70 @@
+#include <binance/Api.h>
+
+#include <tradebot/Exchange.h>
+#include <tradebot/marketdata/Recorder.h>
+
+#include <spdlog/spdlog.h>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/signal_set.hpp>
+
+#include <fstream>
+#include <iostream>
+
+#include <csignal>
+#include <cstdlib>
+
+
+using namespace ad;
+
+
+int main(int argc, char * argv[])
+{
+    if (argc != 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " secretsfile output-directory symbol\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        tradebot::Exchange exchange{
+            binance::Api{std::ifstream{argv[1]}}
+        };
+
+        tradebot::marketdata::Recorder recorder{argv[2], argv[3]};
+
+        if (! exchange.openMarketStream(recorder.getStreamName(),
+                                        [&recorder](Json aMessage)
+                                        {
+                                            recorder.record(aMessage);
+                                        },
+                                        []()
+                                        {
+                                            spdlog::warn("Market stream reconnected with a potential gap in the recording.");
+                                        }))
+        {
+            spdlog::critical("Cannot connect to market stream '{}'.", recorder.getStreamName());
+            return EXIT_FAILURE;
+        }
+
+        // Record until interrupted
+        boost::asio::io_context ioContext;
+        boost::asio::signal_set signals{ioContext, SIGINT, SIGTERM};
+        signals.async_wait([](const boost::system::error_code &, int aSignal)
+                           {
+                               spdlog::info("Received signal {}, stopping the recording.", aSignal);
+                           });
+        ioContext.run();
+
+        // Stop the stream before the recorder is destroyed.
+        exchange.closeMarketStream();
+    }
+    catch (std::exception & aException)
+    {
+        spdlog::critical("Uncaught exception: {}", aException.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -91,6 +91,55 @@ SCENARIO("Binance REST API quote order quantity", "[binance][api]")
 }
 
 
+SCENARIO("Binance order templates", "[binance][api]")
+{
+    GIVEN("A template for limit FOK orders")
+    {
+        binance::OrderTemplate orderTemplate{binance::LimitOrder{
+            binance::OrderBase{
+                "BTCUSDT",
+                binance::Side::BUY,
+                0,
+                binance::QuantityUnit::Base,
+                binance::ClientId{""},
+            },
+            4000,
+            binance::TimeInForce::FOK,
+        }};
+
+        THEN("It serialises all the parameters except the quantity and client id")
+        {
+            const std::string & query = orderTemplate.getQuery();
+            CHECK(query.find("symbol=BTCUSDT") != std::string::npos);
+            CHECK(query.find("side=BUY") != std::string::npos);
+            CHECK(query.find("price=4000") != std::string::npos);
+            CHECK(query.find("timeInForce=FOK") != std::string::npos);
+            CHECK(query.find("type=LIMIT") != std::string::npos);
+            CHECK(query.find("newClientOrderId") == std::string::npos);
+            CHECK(orderTemplate.getQuantityKey() == std::string{"quantity"});
+        }
+
+        GIVEN("A Binance interface connected to the testnet")
+        {
+            binance::Api binance{secret::gTestnetCredentials};
+
+            THEN("An order instantiated from the template is accepted, and expires")
+            {
+                binance::Response orderResponse = binance.placeOrderTrade(binance::TemplatedOrder{
+                    orderTemplate,
+                    Decimal{"0.001"},
+                    binance::ClientId{"apitest_templated_order"},
+                });
+                INFO("Response: " << orderResponse.json->dump(2));
+                REQUIRE(orderResponse.status == 200);
+                CHECK(orderResponse.json->at("status") == "EXPIRED");
+                CHECK(orderResponse.json->at("clientOrderId") == "apitest_templated_order");
+            }
+        }
+    }
+}
+
+
 SCENARIO("Raw Websocket use", "[binance][net][websocket][live]")
 {
     GIVEN("A websocket reading a single message")
@@ -7,6 +7,9 @@
 
 #include <spdlog/spdlog.h>
 
+#include <filesystem>
+#include <thread>
+
 
 using namespace ad;
 
@@ -297,6 +300,126 @@ SCENARIO("Order high-level creation.", "[db]")
             }
         }
 
+        THEN("Orders for several rates and sides can be prepared at once")
+        {
+            std::vector<Order> orders = db.prepareOrders(
+                "dbtest",
+                {{Side::Sell, 1.}, {Side::Sell, 3.}, {Side::Buy, 2.}},
+                {"DOGE", "BUSD"});
+
+            REQUIRE(orders.size() == 3);
+            REQUIRE(orders[0].side == Side::Sell);
+            REQUIRE(orders[0].baseAmount == 2*baseFragment.baseAmount);
+            REQUIRE(orders[1].fragmentsRate == 3.);
+            REQUIRE(orders[2].side == Side::Buy);
+            REQUIRE(orders[2].baseAmount == 100.);
+
+            for (const Order & order : orders)
+            {
+                REQUIRE(db.getOrder(order.id).baseAmount == order.baseAmount);
+                REQUIRE(db.sumFragmentsOfOrder(order) == order.baseAmount);
+            }
+            REQUIRE(db.getSellRatesBelow(4., {"DOGE", "BUSD"}) == std::vector<Decimal>{2.});
+        }
+
+        THEN("Preparing several orders is all or nothing")
+        {
+            // There are no sell fragments at rate 4.
+            REQUIRE_THROWS(db.prepareOrders("dbtest",
+                                            {{Side::Sell, 1.}, {Side::Sell, 4.}},
+                                            {"DOGE", "BUSD"}));
+            REQUIRE(db.countOrders() == 0);
+            REQUIRE(db.getSellRatesBelow(4., {"DOGE", "BUSD"}).size() == 3);
+        }
+
+        THEN("The profitable fragments can be summed per rate")
+        {
+            std::vector<RateFragments> sells = db.sumProfitableFragments(Side::Sell, 2.5, {"DOGE", "BUSD"});
+            REQUIRE(sells.size() == 2);
+            REQUIRE(sells[0].rate == 1.);
+            REQUIRE(sells[0].baseAmount == 2*baseFragment.baseAmount);
+            REQUIRE(sells[0].count == 2);
+            REQUIRE(sells[1].rate == 2.);
+
+            std::vector<RateFragments> buys = db.sumProfitableFragments(Side::Buy, 1.5, {"DOGE", "BUSD"});
+            REQUIRE(buys.size() == 2);
+            REQUIRE(buys[0].rate == 3.);
+            REQUIRE(buys[0].baseAmount == 100.);
+            REQUIRE(buys[0].count == 1);
+
+            THEN("An order can be prepared from the planned fragments")
+            {
+                std::uint64_t sellGeneration = db.getFragmentsGeneration(Side::Sell);
+                std::uint64_t buyGeneration = db.getFragmentsGeneration(Side::Buy);
+
+                Order order = db.preparePlannedOrder("dbtest", Side::Sell, sells[0], {"DOGE", "BUSD"});
+                REQUIRE(order.baseAmount == sells[0].baseAmount);
+                REQUIRE(db.sumFragmentsOfOrder(order) == order.baseAmount);
+
+                // Only the side of the assigned fragments is invalidated.
+                REQUIRE(db.getFragmentsGeneration(Side::Sell) != sellGeneration);
+                REQUIRE(db.getFragmentsGeneration(Side::Buy) == buyGeneration);
+
+                THEN("Discarding the order changes the generation again")
+                {
+                    sellGeneration = db.getFragmentsGeneration(Side::Sell);
+                    db.discardOrder(order);
+                    REQUIRE(db.getFragmentsGeneration(Side::Sell) != sellGeneration);
+                }
+            }
+
+            THEN("A stale plan still assigns the actual fragments")
+            {
+                std::uint64_t sellGeneration = db.getFragmentsGeneration(Side::Sell);
+                baseFragment.targetRate = 1.;
+                db.insert(baseFragment);
+                REQUIRE(db.getFragmentsGeneration(Side::Sell) != sellGeneration);
+
+                Order order = db.preparePlannedOrder("dbtest", Side::Sell, sells[0], {"DOGE", "BUSD"});
+                REQUIRE(order.baseAmount == 3*baseFragment.baseAmount);
+                REQUIRE(db.getOrder(order.id).baseAmount == order.baseAmount);
+                REQUIRE(db.sumFragmentsOfOrder(order) == order.baseAmount);
+            }
+
+            THEN("Associating a fragment to an order by an update invalidates the plan")
+            {
+                Order other{"dbtest", "DOGE", "BUSD", 10., 1., Side::Sell};
+                db.insert(other);
+
+                std::uint64_t sellGeneration = db.getFragmentsGeneration(Side::Sell);
+                std::uint64_t buyGeneration = db.getFragmentsGeneration(Side::Buy);
+                Fragment fragment = db.getUnassociatedFragments(Side::Sell, 1., {"DOGE", "BUSD"}).front();
+                fragment.composedOrder = other.id;
+                db.update(fragment);
+
+                REQUIRE(db.getFragmentsGeneration(Side::Sell) != sellGeneration);
+                REQUIRE(db.getFragmentsGeneration(Side::Buy) == buyGeneration);
+
+                // The plan is stale: only one of its two fragments is left.
+                REQUIRE(db.sumProfitableFragments(Side::Sell, 2.5, {"DOGE", "BUSD"})[0].count == 1);
+            }
+        }
+
+        THEN("All unassociated fragments can be summed per rate")
+        {
+            std::vector<RateFragments> sells = db.sumUnassociatedFragments(Side::Sell, {"DOGE", "BUSD"});
+            REQUIRE(sells.size() == 3);
+            REQUIRE(sells[0].rate == 1.);
+            REQUIRE(sells[0].baseAmount == 2*baseFragment.baseAmount);
+            REQUIRE(sells[0].count == 2);
+
+            std::vector<RateFragments> buys = db.sumUnassociatedFragments(Side::Buy, {"DOGE", "BUSD"});
+            REQUIRE(buys.size() == 3);
+
+            THEN("Fragments assigned to an order are not summed")
+            {
+                db.prepareOrder("dbtest", Side::Sell, 1., {"DOGE", "BUSD"});
+                sells = db.sumUnassociatedFragments(Side::Sell, {"DOGE", "BUSD"});
+                REQUIRE(sells.size() == 2);
+                REQUIRE(sells[0].rate == 2.);
+            }
+        }
+
         THEN("Matching BUY fragments can be assigned to a new BUY order")
         {
             Order order =
@@ -355,3 +478,417 @@ SCENARIO("Order high-level creation.", "[db]")
         }
     }
 }
+
+
+SCENARIO("Fragment totals.", "[db]")
+{
+    using namespace ad::tradebot;
+
+    GIVEN("A database with a few fragments")
+    {
+        Database db{":memory:"};
+        const Pair pair{"DOGE", "BUSD"};
+
+        REQUIRE(db.getFragmentTotals(Side::Sell, pair).unassociatedCount == 0);
+
+        for(auto rate : {1., 2., 2.})
+        {
+            db.insert(Fragment{"DOGE", "BUSD", 10., rate, Side::Sell});
+        }
+        db.insert(Fragment{"DOGE", "BUSD", 100., 0.5, Side::Buy});
+        db.insert(Fragment{"DOGE", "USDT", 10., 1., Side::Sell});
+
+        stats::FragmentTotals sells = db.getFragmentTotals(Side::Sell, pair);
+        REQUIRE(sells.unassociatedBase == 30.);
+        REQUIRE(sells.unassociatedQuote == 50.);
+        REQUIRE(sells.unassociatedCount == 3);
+        REQUIRE(sells.takenHome == 0);
+        REQUIRE(db.countUnassociatedFragments(Side::Sell, pair) == 3);
+
+        stats::FragmentTotals buys = db.getFragmentTotals(Side::Buy, pair);
+        REQUIRE(buys.unassociatedBase == 100.);
+        REQUIRE(buys.unassociatedQuote == 50.);
+        REQUIRE(buys.unassociatedCount == 1);
+
+        THEN("Preparing an order removes its fragments from the unassociated totals")
+        {
+            Order order = db.prepareOrder("dbtest", Side::Sell, 2., pair);
+
+            sells = db.getFragmentTotals(Side::Sell, pair);
+            REQUIRE(sells.unassociatedBase == 10.);
+            REQUIRE(sells.unassociatedQuote == 10.);
+            REQUIRE(sells.unassociatedCount == 1);
+            // Other pairs and sides are not affected
+            REQUIRE(db.getFragmentTotals(Side::Buy, pair).unassociatedCount == 1);
+            REQUIRE(db.getFragmentTotals(Side::Sell, {"DOGE", "USDT"}).unassociatedCount == 1);
+
+            THEN("Discarding the order restores the totals")
+            {
+                db.discardOrder(order);
+                sells = db.getFragmentTotals(Side::Sell, pair);
+                REQUIRE(sells.unassociatedBase == 30.);
+                REQUIRE(sells.unassociatedQuote == 50.);
+                REQUIRE(sells.unassociatedCount == 3);
+            }
+
+            THEN("The taken home of its fragments is accumulated")
+            {
+                for (Fragment fragment : db.getFragmentsComposing(order))
+                {
+                    fragment.takenHome = 0.5;
+                    db.update(fragment);
+                }
+                sells = db.getFragmentTotals(Side::Sell, pair);
+                REQUIRE(sells.takenHome == 1.);
+                REQUIRE(sells.unassociatedCount == 1);
+            }
+
+            THEN("The taken home of all its fragments can be recorded at once")
+            {
+                std::vector<Fragment> fragments = db.getFragmentsComposing(order);
+                for (Fragment & fragment : fragments)
+                {
+                    fragment.takenHome = 0.5;
+                }
+                db.recordTakenHome(order, fragments);
+                REQUIRE(db.sumTakenHome(order) == 1.);
+                REQUIRE(db.getFragmentTotals(Side::Sell, pair).takenHome == 1.);
+
+                // Recording again only applies the difference.
+                fragments.front().takenHome = 1.5;
+                db.recordTakenHome(order, fragments);
+                REQUIRE(db.sumTakenHome(order) == 2.);
+                sells = db.getFragmentTotals(Side::Sell, pair);
+                REQUIRE(sells.takenHome == 2.);
+                REQUIRE(sells.unassociatedCount == 1);
+
+                db.rebuildFragmentTotals();
+                REQUIRE(db.getFragmentTotals(Side::Sell, pair).takenHome == 2.);
+            }
+
+            THEN("Fragments not composing the order are rejected")
+            {
+                Fragment other = db.getUnassociatedFragments(Side::Sell, pair).front();
+                REQUIRE_THROWS(db.recordTakenHome(order, {other}));
+            }
+        }
+
+        THEN("A failed preparation of several orders leaves the totals unchanged")
+        {
+            REQUIRE_THROWS(db.prepareOrders("dbtest", {{Side::Sell, 1.}, {Side::Sell, 4.}}, pair));
+            REQUIRE(db.getFragmentTotals(Side::Sell, pair).unassociatedCount == 3);
+        }
+
+        THEN("Updating an unassociated fragment updates the totals")
+        {
+            Fragment fragment = db.getUnassociatedFragments(Side::Sell, 1., pair).front();
+            fragment.targetRate = 3.;
+            db.update(fragment);
+            sells = db.getFragmentTotals(Side::Sell, pair);
+            REQUIRE(sells.unassociatedBase == 30.);
+            REQUIRE(sells.unassociatedQuote == 70.);
+        }
+
+        THEN("Rebuilding the totals gives the same values")
+        {
+            db.prepareOrder("dbtest", Side::Buy, 0.5, pair);
+            stats::FragmentTotals before = db.getFragmentTotals(Side::Buy, pair);
+
+            db.rebuildFragmentTotals();
+            stats::FragmentTotals after = db.getFragmentTotals(Side::Buy, pair);
+            REQUIRE(after.unassociatedBase == before.unassociatedBase);
+            REQUIRE(after.unassociatedCount == 0);
+            REQUIRE(db.getFragmentTotals(Side::Sell, pair).unassociatedQuote == 50.);
+        }
+    }
+}
+
+
+SCENARIO("Fulfilled orders archival.", "[db]")
+{
+    using namespace ad::tradebot;
+
+    GIVEN("A database with an archive")
+    {
+        Database db{":memory:", ":memory:"};
+        const Pair pair{"DOGE", "BUSD"};
+
+        Order parent{"dbtest", "DOGE", "BUSD", 10., 1., Side::Sell};
+        db.insert(parent.setStatus(Order::Status::Fulfilled));
+        db.insert(Fragment{"DOGE", "BUSD", 10., 1., Side::Sell, 0., -1, parent.id});
+
+        db.insert(Fragment{"DOGE", "BUSD", 5., 2., Side::Buy});
+        Order lone = db.prepareOrder("dbtest", Side::Buy, 2., pair);
+        db.update(lone.setStatus(Order::Status::Fulfilled));
+
+        Fragment child{"DOGE", "BUSD", 10., 0.5, Side::Buy, 0., parent.id};
+        db.insert(child);
+
+        REQUIRE(db.countOrders() == 2);
+        REQUIRE(db.countArchivedOrders() == 0);
+
+        THEN("Only the orders without live spawned fragments are archived")
+        {
+            REQUIRE(db.archiveFulfilledOrders(10) == 1);
+            REQUIRE(db.countOrders() == 1);
+            REQUIRE(db.countArchivedOrders() == 1);
+            REQUIRE(db.getOrder(parent.id).id == parent.id);
+            REQUIRE_THROWS(db.getOrder(lone.id));
+            REQUIRE(db.countFragments() == 2);
+
+            REQUIRE(db.archiveFulfilledOrders(10) == 0);
+        }
+
+        THEN("The number of live orders is not bounded by the statement parameters limit")
+        {
+            // Above the historical SQLITE_MAX_VARIABLE_NUMBER of 999.
+            for (int orderId = 0; orderId != 1200; ++orderId)
+            {
+                db.insert(Order{"dbtest", "DOGE", "BUSD", 1., 1., Side::Buy});
+            }
+            REQUIRE(db.archiveFulfilledOrders(2000) == 1);
+            REQUIRE(db.countOrders() == 1201);
+        }
+
+        THEN("Orders are archived once their spawned fragments composed a fulfilled order")
+        {
+            Order order = db.prepareOrder("dbtest", Side::Buy, 0.5, pair);
+            REQUIRE(db.archiveFulfilledOrders(10) == 1);
+
+            Fragment composing = db.getFragmentsComposing(order).front();
+            composing.takenHome = 1.;
+            db.update(composing);
+            db.update(order.setStatus(Order::Status::Fulfilled));
+
+            // Batches are bounded.
+            REQUIRE(db.archiveFulfilledOrders(1) == 1);
+            REQUIRE(db.archiveFulfilledOrders(1) == 1);
+            REQUIRE(db.archiveFulfilledOrders(1) == 0);
+            REQUIRE(db.countOrders() == 0);
+            REQUIRE(db.countFragments() == 0);
+            REQUIRE(db.countArchivedOrders() == 3);
+
+            THEN("The taken home of archived fragments is kept in the totals")
+            {
+                REQUIRE(db.getFragmentTotals(Side::Buy, pair).takenHome == 1.);
+                db.rebuildFragmentTotals();
+                REQUIRE(db.getFragmentTotals(Side::Buy, pair).takenHome == 1.);
+            }
+        }
+    }
+
+    GIVEN("A database without archive")
+    {
+        Database db{":memory:"};
+        THEN("Orders cannot be archived")
+        {
+            REQUIRE_THROWS(db.archiveFulfilledOrders(10));
+        }
+    }
+}
+
+
+SCENARIO("Deferred writes.", "[db]")
+{
+    using namespace ad::tradebot;
+
+    GIVEN("A database file with a writer")
+    {
+        const std::string path =
+            (std::filesystem::temp_directory_path() / "tradebot-deferred-tests.sqlite").string();
+        for (const std::string suffix : {"", "-wal", "-shm"})
+        {
+            std::filesystem::remove(path + suffix);
+        }
+
+        Database db{path};
+        db.startWriter();
+
+        Order order{"dbtest", "DOGE", "BUSD", 10., 1., Side::Sell};
+        db.insert(order);
+
+        THEN("Deferred order updates are visible to the following reads")
+        {
+            db.updateDeferred(order.setStatus(Order::Status::Cancelling));
+            REQUIRE(db.getOrder(order.id).status == Order::Status::Cancelling);
+        }
+
+        THEN("Synchronous order updates are not overtaken by deferred ones")
+        {
+            for (int update = 0; update != 100; ++update)
+            {
+                db.updateDeferred(order.setStatus(Order::Status::Cancelling));
+            }
+            db.update(order.setStatus(Order::Status::Fulfilled));
+            db.flush();
+            REQUIRE(db.getOrder(order.id).status == Order::Status::Fulfilled);
+        }
+
+        THEN("Deferred stats are committed on flush")
+        {
+            stats::Balance balance;
+            balance.time = getTimestamp();
+            db.insertDeferred(stats::Launch{});
+            db.insertDeferred(balance);
+            db.flush();
+            REQUIRE(db.countBalances() == 1);
+        }
+    }
+
+    GIVEN("An in-memory database")
+    {
+        Database db{":memory:"};
+        db.startWriter();
+
+        THEN("Deferred writes are applied immediately")
+        {
+            stats::Balance balance;
+            balance.time = getTimestamp();
+            db.insertDeferred(balance);
+            REQUIRE(db.countBalances() == 1);
+        }
+    }
+}
+
+
+SCENARIO("Database performance profiles.", "[db]")
+{
+    using namespace ad::tradebot;
+
+    GIVEN("Database files opened with each profile")
+    {
+        for (const std::string profile : {"default", "durable", "fast"})
+        {
+            const std::string path =
+                (std::filesystem::temp_directory_path() / ("tradebot-profile-tests-" + profile + ".sqlite")).string();
+            for (const std::string suffix : {"", "-wal", "-shm"})
+            {
+                std::filesystem::remove(path + suffix);
+            }
+
+            Database db{path, {}, makeDatabaseProfile(profile)};
+            db.startWriter();
+
+            Order order{"dbtest", "DOGE", "BUSD", 10., 1., Side::Sell};
+            db.insert(order);
+            db.insert(Fragment{"DOGE", "BUSD", 10., 1., Side::Sell});
+            db.updateDeferred(order.setStatus(Order::Status::Cancelling));
+
+            THEN("The writes are read back, including from the writer connection")
+            {
+                REQUIRE(db.getOrder(order.id).status == Order::Status::Cancelling);
+                REQUIRE(db.countUnassociatedFragments(Side::Sell, {"DOGE", "BUSD"}) == 1);
+            }
+        }
+    }
+
+    GIVEN("A database file with an archive, opened with a checkpointed profile")
+    {
+        const std::string path =
+            (std::filesystem::temp_directory_path() / "tradebot-profile-tests-archived.sqlite").string();
+        const std::string archivePath =
+            (std::filesystem::temp_directory_path() / "tradebot-profile-tests-archive.sqlite").string();
+        for (const std::string suffix : {"", "-wal", "-shm"})
+        {
+            std::filesystem::remove(path + suffix);
+            std::filesystem::remove(archivePath + suffix);
+        }
+
+        DatabaseOptions options = makeDatabaseProfile("durable");
+        options.checkpointPeriod = std::chrono::milliseconds{5};
+        Database db{path, archivePath, options};
+
+        auto archiveOrder = [&]()
+        {
+            Order order{"dbtest", "DOGE", "BUSD", 10., 1., Side::Sell};
+            db.insert(order.setStatus(Order::Status::Fulfilled));
+            REQUIRE(db.archiveFulfilledOrders(10) == 1);
+            // Leaves time for several checkpoints.
+            std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        };
+
+        THEN("The archive WAL is reset after its checkpoints, instead of growing with each archival")
+        {
+            archiveOrder();
+            const auto walSize = std::filesystem::file_size(archivePath + "-wal");
+            REQUIRE(walSize > 0);
+
+            for (int archival = 0; archival != 20; ++archival)
+            {
+                archiveOrder();
+            }
+            REQUIRE(db.countArchivedOrders() == 21);
+            REQUIRE(std::filesystem::file_size(archivePath + "-wal") <= 2 * walSize);
+        }
+    }
+
+    GIVEN("An unknown profile name")
+    {
+        THEN("No options can be made")
+        {
+            REQUIRE_THROWS_AS(makeDatabaseProfile("reckless"), std::invalid_argument);
+        }
+    }
+}
+
+
+SCENARIO("Read replicas.", "[db]")
+{
+    using namespace ad::tradebot;
+
+    GIVEN("A database file with an order")
+    {
+        const std::string path =
+            (std::filesystem::temp_directory_path() / "tradebot-replica-tests.sqlite").string();
+        for (const std::string suffix : {"", "-wal", "-shm"})
+        {
+            std::filesystem::remove(path + suffix);
+        }
+
+        Database db{path};
+        Order order{"dbtest", "DOGE", "BUSD", 10., 1., Side::Sell};
+        db.insert(order);
+
+        Database replica = Database::openReadReplica(path);
+
+        THEN("The replica reads the committed state")
+        {
+            REQUIRE(replica.countOrders() == 1);
+            REQUIRE(replica.getOrder(order.id).baseAmount == order.baseAmount);
+        }
+
+        THEN("The replica cannot write")
+        {
+            REQUIRE_THROWS(replica.insert(Order{"dbtest", "DOGE", "BUSD", 5., 1., Side::Buy}));
+            REQUIRE_THROWS_AS(replica.startWriter(), std::logic_error);
+            REQUIRE(db.countOrders() == 1);
+        }
+
+        WHEN("The replica reads in a transaction while the database writes")
+        {
+            auto guard = replica.startTransaction();
+            REQUIRE(replica.countOrders() == 1);
+
+            db.insert(Order{"dbtest", "DOGE", "BUSD", 5., 1., Side::Buy});
+
+            THEN("The transaction keeps reading its snapshot")
+            {
+                REQUIRE(replica.countOrders() == 1);
+                replica.commit(std::move(guard));
+                REQUIRE(replica.countOrders() == 2);
+            }
+        }
+    }
+
+    GIVEN("A missing database file")
+    {
+        const std::string path =
+            (std::filesystem::temp_directory_path() / "tradebot-replica-missing.sqlite").string();
+        std::filesystem::remove(path);
+
+        THEN("No replica can be opened")
+        {
+            REQUIRE_THROWS_AS(Database::openReadReplica(path), std::invalid_argument);
+        }
+    }
+}
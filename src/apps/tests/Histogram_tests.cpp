@@ -0,0 +1,171 @@
+#include "catch.hpp"
+
+#include <trademath/Histogram.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace ad;
+using namespace ad::trade;
+
+
+SCENARIO("Histogram buckets.", "[histogram]")
+{
+    GIVEN("Values in the linear range")
+    {
+        THEN("Each value has its own bucket")
+        {
+            for (std::uint64_t value = 0; value != Histogram::gSubBucketCount; ++value)
+            {
+                REQUIRE(Histogram::bucketIndex(value) == value);
+                REQUIRE(Histogram::bucketLowerBound(value) == value);
+                REQUIRE(Histogram::bucketUpperBound(value) == value);
+            }
+        }
+    }
+
+    GIVEN("Values above the linear range")
+    {
+        THEN("Each value falls within the bounds of its bucket, with bounded relative error")
+        {
+            for (std::uint64_t value : {32ull, 33ull, 63ull, 64ull, 65ull, 1000ull, 123456ull, (1ull << 39) + 7})
+            {
+                std::size_t index = Histogram::bucketIndex(value);
+                std::uint64_t lower = Histogram::bucketLowerBound(index);
+                std::uint64_t upper = Histogram::bucketUpperBound(index);
+                REQUIRE(lower <= value);
+                REQUIRE(value <= upper);
+                REQUIRE((upper - lower) <= lower / Histogram::gSubBucketCount);
+            }
+        }
+
+        THEN("Buckets are contiguous")
+        {
+            for (std::size_t index = 0; index + 1 != Histogram::gBucketCount; ++index)
+            {
+                REQUIRE(Histogram::bucketUpperBound(index) + 1 == Histogram::bucketLowerBound(index + 1));
+                REQUIRE(Histogram::bucketIndex(Histogram::bucketLowerBound(index)) == index);
+            }
+        }
+
+        THEN("Values beyond the range are counted in the last bucket")
+        {
+            REQUIRE(Histogram::bucketIndex(1ull << 40) == Histogram::gBucketCount - 1);
+            REQUIRE(Histogram::bucketIndex(std::numeric_limits<std::uint64_t>::max())
+                    == Histogram::gBucketCount - 1);
+        }
+    }
+}
+
+
+SCENARIO("Histogram recording.", "[histogram]")
+{
+    GIVEN("An empty histogram")
+    {
+        Histogram histogram;
+
+        THEN("Its summary is null")
+        {
+            Histogram::Summary summary = histogram.summarize();
+            REQUIRE(summary.count == 0);
+            REQUIRE(summary.min == 0);
+            REQUIRE(summary.max == 0);
+            REQUIRE(summary.p99 == 0);
+        }
+
+        WHEN("Values 1 to 1000 are recorded")
+        {
+            for (std::uint64_t value = 1; value <= 1000; ++value)
+            {
+                histogram.record(value);
+            }
+
+            THEN("The summary reflects them, within the precision of the buckets")
+            {
+                Histogram::Summary summary = histogram.summarize();
+                REQUIRE(summary.count == 1000);
+                REQUIRE(summary.min == 1);
+                REQUIRE(summary.max == 1000);
+                REQUIRE(summary.mean == Approx(500.5));
+                REQUIRE(summary.p50 >= 500);
+                REQUIRE(summary.p50 <= 500 + 500 / Histogram::gSubBucketCount);
+                REQUIRE(summary.p99 >= 990);
+                REQUIRE(summary.p99 <= 1000);
+                REQUIRE(histogram.valueAtPercentile(100.) == 1000);
+                REQUIRE(histogram.valueAtPercentile(0.) == 1);
+            }
+
+            THEN("An invalid percentile throws")
+            {
+                REQUIRE_THROWS(histogram.valueAtPercentile(100.1));
+            }
+
+            THEN("It can be reset")
+            {
+                histogram.reset();
+                REQUIRE(histogram.count() == 0);
+                REQUIRE(histogram.summarize().max == 0);
+            }
+        }
+
+        WHEN("Values are recorded concurrently")
+        {
+            std::vector<std::thread> threads;
+            for (std::uint64_t thread = 0; thread != 4; ++thread)
+            {
+                threads.emplace_back([&histogram, thread]()
+                {
+                    for (std::uint64_t value = 0; value != 10000; ++value)
+                    {
+                        histogram.record(thread * 10000 + value);
+                    }
+                });
+            }
+            for (auto & thread : threads)
+            {
+                thread.join();
+            }
+
+            THEN("All values are accounted for")
+            {
+                Histogram::Summary summary = histogram.summarize();
+                REQUIRE(summary.count == 40000);
+                REQUIRE(summary.min == 0);
+                REQUIRE(summary.max == 39999);
+            }
+        }
+    }
+}
+
+
+SCENARIO("Histogram family.", "[histogram]")
+{
+    GIVEN("An empty histogram family")
+    {
+        HistogramFamily family;
+
+        WHEN("Values are recorded under different labels")
+        {
+            family.get("b").record(10);
+            family.get("a").record(20);
+            family.get("b").record(30);
+
+            THEN("Each label has its own histogram, visited in label order")
+            {
+                std::vector<std::string> labels;
+                std::vector<std::uint64_t> sums;
+                family.forEach([&](const std::string & aLabel, const Histogram & aHistogram)
+                {
+                    labels.push_back(aLabel);
+                    sums.push_back(aHistogram.sum());
+                });
+
+                REQUIRE(labels == std::vector<std::string>{"a", "b"});
+                REQUIRE(sums == std::vector<std::uint64_t>{20, 40});
+                REQUIRE(&family.get("a") == &family.get("a"));
+            }
+        }
+    }
+}
@@ -0,0 +1,247 @@
+#include "catch.hpp"
+
+#include <tradebot/marketdata/OrderBook.h>
+#include <tradebot/marketdata/Recorder.h>
+#include <tradebot/marketdata/TradeArchive.h>
+
+#include <iterator>
+#include <thread>
+
+
+using namespace ad;
+using namespace ad::tradebot::marketdata;
+
+
+SCENARIO("Fixed point parsing.", "[marketdata]")
+{
+    GIVEN("Decimal strings as sent by the exchange")
+    {
+        THEN("They are parsed exactly")
+        {
+            REQUIRE(parseFixedPoint("26012.34000000") == 2601234000000);
+            REQUIRE(parseFixedPoint("0.00000001") == 1);
+            REQUIRE(parseFixedPoint("12") == 1200000000);
+            REQUIRE(parseFixedPoint("1.5") == 150000000);
+            REQUIRE(parseFixedPoint("-0.25") == -25000000);
+            REQUIRE(parseFixedPoint("0.1234567800") == 12345678);
+            REQUIRE(toDouble(parseFixedPoint("1.5")) == 1.5);
+        }
+
+        THEN("Values which cannot be represented exactly are rejected")
+        {
+            REQUIRE_THROWS(parseFixedPoint("0.000000001"));
+            REQUIRE_THROWS(parseFixedPoint("1.2.3"));
+            REQUIRE_THROWS(parseFixedPoint("abc"));
+            REQUIRE_THROWS(parseFixedPoint(""));
+            REQUIRE_THROWS(parseFixedPoint("-"));
+            REQUIRE_THROWS(parseFixedPoint("100000000000000"));
+        }
+    }
+
+    GIVEN("An aggTrade message")
+    {
+        Json message = Json::parse(R"#({
+            "e": "aggTrade", "E": 123456789, "s": "BTCUSDT", "a": 5933014, "p": "0.001",
+            "q": "100", "f": 100, "l": 105, "T": 123456785, "m": true, "M": true
+        })#");
+
+        THEN("It is decoded as a record")
+        {
+            AggregateTrade trade = AggregateTrade::fromJson(message);
+            REQUIRE(trade.eventTime == 123456789);
+            REQUIRE(trade.tradeTime == 123456785);
+            REQUIRE(trade.aggregateTradeId == 5933014);
+            REQUIRE(trade.firstTradeId == 100);
+            REQUIRE(trade.lastTradeId == 105);
+            REQUIRE(trade.price == 100000);
+            REQUIRE(trade.quantity == 100 * gFixedPointScale);
+            REQUIRE(trade.buyerIsMaker == 1);
+        }
+    }
+}
+
+
+SCENARIO("Trade archive recording.", "[marketdata]")
+{
+    const std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "tradebot-marketdata-tests";
+    std::filesystem::remove_all(directory);
+
+    // 2023/12/22 00:00:00 UTC
+    const MillisecondsSinceEpoch day = 1703203200000;
+    const MillisecondsSinceEpoch minute = 60 * 1000;
+
+    auto makeTrade = [](std::int64_t aId, MillisecondsSinceEpoch aTime)
+    {
+        return AggregateTrade{aTime + 1, aTime, aId, aId, aId, aId * 100, gFixedPointScale, aId % 2 == 0};
+    };
+
+    GIVEN("A recorder")
+    {
+        Recorder recorder{directory, "btcusdt"};
+        REQUIRE(recorder.getStreamName() == "btcusdt@aggTrade");
+        REQUIRE(recorder.getArchivePath(day).filename() == "BTCUSDT-aggTrade-20231222.bin");
+
+        WHEN("Trades spanning several minutes of a day are recorded")
+        {
+            // 3 trades per minute, for 5 minutes. The 3rd minute has no trades.
+            std::int64_t id = 0;
+            for (MillisecondsSinceEpoch offset : {0, 1, 3, 4})
+            {
+                for (int trade = 0; trade != 3; ++trade)
+                {
+                    recorder.record(makeTrade(id++, day + offset * minute + trade * 1000));
+                }
+            }
+
+            THEN("They can be read back, and searched by time")
+            {
+                TradeFileReader reader{recorder.getArchivePath(day)};
+                REQUIRE(std::string{reader.getHeader().symbol} == "BTCUSDT");
+                REQUIRE(reader.getHeader().day == day);
+                REQUIRE(reader.size() == 12);
+                REQUIRE(reader.begin()->aggregateTradeId == 0);
+                REQUIRE((reader.end() - 1)->aggregateTradeId == 11);
+                REQUIRE((reader.begin() + 5)->price == 500);
+
+                REQUIRE(reader.lowerBound(day)->aggregateTradeId == 0);
+                REQUIRE(reader.lowerBound(day + minute + 1500)->aggregateTradeId == 5);
+                // In the minute without trades
+                REQUIRE(reader.lowerBound(day + 2 * minute + 30000)->aggregateTradeId == 6);
+                REQUIRE(reader.lowerBound(day + 3 * minute)->aggregateTradeId == 6);
+                REQUIRE(reader.lowerBound(day + 10 * minute) == reader.end());
+            }
+
+            WHEN("The recording continues on the next day")
+            {
+                recorder.record(makeTrade(id++, day + 24 * 60 * minute + 10));
+
+                THEN("A new archive file is started, and the previous one is truncated")
+                {
+                    REQUIRE(std::filesystem::file_size(recorder.getArchivePath(day))
+                            == sizeof(ArchiveHeader) + 12 * sizeof(AggregateTrade));
+
+                    TradeFileReader reader{recorder.getArchivePath(day + 24 * 60 * minute)};
+                    REQUIRE(reader.size() == 1);
+                    REQUIRE(reader.begin()->aggregateTradeId == 12);
+                }
+            }
+        }
+    }
+
+    GIVEN("An archive file written by a previous recorder")
+    {
+        {
+            Recorder recorder{directory, "BTCUSDT"};
+            recorder.record(makeTrade(0, day));
+            recorder.record(makeTrade(1, day + minute));
+        }
+
+        WHEN("Another recorder appends to the same day")
+        {
+            {
+                Recorder recorder{directory, "BTCUSDT"};
+                recorder.record(makeTrade(2, day + 2 * minute));
+            }
+
+            THEN("The trades are appended after the existing ones")
+            {
+                TradeFileReader reader{Recorder{directory, "BTCUSDT"}.getArchivePath(day)};
+                REQUIRE(reader.size() == 3);
+                REQUIRE((reader.begin() + 2)->aggregateTradeId == 2);
+                REQUIRE(reader.lowerBound(day + 2 * minute)->aggregateTradeId == 2);
+            }
+        }
+
+        THEN("A writer for another symbol cannot reuse it")
+        {
+            auto countDescriptors = []()
+            {
+                auto entries = std::filesystem::directory_iterator{"/proc/self/fd"};
+                return std::distance(begin(entries), end(entries));
+            };
+
+            const std::filesystem::path path = Recorder{directory, "BTCUSDT"}.getArchivePath(day);
+            const auto fileSize = std::filesystem::file_size(path);
+            const auto descriptors = countDescriptors();
+
+            REQUIRE_THROWS(TradeFileWriter{path, "ETHUSDT", day});
+
+            // Neither the descriptor is leaked, nor the file altered.
+            REQUIRE(countDescriptors() == descriptors);
+            REQUIRE(std::filesystem::file_size(path) == fileSize);
+        }
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+
+SCENARIO("Order book visible liquidity.", "[marketdata]")
+{
+    using tradebot::Side;
+
+    GIVEN("An order book without any update")
+    {
+        OrderBook book;
+
+        THEN("The available quantity is unknown")
+        {
+            REQUIRE_FALSE(book.availableQuantity(Side::Sell, Decimal{"10"}));
+            REQUIRE(book.getVersion() == 0);
+            REQUIRE_FALSE(book.waitForUpdate(0, std::chrono::milliseconds{1}));
+        }
+
+        WHEN("It receives a book ticker")
+        {
+            book.onBookTicker(Json::parse(R"({"u":400900217,"s":"BNBUSDT",)"
+                                          R"("b":"25.35190000","B":"31.21000000",)"
+                                          R"("a":"25.36520000","A":"40.66000000"})"));
+
+            THEN("Nothing is available at limits the best levels do not reach")
+            {
+                REQUIRE(book.getVersion() == 1);
+                REQUIRE(*book.availableQuantity(Side::Sell, Decimal{"25.36"}) == 0);
+                REQUIRE(*book.availableQuantity(Side::Buy, Decimal{"25.36"}) == 0);
+            }
+
+            THEN("The quantity is unknown at limits matching the best levels, deeper levels might match too")
+            {
+                REQUIRE_FALSE(book.availableQuantity(Side::Sell, Decimal{"25.35"}));
+                REQUIRE_FALSE(book.availableQuantity(Side::Buy, Decimal{"25.3652"}));
+            }
+        }
+
+        WHEN("It receives a partial depth")
+        {
+            book.onPartialDepth(Json::parse(R"({"lastUpdateId":160,)"
+                                            R"("bids":[["0.0024","10"],["0.0023","5"],["0.0022","1"]],)"
+                                            R"("asks":[["0.0026","100"],["0.0027","7"]]})"));
+
+            THEN("All the levels crossing the limit are summed")
+            {
+                REQUIRE(*book.availableQuantity(Side::Sell, Decimal{"0.0023"}) == 15);
+                REQUIRE(*book.availableQuantity(Side::Buy, Decimal{"0.0026"}) == 100);
+            }
+
+            THEN("The quantity is unknown when all the visible levels cross the limit")
+            {
+                REQUIRE_FALSE(book.availableQuantity(Side::Sell, Decimal{"0.0022"}));
+                REQUIRE_FALSE(book.availableQuantity(Side::Sell, Decimal{"0.0020"}));
+                REQUIRE_FALSE(book.availableQuantity(Side::Buy, Decimal{"0.0027"}));
+            }
+        }
+    }
+
+    GIVEN("An order book with a short maximum age")
+    {
+        OrderBook book{std::chrono::milliseconds{1}};
+        book.onBookTicker(Json::parse(R"({"b":"1","B":"1","a":"2","A":"1"})"));
+        std::this_thread::sleep_for(std::chrono::milliseconds{5});
+
+        THEN("Its data is considered unknown once stale")
+        {
+            REQUIRE_FALSE(book.availableQuantity(Side::Sell, Decimal{"1"}));
+        }
+    }
+}
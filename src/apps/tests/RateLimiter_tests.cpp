@@ -0,0 +1,68 @@
+#include "catch.hpp"
+
+#include <tradebot/RateLimiter.h>
+
+#include <vector>
+
+
+using namespace ad;
+using namespace ad::tradebot;
+
+
+SCENARIO("Rate limiter.", "[ratelimiter]")
+{
+    GIVEN("A rate limiter allowing bursts of 3, then 50 operations per second, on a manual clock.")
+    {
+        RateLimiter::Clock::time_point time{};
+        std::vector<double> waits;
+        RateLimiter limiter{
+            50.,
+            3.,
+            [&time](){ return time; },
+            [&waits](std::chrono::duration<double> aWait){ waits.push_back(aWait.count()); }
+        };
+
+        THEN("The burst is allowed immediately.")
+        {
+            for (int operation = 0; operation != 3; ++operation)
+            {
+                REQUIRE_FALSE(limiter.acquire());
+            }
+            REQUIRE(waits.empty());
+
+            THEN("The following operations wait for their reserved token, in order.")
+            {
+                REQUIRE(limiter.acquire());
+                REQUIRE(limiter.acquire());
+                REQUIRE(waits.size() == 2);
+                REQUIRE(waits[0] == Approx(0.02));
+                REQUIRE(waits[1] == Approx(0.04));
+            }
+
+            THEN("The tokens are refilled with time, up to the burst.")
+            {
+                time += std::chrono::milliseconds{40};
+                REQUIRE_FALSE(limiter.acquire());
+                REQUIRE_FALSE(limiter.acquire());
+                REQUIRE(limiter.acquire());
+                REQUIRE(waits.back() == Approx(0.02));
+
+                time += std::chrono::seconds{10};
+                for (int operation = 0; operation != 3; ++operation)
+                {
+                    REQUIRE_FALSE(limiter.acquire());
+                }
+                REQUIRE(limiter.acquire());
+            }
+        }
+    }
+
+    GIVEN("Invalid limits.")
+    {
+        THEN("No limiter can be constructed.")
+        {
+            REQUIRE_THROWS_AS((RateLimiter{0., 1.}), std::invalid_argument);
+            REQUIRE_THROWS_AS((RateLimiter{1., 0.5}), std::invalid_argument);
+        }
+    }
+}
@@ -773,6 +773,55 @@ SCENARIO("Consolidation of counter-fragments.", "[spawn]")
 }
 
 
+SCENARIO("Spawn buffer consolidation.", "[spawn]")
+{
+    GIVEN("A spawn buffer with the spawns of several fragments")
+    {
+        SpawnBuffer buffer;
+        std::vector<Spawn> first{
+            {Decimal{"3"}, Base{Decimal{"10"}}},
+            {Decimal{"2"}, Base{Decimal{"5"}}},
+            {Decimal{"1"}, Base{Decimal{"1"}}},
+        };
+        std::vector<Spawn> second{
+            {Decimal{"2"}, Base{Decimal{"0.5"}}},
+            {Decimal{"4"}, Base{Decimal{"7"}}},
+        };
+        buffer.append(first.begin(), first.end());
+        buffer.append(second.begin(), second.end());
+        buffer.append(first.begin(), first.begin() + 1);
+
+        WHEN("It is consolidated")
+        {
+            buffer.consolidate();
+
+            THEN("There is a single entry per rate, by increasing rate")
+            {
+                const std::vector<SpawnBuffer::Entry> & entries = buffer.getEntries();
+                REQUIRE(entries.size() == 4);
+                CHECK(entries[0].rate == Decimal{"1"});
+                CHECK(entries[0].base == Decimal{"1"});
+                CHECK(entries[1].rate == Decimal{"2"});
+                CHECK(entries[1].base == Decimal{"5.5"});
+                CHECK(entries[2].rate == Decimal{"3"});
+                CHECK(entries[2].base == Decimal{"20"});
+                CHECK(entries[3].rate == Decimal{"4"});
+                CHECK(entries[3].base == Decimal{"7"});
+            }
+
+            THEN("It can be reused once cleared")
+            {
+                buffer.clear();
+                REQUIRE(buffer.getEntries().empty());
+                buffer.append(second.begin(), second.end());
+                buffer.consolidate();
+                REQUIRE(buffer.getEntries().size() == 2);
+            }
+        }
+    }
+}
+
+
 SCENARIO("Fix tradebot#1: change in filter price.", "[spawn]")
 {
     GIVEN("Different internal and exchange price tick sizes.")
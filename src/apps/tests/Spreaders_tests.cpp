@@ -2,6 +2,8 @@
 
 #include <trademath/Spreaders.h>
 
+#include <random>
+
 
 using namespace ad;
 using namespace ad::trade;
@@ -214,4 +216,177 @@ SCENARIO("Spreader multiple proportions", "[spreaders]")
         }
 
     }
-}
\ No newline at end of file
+}
+
+SCENARIO("Spreader stop lookup", "[spreaders]")
+{
+    GIVEN("A proportion spreader over a generated ladder")
+    {
+        Ladder ladder = makeLadder(Decimal{"0.1"}, Decimal{"1.05"}, 50, Decimal{"0.0001"});
+
+        ProportionSpreader spreader{
+            ladder,
+            ProportionsMap{
+                {
+                    ladder.at(20),
+                    {Decimal{"0.3"}, Decimal{"0.7"}},
+                },
+                {
+                    ladder.at(40),
+                    {Decimal{"0.1"}, Decimal{"0.2"}, Decimal{"0.3"}, Decimal{"0.4"}},
+                }
+            },
+            Decimal{"0.01"},
+        };
+
+        THEN("Spreading from each stop matches the spread over the ladder")
+        {
+            Decimal amount{"1234.5678"};
+            for (std::size_t index = 0; index != ladder.size(); ++index)
+            {
+                const std::vector<Decimal> & proportions = spreader.getProportions(ladder[index]);
+
+                auto down = spreader.spreadDown(Quote{amount}, ladder[index]);
+                auto expectedDown = spawnProportions(Quote{amount},
+                                                     ladder.crbegin() + (ladder.size() - index), ladder.crend(),
+                                                     proportions.cbegin(), proportions.cend(),
+                                                     spreader.amountTickSize);
+                REQUIRE(down.first == expectedDown.first);
+                REQUIRE(static_cast<Decimal>(down.second) == static_cast<Decimal>(expectedDown.second));
+
+                auto up = spreader.spreadUp(Base{amount}, ladder[index]);
+                auto expectedUp = spawnProportions(Base{amount},
+                                                   ladder.cbegin() + index + 1, ladder.cend(),
+                                                   proportions.cbegin(), proportions.cend(),
+                                                   spreader.amountTickSize);
+                REQUIRE(up.first == expectedUp.first);
+                REQUIRE(static_cast<Decimal>(up.second) == static_cast<Decimal>(expectedUp.second));
+            }
+        }
+
+        THEN("Rates which are not ladder stops are rejected")
+        {
+            REQUIRE_THROWS(spreader.spreadDown(Base{Decimal{1}}, ladder.at(3) + Decimal{"0.00001"}));
+            REQUIRE_THROWS(spreader.spreadUp(Base{Decimal{1}}, ladder.back() * 2));
+        }
+    }
+
+    GIVEN("A ladder which is not increasing")
+    {
+        THEN("The spreader cannot be constructed")
+        {
+            REQUIRE_THROWS(ProportionSpreader{
+                Ladder{2, 1},
+                ProportionsMap{{Decimal{10}, {Decimal{1}}}},
+            });
+        }
+    }
+}
+
+
+SCENARIO("Spreader batches", "[spreaders]")
+{
+    GIVEN("A proportion spreader over a generated ladder")
+    {
+        Ladder ladder = makeLadder(Decimal{"0.05"}, Decimal{"1.02"}, 200, Decimal{"0.0001"});
+
+        ProportionSpreader spreader{
+            ladder,
+            ProportionsMap{
+                {
+                    ladder.at(100),
+                    {Decimal{"0.1"}, Decimal{"0.15"}, Decimal{"0.2"}, Decimal{"0.25"}, Decimal{"0.3"}},
+                },
+                {
+                    ladder.back(),
+                    {Decimal{"0.125"}, Decimal{"0.375"}, Decimal{"0.5"}},
+                }
+            },
+        };
+
+        // Amounts with up to 16 decimals, as obtained by multiplying two exchange values.
+        std::mt19937_64 generator{42};
+        std::uniform_int_distribution<std::uint64_t> baseAmounts{1, 100'000'000'000};
+        std::uniform_int_distribution<std::uint64_t> quoteAmounts{1, 2'000'000'000'000'000'000};
+        std::uniform_int_distribution<std::size_t> stops{0, ladder.size() - 1};
+
+        std::vector<Decimal> amounts;
+        std::vector<Decimal> rates;
+        for (std::size_t fragmentId = 0; fragmentId != 500; ++fragmentId)
+        {
+            rates.push_back(ladder[stops(generator)]);
+        }
+
+        auto requireIdentical = [&](const SpawnBatch & aBatch, auto aSpread)
+        {
+            REQUIRE(aBatch.size() == amounts.size());
+            for (std::size_t fragmentId = 0; fragmentId != amounts.size(); ++fragmentId)
+            {
+                auto [spawns, accumulation] = aSpread(amounts[fragmentId], rates[fragmentId]);
+                std::vector<Spawn> batchSpawns = aBatch.getSpawns(fragmentId);
+                REQUIRE(batchSpawns == spawns);
+                REQUIRE(aBatch.accumulations[fragmentId] == static_cast<Decimal>(accumulation));
+                for (std::size_t spawnId = 0; spawnId != spawns.size(); ++spawnId)
+                {
+                    REQUIRE(batchSpawns[spawnId].base.str(40) == spawns[spawnId].base.str(40));
+                }
+            }
+        };
+
+        THEN("Base amounts spread as the scalar spreader")
+        {
+            for (std::size_t fragmentId = 0; fragmentId != rates.size(); ++fragmentId)
+            {
+                amounts.push_back(Decimal{baseAmounts(generator)} / 100'000'000);
+            }
+
+            SpawnBatch batch;
+            spreader.spreadDownBatch<Base>(amounts, rates, batch);
+            requireIdentical(batch, [&](Decimal aAmount, Decimal aRate)
+                    {
+                        return spreader.spreadDown(Base{aAmount}, aRate);
+                    });
+            // Only the fragments too close to the bottom of the ladder use Decimal.
+            CHECK(batch.decimalSpawns < batch.rates.size() / 10);
+
+            batch.clear();
+            spreader.spreadUpBatch<Base>(amounts, rates, batch);
+            requireIdentical(batch, [&](Decimal aAmount, Decimal aRate)
+                    {
+                        return spreader.spreadUp(Base{aAmount}, aRate);
+                    });
+        }
+
+        THEN("Quote amounts spread as the scalar spreader")
+        {
+            for (std::size_t fragmentId = 0; fragmentId != rates.size(); ++fragmentId)
+            {
+                // Keeps some amounts with few decimals, whose spawns can be exact ticks.
+                amounts.push_back(fragmentId % 4 == 0 ?
+                                  Decimal{quoteAmounts(generator) % 100'000}
+                                  : Decimal{quoteAmounts(generator)} / 10'000'000'000'000'000);
+            }
+
+            SpawnBatch batch;
+            spreader.spreadDownBatch<Quote>(amounts, rates, batch);
+            requireIdentical(batch, [&](Decimal aAmount, Decimal aRate)
+                    {
+                        return spreader.spreadDown(Quote{aAmount}, aRate);
+                    });
+            CHECK(batch.decimalSpawns < batch.rates.size() / 10);
+        }
+
+        THEN("Amounts which are not representable use Decimal")
+        {
+            amounts.assign(rates.size(), Decimal{1} / 3);
+
+            SpawnBatch batch;
+            spreader.spreadDownBatch<Base>(amounts, rates, batch);
+            requireIdentical(batch, [&](Decimal aAmount, Decimal aRate)
+                    {
+                        return spreader.spreadDown(Base{aAmount}, aRate);
+                    });
+            CHECK(batch.decimalSpawns == batch.rates.size());
+        }
+    }
+}
@@ -248,3 +248,95 @@ SCENARIO("StableDownSpread from fixed proportions.", "[sdspread]")
 
     }
 }
+
+
+SCENARIO("StableDownSpread order spawns.", "[sdspread]")
+{
+    const Pair pair{"BTC", "USDT"};
+    const std::string tradername = "sdspreadtest";
+
+    GIVEN("A StableDownSpread with proportion spreader")
+    {
+        spawner::StableDownSpread<trade::ProportionSpreader> spawner{
+            trade::ProportionSpreader{
+                trade::Ladder{1, 2, 3, 4, 5, 6, 7, 8, 9},
+                trade::ProportionsMap{
+                    {Decimal{10000}, {Decimal{"0.4"}, Decimal{"0.6"}}},
+                },
+                Decimal{"0.01"},
+            },
+            Decimal{"0.4"},
+            Decimal{"0.2"},
+            Decimal{"0.3"},
+        };
+
+        WHEN("An order of several initial sell fragments is fulfilled.")
+        {
+            tradebot::Database db{":memory:"};
+
+            auto [order, fragments] =
+                makeOrderWithFragments(db, tradername, pair,
+                                       {Decimal{"100"}, Decimal{"37.53"}, Decimal{"0.12"}},
+                                       Decimal{"5"}, Side::Sell);
+            FulfilledOrder fulfilled = mockupFulfill(order, Decimal{"5.17"});
+
+            ParentOrders parents{db};
+            SpawnBuffer buffer;
+            std::vector<Fragment> batched = fragments;
+            spawner.computeOrderSpawns(batched, fulfilled, parents, buffer);
+
+            THEN("The initial sells are spread in a batch, as they would be one at a time.")
+            {
+                std::size_t entry = 0;
+                for (std::size_t id = 0; id != fragments.size(); ++id)
+                {
+                    INFO("Fragment index is " << id);
+                    auto [spawns, takenHome] = spawner.computeResultingFragments(fragments[id], fulfilled, parents);
+                    REQUIRE(batched[id].takenHome == takenHome);
+                    for (const trade::Spawn & spawn : spawns)
+                    {
+                        REQUIRE(buffer.getEntries().at(entry).rate == spawn.rate);
+                        REQUIRE(buffer.getEntries().at(entry).base == spawn.base);
+                        ++entry;
+                    }
+                }
+                REQUIRE(buffer.getEntries().size() == entry);
+            }
+        }
+    }
+}
+
+
+SCENARIO("Parent orders cache.", "[sdspread]")
+{
+    const Pair pair{"BTC", "USDT"};
+    const std::string tradername = "sdspreadtest";
+
+    GIVEN("Two orders in database")
+    {
+        tradebot::Database db{":memory:"};
+
+        Order sell = makeOrderWithFragments(db, tradername, pair, {Decimal{"10"}}, Decimal{"5"}, Side::Sell).first;
+        Order buy = makeOrderWithFragments(db, tradername, pair, {Decimal{"10"}}, Decimal{"3"}, Side::Buy).first;
+
+        WHEN("Their rates are read through a bounded cache.")
+        {
+            ParentOrders parents{db, 1};
+
+            THEN("The rates match the orders.")
+            {
+                REQUIRE(parents.getFragmentsRate(sell.id) == sell.fragmentsRate);
+                REQUIRE(parents.getFragmentsRate(sell.id) == sell.fragmentsRate);
+                REQUIRE(parents.size() == 1);
+
+                REQUIRE(parents.getFragmentsRate(buy.id) == buy.fragmentsRate);
+                REQUIRE(parents.size() == 1);
+            }
+
+            THEN("Unknown orders are reported.")
+            {
+                REQUIRE_THROWS(parents.getFragmentsRate(buy.id + 1));
+            }
+        }
+    }
+}
@@ -0,0 +1,276 @@
+#include "catch.hpp"
+
+#include <tradebot/Stream.h>
+
+
+using namespace ad;
+using namespace ad::tradebot;
+
+
+SCENARIO("Combined stream routing.", "[stream]")
+{
+    GIVEN("A stream router with handlers for two streams.")
+    {
+        std::vector<Json> trades;
+        std::vector<Json> tickers;
+
+        StreamRouter router{
+            {
+                {"dogeusdt@aggTrade", [&trades](Json aMessage){ trades.push_back(std::move(aMessage)); }},
+                {"dogeusdt@bookTicker", [&tickers](Json aMessage){ tickers.push_back(std::move(aMessage)); }},
+            }
+        };
+
+        REQUIRE(router.listStreams() == std::vector<std::string>{"dogeusdt@aggTrade", "dogeusdt@bookTicker"});
+
+        THEN("Combined messages are dispatched to the handler of their stream, unwrapped.")
+        {
+            router.route(Json::parse(R"({"stream":"dogeusdt@aggTrade","data":{"e":"aggTrade","a":12,"p":"0.2"}})"));
+            router.route(Json::parse(R"({"stream":"dogeusdt@bookTicker","data":{"u":400,"b":"0.19"}})"));
+            router.route(Json::parse(R"({"stream":"dogeusdt@aggTrade","data":{"e":"aggTrade","a":13,"p":"0.21"}})"));
+
+            REQUIRE(trades.size() == 2);
+            CHECK(trades.at(0).at("a") == 12);
+            CHECK(trades.at(1).at("p") == "0.21");
+            REQUIRE(tickers.size() == 1);
+            CHECK(tickers.at(0).at("u") == 400);
+        }
+
+        THEN("Messages for unknown streams and request responses are not dispatched.")
+        {
+            router.route(Json::parse(R"({"stream":"btcusdt@aggTrade","data":{"a":1}})"));
+            router.route(Json::parse(R"({"result":null,"id":1})"));
+
+            CHECK(trades.empty());
+            CHECK(tickers.empty());
+        }
+
+        WHEN("A stream is removed and another one added.")
+        {
+            std::vector<Json> others;
+            router.remove("dogeusdt@bookTicker");
+            router.add("btcusdt@aggTrade", [&others](Json aMessage){ others.push_back(std::move(aMessage)); });
+
+            router.route(Json::parse(R"({"stream":"dogeusdt@bookTicker","data":{"u":401}})"));
+            router.route(Json::parse(R"({"stream":"btcusdt@aggTrade","data":{"a":2}})"));
+
+            THEN("Dispatching follows the new handlers.")
+            {
+                CHECK(tickers.empty());
+                REQUIRE(others.size() == 1);
+                CHECK(router.listStreams() == std::vector<std::string>{"btcusdt@aggTrade", "dogeusdt@aggTrade"});
+            }
+        }
+
+        THEN("Live requests are numbered consecutively.")
+        {
+            Json first = Json::parse(router.makeRequest("SUBSCRIBE", {"btcusdt@aggTrade"}));
+            Json second = Json::parse(router.makeRequest("UNSUBSCRIBE", {"btcusdt@aggTrade"}));
+
+            CHECK(first.at("method") == "SUBSCRIBE");
+            CHECK(first.at("params") == Json::array({"btcusdt@aggTrade"}));
+            CHECK(second.at("id").get<long>() == first.at("id").get<long>() + 1);
+        }
+    }
+}
+
+
+SCENARIO("Market stream sequence extraction.", "[stream]")
+{
+    GIVEN("Raw market stream messages.")
+    {
+        auto aggTrade = Json::parse(R"({"e":"aggTrade","E":123,"s":"DOGEUSDT","a":26129,"p":"0.1","f":100,"l":105})");
+        auto bookTicker = Json::parse(R"({"u":400900217,"s":"DOGEUSDT","b":"0.1","B":"31","a":"0.2","A":"40"})");
+        auto unsequenced = Json::parse(R"({"result":null,"id":1})");
+
+        THEN("The sequence id is extracted on a single channel.")
+        {
+            auto tradeSequence = RollingStream::marketStreamSequence(aggTrade);
+            REQUIRE(tradeSequence);
+            CHECK(tradeSequence->channel == "");
+            CHECK(tradeSequence->id == 26129);
+
+            auto bookSequence = RollingStream::marketStreamSequence(bookTicker);
+            REQUIRE(bookSequence);
+            CHECK(bookSequence->id == 400900217);
+
+            CHECK_FALSE(RollingStream::marketStreamSequence(unsequenced));
+        }
+    }
+
+    GIVEN("A combined market stream message.")
+    {
+        auto message = Json::parse(R"({"stream":"dogeusdt@aggTrade","data":{"e":"aggTrade","a":12,"f":1,"l":1}})");
+
+        THEN("The channel is the stream name.")
+        {
+            auto sequence = RollingStream::marketStreamSequence(message);
+            REQUIRE(sequence);
+            CHECK(sequence->channel == "dogeusdt@aggTrade");
+            CHECK(sequence->id == 12);
+        }
+    }
+}
+
+
+SCENARIO("Switch over between stream connections.", "[stream]")
+{
+    auto message = [](long long aId)
+    {
+        return Json{{"a", aId}};
+    };
+    auto ids = [](const std::vector<Json> & aMessages)
+    {
+        std::vector<long long> result;
+        for (const Json & message : aMessages)
+        {
+            result.push_back(message.at("a").get<long long>());
+        }
+        return result;
+    };
+
+    GIVEN("An active connection which delivered messages up to 10.")
+    {
+        SwitchoverSequencer sequencer;
+        for (long long id = 1; id <= 10; ++id)
+        {
+            REQUIRE(sequencer.receiveActive({"", id}));
+        }
+
+        WHEN("The replacement is ahead of the active connection.")
+        {
+            sequencer.receiveReplacement(message(14), {"", 14});
+            sequencer.receiveReplacement(message(15), {"", 15});
+
+            THEN("The lagging active connection keeps delivering until it reaches the replacement.")
+            {
+                CHECK_FALSE(sequencer.isOverlapping());
+                for (long long id = 11; id <= 13; ++id)
+                {
+                    CHECK(sequencer.receiveActive({"", id}));
+                    CHECK_FALSE(sequencer.isOverlapping());
+                }
+                CHECK(sequencer.receiveActive({"", 14}));
+                CHECK(sequencer.isOverlapping());
+
+                // Only the held back messages not delivered by the active connection are released.
+                CHECK(ids(sequencer.switchOver()) == std::vector<long long>{15});
+                CHECK(sequencer.receiveActive({"", 16}));
+                CHECK_FALSE(sequencer.receiveActive({"", 15}));
+            }
+        }
+
+        WHEN("The replacement is behind the active connection.")
+        {
+            sequencer.receiveReplacement(message(9), {"", 9});
+            sequencer.receiveReplacement(message(10), {"", 10});
+            sequencer.receiveReplacement(message(11), {"", 11});
+
+            THEN("It overlaps immediately, and releases the messages the active connection did not deliver.")
+            {
+                CHECK(sequencer.isOverlapping());
+                CHECK(ids(sequencer.switchOver()) == std::vector<long long>{11});
+            }
+        }
+
+        WHEN("The replacement received a channel the active connection did not deliver.")
+        {
+            sequencer.receiveReplacement(message(5), {"", 5});
+            sequencer.receiveReplacement(message(100), {"other", 100});
+
+            THEN("It does not overlap.")
+            {
+                CHECK_FALSE(sequencer.isOverlapping());
+            }
+        }
+
+        WHEN("The replacement is abandoned.")
+        {
+            sequencer.receiveReplacement(message(20), {"", 20});
+            sequencer.resetReplacement();
+
+            THEN("Its held back messages are discarded.")
+            {
+                CHECK_FALSE(sequencer.isOverlapping());
+                CHECK(sequencer.switchOver().empty());
+            }
+        }
+    }
+}
+
+
+SCENARIO("Refresh timers on a shared executor.", "[stream]")
+{
+    GIVEN("An executor with two threads.")
+    {
+        ThreadPool executor{2};
+        REQUIRE(executor.size() == 2);
+
+        WHEN("Several refresh timers run on it.")
+        {
+            std::atomic<int> firstCount{0};
+            std::atomic<int> secondCount{0};
+            {
+                RefreshTimer first{[&firstCount](){ ++firstCount; }, std::chrono::milliseconds{5}, &executor};
+                RefreshTimer second{[&secondCount](){ ++secondCount; }, std::chrono::milliseconds{5}, &executor};
+                second.trigger();
+                std::this_thread::sleep_for(std::chrono::milliseconds{60});
+            }
+
+            THEN("Their operations are invoked, and they stop on destruction.")
+            {
+                int firstStopped = firstCount;
+                CHECK(firstStopped > 1);
+                CHECK(secondCount > 1);
+
+                std::this_thread::sleep_for(std::chrono::milliseconds{20});
+                CHECK(firstCount == firstStopped);
+            }
+        }
+    }
+}
+
+
+SCENARIO("Stream failing to connect.", "[stream]")
+{
+    // Nothing is expected to listen on this port.
+    WebsocketDestination unreachable{"127.0.0.1", "1", "/ws"};
+
+    GIVEN("A stream running on a shared executor.")
+    {
+        ThreadPool executor{1};
+        std::atomic<int> closeCount{0};
+
+        {
+            Stream stream{unreachable,
+                          [](Json){},
+                          [&closeCount](){ ++closeCount; },
+                          nullptr,
+                          &executor};
+
+            THEN("The connection fails, which is reported as an unintended close.")
+            {
+                CHECK_FALSE(stream.waitConnection());
+                CHECK(stream.isDone());
+                CHECK(closeCount == 1);
+            }
+        }
+    }
+
+    GIVEN("A stream running its own thread.")
+    {
+        std::atomic<int> closeCount{0};
+
+        {
+            Stream stream{unreachable,
+                          [](Json){},
+                          [&closeCount](){ ++closeCount; }};
+
+            THEN("The connection fails, which is reported as an unintended close.")
+            {
+                CHECK_FALSE(stream.waitConnection());
+                CHECK(closeCount == 1);
+            }
+        }
+    }
+}
@@ -8,7 +8,11 @@
 
 #include <tradebot/Trader.h>
 
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
+#include <mutex>
+#include <set>
 #include <thread>
 
 
@@ -770,3 +774,172 @@ SCENARIO("Symbol filters", "[trader]")
         }
     }
 }
+
+
+namespace {
+
+
+    /// \brief Fills limit FOK orders at their limit price, after expiring the first attempt of each order.
+    ///
+    /// Thread safe, so it can be used by concurrent dispatch.
+    class ExpireOnceSimulator : public OrderSimulator
+    {
+    public:
+        std::optional<FulfilledOrder> fillLimitFokOrder(Order & aOrder, Decimal aLimitPrice) override
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            aOrder.exchangeId = nextExchangeId++;
+            if (attempted.insert(aOrder.id).second)
+            {
+                return {};
+            }
+
+            const Decimal quoteAmount = aOrder.baseAmount * aLimitPrice;
+            const MillisecondsSinceEpoch time = getTimestamp();
+            Json status{
+                {"status", "FILLED"},
+                {"executedQty", to_str(aOrder.baseAmount)},
+                {"price", to_str(aLimitPrice)},
+                {"transactTime", time},
+            };
+            return fulfill(aOrder, status, Fulfillment{aOrder.baseAmount, quoteAmount, 0, aOrder.quote, time, 1});
+        }
+
+        std::mutex mutex;
+        std::set<decltype(Order::id)> attempted;
+        long nextExchangeId{1};
+    };
+
+
+} // anonymous namespace
+
+
+SCENARIO("Fill profitable orders concurrently.", "[trader]")
+{
+    const Pair pair{"DOGE", "BUSD"};
+
+    GIVEN("A trader dispatching its orders on 4 threads, with a simulated exchange and an order rate limit.")
+    {
+        Trader trader{
+            "tradertest",
+            pair,
+            Database{":memory:"},
+            Exchange{binance::Api{Json{
+                {"server", "test"},
+                {"apikey", ""},
+                {"secretkey", ""},
+            }}},
+        };
+        trader.exchange.simulator = std::make_unique<ExpireOnceSimulator>();
+        trader.orderDispatcher = std::make_unique<ThreadPool>(4);
+
+        // The clock does not advance, so only the burst is allowed without waiting.
+        std::mutex waitsMutex;
+        std::vector<double> waits;
+        trader.orderRateLimiter = std::make_shared<RateLimiter>(
+            20.,
+            5.,
+            []() { return RateLimiter::Clock::time_point{}; },
+            [&](std::chrono::duration<double> aWait)
+            {
+                std::lock_guard<std::mutex> lock{waitsMutex};
+                waits.push_back(aWait.count());
+            });
+
+        auto & db = trader.database;
+
+        WHEN("There are profitable fragments at 8 sell rates and 2 buy rates.")
+        {
+            for (int rate = 0; rate != 8; ++rate)
+            {
+                db.insert(Fragment{pair.base, pair.quote, 10, Decimal{"1"} + Decimal{rate} / 10, Side::Sell});
+            }
+            db.insert(Fragment{pair.base, pair.quote, 10, 3, Side::Buy});
+            db.insert(Fragment{pair.base, pair.quote, 10, 4, Side::Buy});
+
+            auto [sellCount, buyCount] = trader.makeAndFillProfitableOrders({2, 2}, SymbolFilters{});
+
+            THEN("All the orders are filled and recorded, each after an expired attempt.")
+            {
+                REQUIRE(sellCount == 8);
+                REQUIRE(buyCount == 2);
+                REQUIRE(db.selectOrders(pair, Order::Status::Fulfilled).size() == 10);
+                REQUIRE(db.selectOrders(pair, Order::Status::Sending).empty());
+                REQUIRE(db.getUnassociatedFragments(Side::Sell, pair).empty());
+                REQUIRE(db.getUnassociatedFragments(Side::Buy, pair).empty());
+                REQUIRE(trader.fokCounters->placed == 20);
+                REQUIRE(trader.fokCounters->expired == 10);
+                REQUIRE(trader.fokCounters->filled == 10);
+            }
+
+            THEN("The orders were sent within the rate limit.")
+            {
+                // After the burst of 5, each of the 15 other orders waits for its own token, at 20 per second.
+                REQUIRE(trader.fokCounters->throttled == 15);
+                std::lock_guard<std::mutex> lock{waitsMutex};
+                REQUIRE(waits.size() == 15);
+                std::sort(waits.begin(), waits.end());
+                for (std::size_t wait = 0; wait != waits.size(); ++wait)
+                {
+                    REQUIRE(waits[wait] == Approx((wait + 1) / 20.));
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Complete orders while the deferred writes are committed.", "[trader]")
+{
+    const Pair pair{"DOGE", "BUSD"};
+
+    GIVEN("A trader on a database file, with a writer.")
+    {
+        const std::string path =
+            (std::filesystem::temp_directory_path() / "tradebot-trader-writer-tests.sqlite").string();
+        for (const std::string suffix : {"", "-wal", "-shm"})
+        {
+            std::filesystem::remove(path + suffix);
+        }
+
+        Trader trader{
+            "tradertest",
+            pair,
+            Database{path},
+            Exchange{binance::Api{Json{
+                {"server", "test"},
+                {"apikey", ""},
+                {"secretkey", ""},
+            }}},
+        };
+        auto & db = trader.database;
+        db.startWriter();
+
+        WHEN("Each order is completed just after queuing deferred writes.")
+        {
+            const int orderCount = 50;
+            const int balancesPerOrder = 20;
+            for (int orderId = 0; orderId != orderCount; ++orderId)
+            {
+                auto [order, fragments] =
+                    makeOrderWithFragments(db, trader.name, pair, {Decimal{"10"}}, Decimal{"2"}, Side::Sell);
+
+                for (int balanceId = 0; balanceId != balancesPerOrder; ++balanceId)
+                {
+                    stats::Balance balance;
+                    balance.time = getTimestamp();
+                    db.insertDeferred(balance);
+                }
+                // The writer commits the batch while the completion reads, then writes.
+                REQUIRE(trader.completeFulfilledOrder(mockupFulfill(order, Decimal{"2"})));
+            }
+            db.flush();
+
+            THEN("All the orders and all the deferred writes are committed.")
+            {
+                REQUIRE(db.selectOrders(pair, Order::Status::Fulfilled).size() == orderCount);
+                REQUIRE(db.countBalances() == orderCount * balancesPerOrder);
+            }
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #include "catch.hpp"
 
+#include <websocket/MessageRing.h>
 #include <websocket/WebSocket.h>
 
 #include <thread>
@@ -31,3 +32,119 @@ SCENARIO("Websocket simple communication", "[.]")
         }
     }
 }
+
+
+SCENARIO("Outbound message ring.", "[websocket]")
+{
+    GIVEN("A message ring.")
+    {
+        ad::net::MessageRing ring{3, 64};
+        REQUIRE(ring.capacity() == 4);
+        REQUIRE(ring.front() == nullptr);
+
+        THEN("Messages are consumed in order, until the ring is full.")
+        {
+            CHECK(ring.push("first"));
+            CHECK(ring.push("second"));
+            CHECK(ring.push("third"));
+            CHECK(ring.push("fourth"));
+            CHECK_FALSE(ring.push("overflow"));
+
+            REQUIRE(ring.front() != nullptr);
+            CHECK(*ring.front() == "first");
+            ring.pop();
+            CHECK(*ring.front() == "second");
+
+            // A slot was released
+            CHECK(ring.push("fifth"));
+
+            std::vector<std::string> remaining;
+            while (const std::string * message = ring.front())
+            {
+                remaining.push_back(*message);
+                ring.pop();
+            }
+            CHECK(remaining == std::vector<std::string>{"second", "third", "fourth", "fifth"});
+        }
+    }
+
+    GIVEN("Several producer threads.")
+    {
+        constexpr int producerCount = 4;
+        constexpr int messagesPerProducer = 5000;
+        ad::net::MessageRing ring{64, 16};
+
+        std::vector<std::thread> producers;
+        for (int producer = 0; producer != producerCount; ++producer)
+        {
+            producers.emplace_back([&ring, producer]()
+                {
+                    for (int index = 0; index != messagesPerProducer; ++index)
+                    {
+                        std::string message = std::to_string(producer) + ":" + std::to_string(index);
+                        while (! ring.push(message))
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+                });
+        }
+
+        THEN("The single consumer receives each message once, in order for each producer.")
+        {
+            std::vector<int> nextIndex(producerCount, 0);
+            int received = 0;
+            bool ordered = true;
+            while (received != producerCount * messagesPerProducer)
+            {
+                if (const std::string * message = ring.front())
+                {
+                    auto separator = message->find(':');
+                    int producer = std::stoi(message->substr(0, separator));
+                    int index = std::stoi(message->substr(separator + 1));
+                    ordered = ordered && (index == nextIndex[producer]++);
+                    ring.pop();
+                    ++received;
+                }
+            }
+
+            for (std::thread & producer : producers)
+            {
+                producer.join();
+            }
+
+            CHECK(ordered);
+            CHECK(ring.front() == nullptr);
+        }
+    }
+}
+
+
+SCENARIO("Websocket compression settings.", "[websocket]")
+{
+    GIVEN("A websocket which never ran.")
+    {
+        ad::net::WebSocket ws;
+
+        THEN("Its statistics are empty.")
+        {
+            ad::net::WebSocket::Statistics statistics = ws.getStatistics();
+            CHECK(statistics.messagesReceived == 0);
+            CHECK(statistics.wireBytesReceived == 0);
+            CHECK(statistics.wireBytesSent == 0);
+        }
+
+        THEN("Valid compression settings are accepted.")
+        {
+            CHECK_NOTHROW(ws.setCompression({true, 9, 1, 0, true}));
+            CHECK_NOTHROW(ws.setCompression({true, 15, 9, 9, false}));
+        }
+
+        THEN("Out of range compression settings are rejected.")
+        {
+            CHECK_THROWS_AS(ws.setCompression({true, 8, 4, 8, false}), std::invalid_argument);
+            CHECK_THROWS_AS(ws.setCompression({true, 15, 0, 8, false}), std::invalid_argument);
+            CHECK_THROWS_AS(ws.setCompression({true, 15, 4, 10, false}), std::invalid_argument);
+        }
+    }
+}
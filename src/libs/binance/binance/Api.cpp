@@ -263,6 +263,28 @@ Response Api::placeOrderTrade(const LimitOrder & aOrder)
 }
 
 
+Response Api::placeOrderTrade(const TemplatedOrder & aOrder)
+{
+    static const std::string endpoint{"/api/v3/order"};
+
+    // Same parameters as makeRequest() would sign and send, appended to the pre-serialised template.
+    std::string query;
+    query.reserve(aOrder.orderTemplate.getQuery().size() + 192);
+    query.append(aOrder.orderTemplate.getQuery())
+        .append("&").append(aOrder.orderTemplate.getQuantityKey()).append("=").append(to_str(aOrder.quantity))
+        .append("&newClientOrderId=").append(cpr::util::urlEncode(static_cast<const std::string &>(aOrder.clientId)))
+        .append("&timestamp=").append(std::to_string(getTimestamp()))
+        .append("&recvWindow=").append(std::to_string(mReceiveWindow.count()));
+    query.append("&signature=")
+        .append(crypto::encodeHexadecimal(crypto::hashMacSha256(mSecretKey, query)));
+
+    cpr::Session session;
+    session.SetUrl(cpr::Url{mEndpoints.restUrl + endpoint + '?' + query});
+    session.SetHeader({{"X-MBX-APIKEY", mApiKey}});
+    return completeRequest("POST", endpoint, session.Post());
+}
+
+
 Response Api::listOpenOrders(const Symbol & aSymbol)
 {
     return makeRequest(Verb::Get, {"/api/v3/openOrders"}, Security::Signed,
@@ -367,7 +389,35 @@ const Endpoints & Api::getEndpoints()
 Response Api::makeRequest(const std::string & aEndpoint)
 {
     cpr::Response response = cpr::Get(cpr::Url{mEndpoints.restUrl} + cpr::Url{aEndpoint});
-    return analyzeResponse("GET", response);
+    return completeRequest("GET", aEndpoint, response);
+}
+
+
+Response Api::completeRequest(const std::string & aVerb,
+                              const std::string & aEndpoint,
+                              const cpr::Response & aResponse)
+{
+    // elapsed is the total transfer time measured by curl, in seconds.
+    mMetrics->latencies.get(aVerb + ' ' + aEndpoint)
+        .record(static_cast<std::uint64_t>(aResponse.elapsed * 1e6));
+    if (auto found = aResponse.header.find("x-mbx-used-weight-1m");
+        found != aResponse.header.end())
+    {
+        try
+        {
+            mMetrics->usedWeight.store(std::stol(found->second), std::memory_order_relaxed);
+        }
+        catch (const std::logic_error &)
+        {
+            spdlog::warn("Cannot parse used weight header value '{}'.", found->second);
+        }
+    }
+    if (aResponse.status_code != 200)
+    {
+        mMetrics->errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return analyzeResponse(aVerb, aResponse);
 }
 
 
@@ -400,13 +450,13 @@ Response Api::makeRequest(Verb aVerb,
     switch (aVerb)
     {
         case Verb::Delete:
-            return analyzeResponse("DELETE", session.Delete());
+            return completeRequest("DELETE", aEndpoint, session.Delete());
         case Verb::Get:
-            return analyzeResponse("GET", session.Get());
+            return completeRequest("GET", aEndpoint, session.Get());
         case Verb::Post:
-            return analyzeResponse("POST", session.Post());
+            return completeRequest("POST", aEndpoint, session.Post());
         case Verb::Put:
-            return analyzeResponse("PUT", session.Post());
+            return completeRequest("PUT", aEndpoint, session.Post());
         default:
             spdlog::critical("Unhandled HTTP verb, enum value '{}'.", aVerb);
             throw std::domain_error{"Unhandled HTTP verb value."};
@@ -4,13 +4,22 @@
 #include "Json.h"
 #include "Time.h"
 
+#include <trademath/Histogram.h>
+
 #include <websocket/WebSocket.h>
 
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <optional>
 #include <string>
 
 
+namespace cpr {
+    class Response;
+} // namespace cpr
+
+
 namespace ad {
 namespace binance {
 
@@ -37,6 +46,18 @@ struct Response
 class Api
 {
 public:
+    /// \brief Metrics of the REST requests, safe to read from any thread.
+    struct Metrics
+    {
+        /// \brief Request latency in microseconds, labelled by "VERB /endpoint".
+        trade::HistogramFamily latencies;
+        /// \brief Request weight used in the current minute, as reported by the exchange.
+        /// (`-1` until a response reports it.)
+        std::atomic<long> usedWeight{-1};
+        /// \brief Count of responses with status other than 200.
+        std::atomic<std::uint64_t> errors{0};
+    };
+
     /// \brief Tag to make a request without "body"
     /// \note The body content is currently sent as request parameters
     struct NoBody{};
@@ -65,6 +86,8 @@ public:
 
     Response placeOrderTrade(const MarketOrder & aOrder);
     Response placeOrderTrade(const LimitOrder & aOrder);
+    /// \brief Only serialises the quantity and client id, the other parameters come from the template.
+    Response placeOrderTrade(const TemplatedOrder & aOrder);
 
     Response listOpenOrders(const Symbol & aSymbol);
 
@@ -91,6 +114,9 @@ public:
 
     const Endpoints & getEndpoints();
 
+    const Metrics & getMetrics() const
+    { return *mMetrics; }
+
     static const Endpoints gProduction;
     static const Endpoints gTestNet;
 
@@ -105,6 +131,11 @@ private:
 
     Response makeRequest(const std::string & aEndpoint);
 
+    /// \brief Record the metrics of a response, then analyze it.
+    Response completeRequest(const std::string & aVerb,
+                             const std::string & aEndpoint,
+                             const cpr::Response & aResponse);
+
     /// \brief Used to configure the request
     enum class Security
     {
@@ -124,6 +155,9 @@ private:
     ApiKey mApiKey;
     SecretKey mSecretKey;
     std::chrono::milliseconds mReceiveWindow{3000};
+    // Shared by copies of the Api (e.g. the copy refreshing the listen key),
+    // so all the requests made with the same credentials are accounted together.
+    std::shared_ptr<Metrics> mMetrics{std::make_shared<Metrics>()};
 };
 
 
@@ -0,0 +1,26 @@
+#include "Orders.h"
+
+#include "detail/OrdersHelpers.h"
+
+
+namespace ad {
+namespace binance {
+
+
+OrderTemplate::OrderTemplate(const LimitOrder & aOrder) :
+    mQuantityKey{detail::getQuantityKey(aOrder)}
+{
+    cpr::Parameters parameters{
+        {"symbol", aOrder.symbol},
+        {"side", to_string(aOrder.side)},
+        {"price", to_str(aOrder.price)},
+        {"timeInForce", to_string(aOrder.timeInForce)},
+        {"type", to_string(aOrder.type)},
+    };
+    // Encoded the same way as the parameters signed by the Api.
+    mQuery = parameters.GetContent(cpr::CurlHolder{});
+}
+
+
+} // namespace binance
+} // namespace ad
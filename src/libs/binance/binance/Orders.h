@@ -179,5 +179,36 @@ struct LimitOrder : public OrderBase
     const Type type{Type::LIMIT};
 };
 
+
+/// \brief The parameters of a limit order that do not depend on its quantity nor client id
+/// (symbol, side, price, time in force and type), pre-serialised as an url-encoded query.
+///
+/// Allows to serialise these parameters ahead of time, e.g. for each stop of a ladder.
+class OrderTemplate
+{
+public:
+    /// \brief Serialises all the parameters of `aOrder`, except for its quantity and client id.
+    explicit OrderTemplate(const LimitOrder & aOrder);
+
+    const std::string & getQuery() const
+    { return mQuery; }
+
+    const char * getQuantityKey() const
+    { return mQuantityKey; }
+
+private:
+    std::string mQuery;
+    const char * mQuantityKey;
+};
+
+
+/// \brief An order instantiated from an `OrderTemplate`.
+struct TemplatedOrder
+{
+    const OrderTemplate & orderTemplate;
+    Decimal quantity;
+    ClientId clientId;
+};
+
 } // namespace binance
 } // namespace ad
@@ -0,0 +1,230 @@
+#include "Configuration.h"
+
+#include "Logging.h"
+
+#include "spawners/StableDownSpread.h"
+
+#include <trademath/DecimalLog.h>
+#include <trademath/Function.h>
+#include <trademath/Spawn.h>
+#include <trademath/Spreaders.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace ad {
+namespace tradebot {
+
+
+trade::Ladder makeLadder(const Json & aLadderConfig)
+{
+    return trade::makeLadder(
+        Decimal{aLadderConfig.at("firstStop").get<std::string>()},
+        Decimal{aLadderConfig.at("factor").get<std::string>()},
+        std::stoi(aLadderConfig.at("stopCount").get<std::string>()),
+        Decimal{aLadderConfig.contains("priceTickSize") ?
+                    aLadderConfig.at("priceTickSize").get<std::string>()
+                    : aLadderConfig.at("exchangeTickSize").get<std::string>()},
+        Decimal{aLadderConfig.value("internalTickSize", "0")},
+        Decimal{aLadderConfig.at("priceOffset").get<std::string>()});
+}
+
+
+std::unique_ptr<SpawnerBase> makeStableDownSpread(const Json & aSpawnerConfig,
+                                                  const trade::Ladder & aLadder,
+                                                  Decimal aAmountTickSize)
+{
+    auto toDecimals = [](const Json & aProportions)
+    {
+        std::vector<Decimal> result;
+        std::transform(aProportions.begin(),
+                       aProportions.end(),
+                       std::back_inserter(result),
+                       [](const std::string & aValue){ return Decimal{aValue}; });
+        return result;
+    };
+
+    trade::ProportionsMap proportionsMap;
+    const Json & proportions = aSpawnerConfig.at("spreader").at("proportions");
+    if (proportions.is_array())
+    {
+        proportionsMap.push_back({std::numeric_limits<Decimal>::max(), toDecimals(proportions)});
+    }
+    else
+    {
+        Decimal previousMaxRate{0};
+        // Copy the values read from the spawnerConfig["spreader"]["proporitions"] in `proportions`.
+        for(auto & ratedProportions : proportions.items())
+        {
+            Decimal maxRate = Decimal{ratedProportions.key()};
+            if(maxRate <= previousMaxRate)
+            {
+                spdlog::critical("Proportion for rate limit {} coming after rate limit {}.", maxRate, previousMaxRate);
+                throw std::invalid_argument{"Proportions rate must be strictly increasing."};
+            }
+            previousMaxRate = maxRate;
+            proportionsMap.push_back({maxRate, toDecimals(ratedProportions.value())});
+        }
+    }
+
+    return std::make_unique<spawner::StableDownSpread<trade::ProportionSpreader>>(
+        trade::ProportionSpreader{
+            aLadder,
+            proportionsMap,
+            aAmountTickSize,
+        },
+        Decimal{aSpawnerConfig.at("takeHomeFactorInitialSell").get<std::string>()},
+        Decimal{aSpawnerConfig.at("takeHomeFactorSubsequentSell").get<std::string>()},
+        Decimal{aSpawnerConfig.at("takeHomeFactorSubsequentBuy").get<std::string>()}
+    );
+}
+
+
+DatabaseOptions makeDatabaseOptions(const Json & aDatabaseConfig)
+{
+    DatabaseOptions options = makeDatabaseProfile(aDatabaseConfig.value("profile", "default"));
+
+    options.persistentConnection = aDatabaseConfig.value("persistentConnection", options.persistentConnection);
+    if (aDatabaseConfig.contains("mmapSize"))
+    {
+        options.mmapSize = aDatabaseConfig.at("mmapSize").get<std::int64_t>();
+    }
+    if (aDatabaseConfig.contains("cacheSize"))
+    {
+        options.cacheSize = aDatabaseConfig.at("cacheSize").get<std::int64_t>();
+    }
+    if (aDatabaseConfig.contains("synchronous"))
+    {
+        const std::string synchronous = aDatabaseConfig.at("synchronous").get<std::string>();
+        if (synchronous == "off")
+        {
+            options.synchronous = DatabaseOptions::Synchronous::Off;
+        }
+        else if (synchronous == "normal")
+        {
+            options.synchronous = DatabaseOptions::Synchronous::Normal;
+        }
+        else if (synchronous == "full")
+        {
+            options.synchronous = DatabaseOptions::Synchronous::Full;
+        }
+        else
+        {
+            spdlog::critical("Unknown database synchronous mode '{}'.", synchronous);
+            throw std::invalid_argument{"Unknown database synchronous mode."};
+        }
+    }
+    if (aDatabaseConfig.contains("tempStore"))
+    {
+        const std::string tempStore = aDatabaseConfig.at("tempStore").get<std::string>();
+        if (tempStore == "default")
+        {
+            options.tempStore = DatabaseOptions::TempStore::Default;
+        }
+        else if (tempStore == "file")
+        {
+            options.tempStore = DatabaseOptions::TempStore::File;
+        }
+        else if (tempStore == "memory")
+        {
+            options.tempStore = DatabaseOptions::TempStore::Memory;
+        }
+        else
+        {
+            spdlog::critical("Unknown database temp store '{}'.", tempStore);
+            throw std::invalid_argument{"Unknown database temp store."};
+        }
+    }
+    if (aDatabaseConfig.contains("busyTimeoutMilliseconds"))
+    {
+        options.busyTimeout =
+            std::chrono::milliseconds{aDatabaseConfig.at("busyTimeoutMilliseconds").get<long>()};
+    }
+    if (aDatabaseConfig.contains("checkpointPeriodMilliseconds"))
+    {
+        // Zero restores the automatic checkpoints on commit.
+        const long period = aDatabaseConfig.at("checkpointPeriodMilliseconds").get<long>();
+        options.checkpointPeriod =
+            period > 0 ? std::make_optional(std::chrono::milliseconds{period}) : std::nullopt;
+    }
+    return options;
+}
+
+
+std::vector<Fragment> makeInitialFragments(const Json & aConfig,
+                                           const trade::Ladder & aLadder,
+                                           const Pair & aPair,
+                                           const SymbolFilters & aFilters)
+{
+    Decimal amount{aConfig.at("amount").get<std::string>()};
+    std::size_t spawnBeginOffset{aConfig.at("initial").at("spawnBeginOffset")};
+    std::size_t spawnEndOffset{aConfig.at("initial").at("spawnEndOffset")};
+
+    trade::Function initialDistribution{
+        [](Decimal aValue) -> Decimal
+        {
+            return log(aValue);
+        }
+    };
+
+    auto spawnBegin = aLadder.begin() + spawnBeginOffset;
+    auto spawnEnd = aLadder.end() - spawnEndOffset;
+
+    Decimal integral = initialDistribution.integrate(*spawnBegin, *(spawnEnd-1));
+    Decimal ratio = amount/integral; // Not rounded to 8 digits, to give more precision over the spawn integration
+    spdlog::debug("Integration produces {}, target is {}, so the factor is {}.",
+                 integral,
+                 amount,
+                 ratio);
+
+    auto [spawns, spawnedAmount] =
+        trade::spawnIntegration(trade::Base{ratio}, spawnBegin, spawnEnd, initialDistribution);
+
+    if (! isEqual(spawnedAmount, amount))
+    {
+        spdlog::critical("Spawned amount {} is different from requested amount {}.",
+                to_str(spawnedAmount),
+                to_str(amount));
+        throw std::logic_error{"Initial spawned amount does not match the configured amount."};
+    }
+
+    std::vector<Fragment> fragments;
+    Decimal remainder{0};
+    for (const auto & spawn : spawns)
+    {
+        // Carry-on the remainder from previous amount insertion
+        Decimal baseAmount;
+        std::tie(baseAmount, remainder) =
+            trade::computeTickFilter(spawn.base + remainder, aFilters.amount.tickSize);
+
+        if (! testAmount(aFilters, baseAmount, spawn.rate))
+        {
+            spdlog::warn("Spawned fragment for {} {} at rate {} does not pass amount filters.",
+                         baseAmount,
+                         aPair.base,
+                         spawn.rate);
+        }
+
+        if (! testPrice(aFilters, spawn.rate))
+        {
+            spdlog::warn("Spawned fragment for {} {} at rate {} does not pass price filters.",
+                         baseAmount,
+                         aPair.base,
+                         spawn.rate);
+        }
+
+        fragments.push_back(Fragment{
+            aPair.base,
+            aPair.quote,
+            baseAmount,
+            spawn.rate,
+            Side::Sell,
+        });
+    }
+    return fragments;
+}
+
+
+} // namespace tradebot
+} // namespace ad
@@ -0,0 +1,59 @@
+#pragma once
+
+
+#include "Database.h"
+#include "Fragment.h"
+#include "Order.h"
+#include "Spawner.h"
+#include "SymbolFilters.h"
+
+#include <binance/Json.h>
+
+#include <trademath/Ladder.h>
+
+#include <memory>
+#include <vector>
+
+
+namespace ad {
+namespace tradebot {
+
+
+// Assemble the trading components from the sections of a bot configuration file
+// (see configs/ folder), so the bot and the tools share the same interpretation.
+
+
+/// \brief Make the ladder from a "ladder" configuration section.
+///
+/// The effective price tick size is read from "priceTickSize", or "exchangeTickSize" as a fallback.
+trade::Ladder makeLadder(const Json & aLadderConfig);
+
+
+/// \brief Make a `StableDownSpread` with a `ProportionSpreader` from a "spawner" configuration section.
+///
+/// The "spreader.proportions" are either an object mapping strictly increasing max rates to proportions,
+/// or directly an array of proportions applying to all rates.
+std::unique_ptr<SpawnerBase> makeStableDownSpread(const Json & aSpawnerConfig,
+                                                  const trade::Ladder & aLadder,
+                                                  Decimal aAmountTickSize);
+
+
+/// \brief Make the database options from a "database" configuration section.
+///
+/// Starts from the named "profile" (see `makeDatabaseProfile()`, "default" if absent),
+/// then overrides it with the individual keys present in the section.
+DatabaseOptions makeDatabaseOptions(const Json & aDatabaseConfig);
+
+
+/// \brief Spawn the initial `Sell` fragments for the configuration "amount" on the ladder stops,
+/// between the offsets of the "initial" configuration section.
+///
+/// \throw std::logic_error if the spawned amount does not match the configured amount.
+std::vector<Fragment> makeInitialFragments(const Json & aConfig,
+                                           const trade::Ladder & aLadder,
+                                           const Pair & aPair,
+                                           const SymbolFilters & aFilters);
+
+
+} // namespace tradebot
+} // namespace ad
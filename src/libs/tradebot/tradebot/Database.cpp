@@ -4,6 +4,14 @@
 
 #include <sqlite_orm/sqlite_orm.h>
 
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
 #include "OrmAdaptors-impl.h"
 
 
@@ -17,6 +25,10 @@ auto initializeStorage(const std::string & aFilename)
     using namespace sqlite_orm;
     return make_storage(
             aFilename,
+            make_unique_index("idx_fragment_totals_pair_side",
+                              &stats::FragmentTotals::base,
+                              &stats::FragmentTotals::quote,
+                              &stats::FragmentTotals::side),
             make_table("Orders",
                        make_column("id", &Order::id, primary_key(), autoincrement()),
 
@@ -61,10 +73,122 @@ auto initializeStorage(const std::string & aFilename)
                        make_column("quote_buy_potential", &stats::Balance::quoteBuyPotential),
                        make_column("base_sell_potential", &stats::Balance::baseSellPotential),
                        make_column("quote_sell_potential", &stats::Balance::quoteSellPotential)
+            ),
+            make_table("FragmentTotals",
+                       make_column("id", &stats::FragmentTotals::id, primary_key(), autoincrement()),
+
+                       make_column("base", &stats::FragmentTotals::base),
+                       make_column("quote", &stats::FragmentTotals::quote),
+                       make_column("side", &stats::FragmentTotals::side),
+                       make_column("unassociated_base", &stats::FragmentTotals::unassociatedBase),
+                       make_column("unassociated_quote", &stats::FragmentTotals::unassociatedQuote),
+                       make_column("unassociated_count", &stats::FragmentTotals::unassociatedCount),
+                       make_column("taken_home", &stats::FragmentTotals::takenHome)
             )
             );
 }
 
+
+bool isInMemory(const std::string & aFilename)
+{
+    return aFilename.empty() || aFilename == ":memory:";
+}
+
+
+/// \brief Make the `on_open` callback applying `aOptions` to each new connection.
+///
+/// Settings made on the storage would only apply to the connection open at the time.
+/// \param aQueryOnly If true, the connections refuse any change to the database file.
+std::function<void(sqlite3 *)> makeOnOpen(const DatabaseOptions & aOptions, bool aQueryOnly)
+{
+    std::string pragmas;
+    if (aOptions.mmapSize)
+    {
+        pragmas += "PRAGMA mmap_size = " + std::to_string(*aOptions.mmapSize) + ";";
+    }
+    if (aOptions.cacheSize)
+    {
+        pragmas += "PRAGMA cache_size = " + std::to_string(*aOptions.cacheSize) + ";";
+    }
+    if (aOptions.synchronous)
+    {
+        pragmas += "PRAGMA synchronous = " + std::to_string(static_cast<int>(*aOptions.synchronous)) + ";";
+    }
+    if (aOptions.tempStore)
+    {
+        pragmas += "PRAGMA temp_store = " + std::to_string(static_cast<int>(*aOptions.tempStore)) + ";";
+    }
+    if (aOptions.checkpointPeriod)
+    {
+        // Checkpoints are made by the Checkpointer.
+        pragmas += "PRAGMA wal_autocheckpoint = 0;";
+    }
+
+    return [pragmas, busyTimeout = aOptions.busyTimeout, aQueryOnly](sqlite3 * aConnection)
+    {
+        sqlite3_busy_timeout(aConnection, static_cast<int>(busyTimeout.count()));
+        if (aQueryOnly
+            && sqlite3_exec(aConnection, "PRAGMA query_only = ON;", nullptr, nullptr, nullptr) != SQLITE_OK)
+        {
+            spdlog::critical("Cannot make the database connection query only: {}.", sqlite3_errmsg(aConnection));
+            throw std::runtime_error{"Cannot make the database connection query only."};
+        }
+        char * error = nullptr;
+        if (! pragmas.empty()
+            && sqlite3_exec(aConnection, pragmas.c_str(), nullptr, nullptr, &error) != SQLITE_OK)
+        {
+            // The pragmas only affect performance, the connection is still usable.
+            spdlog::error("Cannot apply database pragmas '{}': {}.", pragmas, error);
+            sqlite3_free(error);
+        }
+    };
+}
+
+
+/// \brief The contribution of `aFragment` to the totals of its pair and side.
+stats::FragmentTotals getContribution(const Fragment & aFragment)
+{
+    stats::FragmentTotals result{aFragment.base, aFragment.quote, aFragment.side};
+    if (aFragment.composedOrder == -1)
+    {
+        result.unassociatedBase = aFragment.baseAmount;
+        result.unassociatedQuote = aFragment.baseAmount * aFragment.targetRate;
+        result.unassociatedCount = 1;
+    }
+    result.takenHome = aFragment.takenHome;
+    return result;
+}
+
+
+/// \brief The contribution of `aCount` fragments at `aRate` summing to `aBaseAmount`,
+/// negated when the fragments are assigned to an order.
+stats::FragmentTotals getContribution(Side aSide,
+                                      const Pair & aPair,
+                                      Decimal aRate,
+                                      Decimal aBaseAmount,
+                                      long aCount,
+                                      bool aAssigned)
+{
+    const int sign = aAssigned ? -1 : 1;
+    stats::FragmentTotals result{aPair.base, aPair.quote, aSide};
+    result.unassociatedBase = sign * aBaseAmount;
+    result.unassociatedQuote = sign * aBaseAmount * aRate;
+    result.unassociatedCount = sign * aCount;
+    return result;
+}
+
+
+stats::FragmentTotals & accumulate(stats::FragmentTotals & aTotals,
+                                   const stats::FragmentTotals & aDelta,
+                                   int aSign = 1)
+{
+    aTotals.unassociatedBase += aSign * aDelta.unassociatedBase;
+    aTotals.unassociatedQuote += aSign * aDelta.unassociatedQuote;
+    aTotals.unassociatedCount += aSign * aDelta.unassociatedCount;
+    aTotals.takenHome += aSign * aDelta.takenHome;
+    return aTotals;
+}
+
 } // namespace detail
 
 
@@ -73,36 +197,541 @@ struct Database::Impl
 {
     using Storage = decltype(detail::initializeStorage(""));
 
-    Impl(const std::string & aFilename);
+    Impl(const std::string & aFilename, const std::string & aArchiveFilename, DatabaseOptions aOptions);
+
+    struct ReadReplica {};
+    Impl(const std::string & aFilename, DatabaseOptions aOptions, ReadReplica);
+
+    trade::ScopedTimer time(const std::string & aStatement)
+    { return trade::ScopedTimer{statementLatencies.get(aStatement)}; }
+
+    void onFragmentsWrite(Side aSide)
+    { ++(aSide == Side::Sell ? sellGeneration : buyGeneration); }
+
+    /// \brief Begin a transaction, unless one is already open on the storage.
+    ///
+    /// Allows the fragment totals to be written in the same transaction as the fragments,
+    /// whether or not the caller started a transaction.
+    class Transaction
+    {
+    public:
+        explicit Transaction(Impl & aImpl);
+        ~Transaction();
+
+        void commit();
+
+    private:
+        Impl & impl;
+        // Declared before the guard, so it is released after the rollback.
+        std::unique_lock<std::mutex> exclusion;
+        std::optional<decltype(std::declval<Storage &>().transaction_guard())> guard;
+    };
+
+    /// \brief Set the options on the connections of `aStorage`.
+    void configure(Storage & aStorage) const;
+
+    /// \brief Makes passive WAL checkpoints from its own thread and connection, periodically.
+    ///
+    /// Passive checkpoints do not wait for the readers or writers, so they never stall the trading thread.
+    class Checkpointer
+    {
+    public:
+        Checkpointer(const std::string & aFilename, std::chrono::milliseconds aPeriod);
+        ~Checkpointer();
+
+    private:
+        Checkpointer(const Checkpointer &) = delete;
+        Checkpointer & operator = (const Checkpointer &) = delete;
+
+        void run();
+
+        sqlite3 * connection{nullptr};
+        std::chrono::milliseconds period;
+        std::mutex mutex;
+        std::condition_variable stopCondition;
+        bool stopping{false};
+        std::thread thread;
+    };
+
+    /// \brief Applies deferred writes from its own thread and connection,
+    /// committing all the writes pending at once in a single transaction (group commit).
+    class Writer
+    {
+    public:
+        using Write = std::function<void(Storage &)>;
+
+        Writer(const std::string & aFilename, Impl & aImpl);
+        /// \brief Commits the pending writes before returning.
+        ~Writer();
+
+        /// \param aOrderWrite Whether the write is to the orders, see `waitForOrderWrites()`.
+        void push(Write aWrite, bool aOrderWrite);
+
+        /// \brief Block until all the writes pushed so far are committed.
+        void flush();
+
+        /// \brief Block until the writes to the orders pushed so far are committed.
+        void waitForOrderWrites();
+
+    private:
+        Writer(const Writer &) = delete;
+        Writer & operator = (const Writer &) = delete;
+
+        void waitFor(std::size_t aSequence, std::unique_lock<std::mutex> & aLock);
+
+        void run();
+
+        Storage storage;
+        std::mutex & transactionMutex;
+        std::mutex mutex;
+        std::condition_variable pushedCondition;
+        std::condition_variable committedCondition;
+        std::vector<Write> pending;
+        std::size_t pushed{0};
+        std::size_t committed{0};
+        std::size_t lastOrderWrite{0};
+        // Failure of a batch, rethrown by the next call from the database thread.
+        std::exception_ptr error;
+        bool stopping{false};
+        std::thread thread;
+    };
+
+    /// \brief Apply `aWrite` from the writer if it is started, immediately otherwise.
+    void defer(Writer::Write aWrite, bool aOrderWrite);
+
+    /// \brief Ensure deferred writes to the orders are not overtaken by the caller.
+    ///
+    /// Does not wait from within a transaction: it was done when the outermost transaction began.
+    void awaitOrderWrites()
+    {
+        if (writer && openTransactions == 0)
+        {
+            writer->waitForOrderWrites();
+        }
+    }
+
+    /// \brief Add `aDelta` to the totals of its pair and side, which are inserted on first use.
+    void addToTotals(const stats::FragmentTotals & aDelta);
+
+    /// \brief Replace all totals by the values computed from the fragments.
+    void rebuildTotals();
 
     Storage storage;
+    /// \brief Same schema as `storage`, only the orders and fragments tables are used.
+    std::unique_ptr<Storage> archive;
+    trade::HistogramFamily statementLatencies;
+    std::uint64_t sellGeneration{0};
+    std::uint64_t buyGeneration{0};
+    int openTransactions{0};
+    /// \brief Held by the outermost transaction, and by the writer while it commits a batch.
+    ///
+    /// Transactions begin deferred and read before they write: if the writer commits in between,
+    /// the upgrade to a write transaction fails with SQLITE_BUSY without invoking the busy handler.
+    std::mutex transactionMutex;
+    std::string filename;
+    DatabaseOptions options;
+    bool readOnly{false};
+    // Declared last, so they are stopped before the storages are closed.
+    std::unique_ptr<Checkpointer> checkpointer;
+    // The archive connection gets the same options, so its WAL is not checkpointed on commit either.
+    std::unique_ptr<Checkpointer> archiveCheckpointer;
+    std::unique_ptr<Writer> writer;
 };
 
 
-Database::Impl::Impl(const std::string & aFilename) :
-    storage{detail::initializeStorage(aFilename)}
+void Database::Impl::configure(Storage & aStorage) const
+{
+    aStorage.on_open = detail::makeOnOpen(options, readOnly);
+    if (options.persistentConnection)
+    {
+        aStorage.open_forever();
+    }
+}
+
+
+Database::Impl::Checkpointer::Checkpointer(const std::string & aFilename,
+                                           std::chrono::milliseconds aPeriod) :
+    period{aPeriod}
+{
+    if (sqlite3_open_v2(aFilename.c_str(), &connection, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK)
+    {
+        spdlog::critical("Cannot open database '{}' for checkpoints: {}.",
+                         aFilename, sqlite3_errmsg(connection));
+        sqlite3_close(connection);
+        throw std::runtime_error{"Cannot open the checkpoint connection."};
+    }
+    thread = std::thread{&Checkpointer::run, this};
+}
+
+
+Database::Impl::Checkpointer::~Checkpointer()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    stopCondition.notify_one();
+    thread.join();
+    sqlite3_close(connection);
+}
+
+
+void Database::Impl::Checkpointer::run()
 {
-    // Does not seem to add a timeout
-    //storage.busy_timeout(50000);
+    std::unique_lock<std::mutex> lock{mutex};
+    while (! stopCondition.wait_for(lock, period, [this](){ return stopping; }))
+    {
+        lock.unlock();
+        int walFrames = 0;
+        int checkpointedFrames = 0;
+        if (sqlite3_wal_checkpoint_v2(connection, nullptr, SQLITE_CHECKPOINT_PASSIVE,
+                                      &walFrames, &checkpointedFrames) != SQLITE_OK)
+        {
+            spdlog::warn("Database checkpoint failed: {}.", sqlite3_errmsg(connection));
+        }
+        else
+        {
+            spdlog::trace("Database checkpoint, {}/{} WAL frames checkpointed.", checkpointedFrames, walFrames);
+        }
+        lock.lock();
+    }
+}
+
+
+Database::Impl::Writer::Writer(const std::string & aFilename, Impl & aImpl) :
+    storage{detail::initializeStorage(aFilename)},
+    transactionMutex{aImpl.transactionMutex}
+{
+    aImpl.configure(storage);
+    thread = std::thread{&Writer::run, this};
+}
+
+
+Database::Impl::Writer::~Writer()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    pushedCondition.notify_one();
+    thread.join();
+    if (error)
+    {
+        spdlog::error("Deferred database writes failed before the writer stopped.");
+    }
+}
+
+
+void Database::Impl::Writer::push(Write aWrite, bool aOrderWrite)
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (error)
+        {
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+        pending.push_back(std::move(aWrite));
+        if (aOrderWrite)
+        {
+            lastOrderWrite = pushed + 1;
+        }
+        ++pushed;
+    }
+    pushedCondition.notify_one();
+}
+
+
+void Database::Impl::Writer::flush()
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    waitFor(pushed, lock);
+}
+
+
+void Database::Impl::Writer::waitForOrderWrites()
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    waitFor(lastOrderWrite, lock);
+}
+
+
+void Database::Impl::Writer::waitFor(std::size_t aSequence, std::unique_lock<std::mutex> & aLock)
+{
+    committedCondition.wait(aLock, [&](){ return committed >= aSequence; });
+    if (error)
+    {
+        std::rethrow_exception(std::exchange(error, nullptr));
+    }
+}
+
+
+void Database::Impl::Writer::run()
+{
+    std::vector<Write> batch;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            pushedCondition.wait(lock, [this](){ return stopping || ! pending.empty(); });
+            if (pending.empty())
+            {
+                return;
+            }
+            batch.swap(pending);
+        }
+
+        std::exception_ptr batchError;
+        try
+        {
+            std::lock_guard<std::mutex> exclusion{transactionMutex};
+            auto transaction = storage.transaction_guard();
+            for (Write & write : batch)
+            {
+                write(storage);
+            }
+            transaction.commit();
+        }
+        catch (std::exception & aException)
+        {
+            spdlog::critical("Cannot commit {} deferred database writes: {}.", batch.size(), aException.what());
+            batchError = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            committed += batch.size();
+            if (batchError && ! error)
+            {
+                error = batchError;
+            }
+        }
+        committedCondition.notify_all();
+        batch.clear();
+    }
+}
+
+
+void Database::Impl::defer(Writer::Write aWrite, bool aOrderWrite)
+{
+    if (writer)
+    {
+        writer->push(std::move(aWrite), aOrderWrite);
+    }
+    else
+    {
+        aWrite(storage);
+    }
+}
+
+
+Database::Impl::Transaction::Transaction(Impl & aImpl) :
+    impl{aImpl}
+{
+    if (impl.openTransactions == 0)
+    {
+        // Waits for the writer before locking, since it needs the lock to commit.
+        impl.awaitOrderWrites();
+        exclusion = std::unique_lock<std::mutex>{impl.transactionMutex};
+        guard.emplace(impl.storage.transaction_guard());
+    }
+    ++impl.openTransactions;
+}
+
+
+Database::Impl::Transaction::~Transaction()
+{
+    --impl.openTransactions;
+}
+
+
+void Database::Impl::Transaction::commit()
+{
+    // Nested transactions are committed along with the outermost one.
+    if (guard)
+    {
+        guard->commit();
+    }
+}
+
+
+void Database::Impl::addToTotals(const stats::FragmentTotals & aDelta)
+{
+    using namespace sqlite_orm;
+    std::vector<stats::FragmentTotals> found = storage.get_all<stats::FragmentTotals>(
+            where(is_equal(&stats::FragmentTotals::base, aDelta.base)
+                  && is_equal(&stats::FragmentTotals::quote, aDelta.quote)
+                  && is_equal(&stats::FragmentTotals::side, static_cast<int>(aDelta.side))));
+
+    if (found.empty())
+    {
+        stats::FragmentTotals totals = aDelta;
+        storage.insert(totals);
+    }
+    else
+    {
+        // Sums are done with Decimal, so the stored amounts stay exact to the exchange precision.
+        storage.update(detail::accumulate(found.front(), aDelta));
+    }
+}
+
+
+void Database::Impl::rebuildTotals()
+{
+    using namespace sqlite_orm;
+    Transaction transaction{*this};
+
+    storage.remove_all<stats::FragmentTotals>();
+
+    // Group by rate, so the quote value is computed exactly from the summed base.
+    auto unassociated = storage.select(
+            columns(&Fragment::base, &Fragment::quote, &Fragment::side, &Fragment::targetRate,
+                    sum(&Fragment::baseAmount), count(&Fragment::id)),
+            where(is_equal(&Fragment::composedOrder, -1l)),
+            group_by(&Fragment::base, &Fragment::quote, &Fragment::side, &Fragment::targetRate));
+    for (auto & [base, quote, side, rate, amount, count] : unassociated)
+    {
+        addToTotals(detail::getContribution(side, {base, quote}, rate, fromFP(*amount), count, false));
+    }
+
+    auto takenHome = storage.select(
+            columns(&Fragment::base, &Fragment::quote, &Fragment::side, sum(&Fragment::takenHome)),
+            group_by(&Fragment::base, &Fragment::quote, &Fragment::side));
+    for (auto & [base, quote, side, amount] : takenHome)
+    {
+        stats::FragmentTotals delta{base, quote, side};
+        delta.takenHome = fromFP(*amount);
+        addToTotals(delta);
+    }
+    // Archived fragments are all associated, but they still count toward the taken home.
+    if (archive)
+    {
+        auto archivedTakenHome = archive->select(
+                columns(&Fragment::base, &Fragment::quote, &Fragment::side, sum(&Fragment::takenHome)),
+                group_by(&Fragment::base, &Fragment::quote, &Fragment::side));
+        for (auto & [base, quote, side, amount] : archivedTakenHome)
+        {
+            stats::FragmentTotals delta{base, quote, side};
+            delta.takenHome = fromFP(*amount);
+            addToTotals(delta);
+        }
+    }
+
+    transaction.commit();
+}
+
+
+Database::Impl::Impl(const std::string & aFilename,
+                     const std::string & aArchiveFilename,
+                     DatabaseOptions aOptions) :
+    storage{detail::initializeStorage(aFilename)},
+    filename{aFilename},
+    options{std::move(aOptions)}
+{
+    // Note: the busy timeout is set by configure(), as storage.busy_timeout()
+    // only applies to the connection open at the time.
+    configure(storage);
+
+    if (! aArchiveFilename.empty())
+    {
+        archive.reset(new Storage{detail::initializeStorage(aArchiveFilename)});
+        configure(*archive);
+        archive->pragma.journal_mode(sqlite_orm::journal_mode::WAL);
+        archive->sync_schema();
+    }
 
     // Allows to have reader without locking the one writer
     // see: https://www.sqlite.org/wal.html
     storage.pragma.journal_mode(sqlite_orm::journal_mode::WAL);
     storage.sync_schema();
+
+    if (storage.count<stats::FragmentTotals>() == 0 && storage.count<Fragment>() != 0)
+    {
+        spdlog::info("Database has fragments but no fragment totals, computing them.");
+        rebuildTotals();
+    }
+
+    if (options.checkpointPeriod && ! detail::isInMemory(aFilename))
+    {
+        checkpointer = std::make_unique<Checkpointer>(aFilename, *options.checkpointPeriod);
+    }
+    if (archive && options.checkpointPeriod && ! detail::isInMemory(aArchiveFilename))
+    {
+        archiveCheckpointer = std::make_unique<Checkpointer>(aArchiveFilename, *options.checkpointPeriod);
+    }
+}
+
+
+Database::Impl::Impl(const std::string & aFilename, DatabaseOptions aOptions, ReadReplica) :
+    storage{detail::initializeStorage(aFilename)},
+    filename{aFilename},
+    options{std::move(aOptions)},
+    readOnly{true}
+{
+    if (detail::isInMemory(aFilename) || ! std::filesystem::exists(aFilename))
+    {
+        spdlog::critical("Cannot open a read replica of database '{}', there is no such file.", aFilename);
+        throw std::invalid_argument{"Read replicas require an existing database file."};
+    }
+    // The journal mode, schema and totals are maintained by the writing database.
+    configure(storage);
 }
 
 
-Database::Database(const std::string & aFilename) :
-    mImpl{std::make_unique<Database::Impl>(aFilename)}
+Database::Database(const std::string & aFilename,
+                   const std::string & aArchiveFilename,
+                   DatabaseOptions aOptions) :
+    mImpl{std::make_unique<Database::Impl>(aFilename, aArchiveFilename, std::move(aOptions))}
 {}
 
 
+Database::Database(std::unique_ptr<Impl> aImpl) :
+    mImpl{std::move(aImpl)}
+{}
+
+
+Database Database::openReadReplica(const std::string & aFilename, DatabaseOptions aOptions)
+{
+    return Database{std::make_unique<Impl>(aFilename, std::move(aOptions), Impl::ReadReplica{})};
+}
+
+
+DatabaseOptions makeDatabaseProfile(const std::string & aProfile)
+{
+    DatabaseOptions options;
+    if (aProfile == "default")
+    {
+        return options;
+    }
+
+    options.persistentConnection = true;
+    options.checkpointPeriod = std::chrono::milliseconds{1000};
+    if (aProfile == "durable")
+    {
+        options.synchronous = DatabaseOptions::Synchronous::Full;
+    }
+    else if (aProfile == "fast")
+    {
+        options.synchronous = DatabaseOptions::Synchronous::Normal;
+        options.mmapSize = 256 * 1024 * 1024;
+        options.cacheSize = -64 * 1024; // 64 MiB
+        options.tempStore = DatabaseOptions::TempStore::Memory;
+    }
+    else
+    {
+        spdlog::critical("Unknown database profile '{}'.", aProfile);
+        throw std::invalid_argument{"Unknown database profile."};
+    }
+    return options;
+}
+
+
 Database::~Database()
 {}
 
 
 long Database::insert(Order & aOrder)
 {
+    auto timer = mImpl->time("insert order");
     aOrder.id = mImpl->storage.insert(aOrder);
     spdlog::trace("Inserted order {} in database", aOrder.id);
     return aOrder.id;
@@ -111,6 +740,7 @@ long Database::insert(Order & aOrder)
 
 Order Database::getOrder(decltype(Order::id) aIndex)
 {
+    mImpl->awaitOrderWrites();
     return mImpl->storage.get<Order>(aIndex);
 }
 
@@ -123,7 +753,15 @@ std::size_t Database::countOrders()
 
 long Database::insert(Fragment & aFragment)
 {
+    auto timer = mImpl->time("insert fragment");
+    Impl::Transaction transaction{*mImpl};
     aFragment.id = mImpl->storage.insert(aFragment);
+    mImpl->addToTotals(detail::getContribution(aFragment));
+    transaction.commit();
+    if (aFragment.composedOrder == -1)
+    {
+        mImpl->onFragmentsWrite(aFragment.side);
+    }
     spdlog::trace("Inserted fragment {} in database", aFragment.id);
     return aFragment.id;
 }
@@ -147,13 +785,86 @@ long Database::insert(stats::Balance & aBalance)
 
 void Database::update(const Order & aOrder)
 {
+    mImpl->awaitOrderWrites();
+    auto timer = mImpl->time("update order");
     mImpl->storage.update(aOrder);
 }
 
 
 void Database::update(const Fragment & aFragment)
 {
+    auto timer = mImpl->time("update fragment");
+    Impl::Transaction transaction{*mImpl};
+    Fragment previous = mImpl->storage.get<Fragment>(aFragment.id);
     mImpl->storage.update(aFragment);
+
+    stats::FragmentTotals added = detail::getContribution(aFragment);
+    stats::FragmentTotals removed = detail::getContribution(previous);
+    if (previous.base == aFragment.base && previous.quote == aFragment.quote && previous.side == aFragment.side)
+    {
+        detail::accumulate(added, removed, -1);
+        // Most updates only change fragments associated to an order, without taking home.
+        if (added.unassociatedCount != 0
+            || added.unassociatedBase != 0
+            || added.unassociatedQuote != 0
+            || added.takenHome != 0)
+        {
+            mImpl->addToTotals(added);
+        }
+    }
+    else
+    {
+        stats::FragmentTotals negated{previous.base, previous.quote, previous.side};
+        mImpl->addToTotals(added);
+        mImpl->addToTotals(detail::accumulate(negated, removed, -1));
+    }
+    transaction.commit();
+
+    // The unassociated fragments change when the fragment leaves them, as well as when it is among them.
+    if (previous.composedOrder == -1)
+    {
+        mImpl->onFragmentsWrite(previous.side);
+    }
+    if (aFragment.composedOrder == -1)
+    {
+        mImpl->onFragmentsWrite(aFragment.side);
+    }
+}
+
+
+void Database::recordTakenHome(const Order & aOrder, const std::vector<Fragment> & aFragments)
+{
+    using namespace sqlite_orm;
+    if (aFragments.empty())
+    {
+        return;
+    }
+
+    auto timer = mImpl->time("record taken home");
+    Impl::Transaction transaction{*mImpl};
+
+    stats::FragmentTotals delta{aOrder.base, aOrder.quote, aOrder.side};
+    delta.takenHome = -sumTakenHome(aOrder);
+    for (const Fragment & fragment : aFragments)
+    {
+        if (fragment.composedOrder != aOrder.id)
+        {
+            spdlog::critical("Recording taken home of fragment {} composing order {}, instead of order {}.",
+                             fragment.id,
+                             fragment.composedOrder,
+                             aOrder.id);
+            throw std::logic_error{"Can only record taken home of fragments composing the order."};
+        }
+        mImpl->storage.update_all(set(c(&Fragment::takenHome) = fragment.takenHome),
+                                  where(is_equal(&Fragment::id, fragment.id)));
+        delta.takenHome += fragment.takenHome;
+    }
+
+    if (delta.takenHome != 0)
+    {
+        mImpl->addToTotals(delta);
+    }
+    transaction.commit();
 }
 
 
@@ -183,6 +894,35 @@ std::size_t Database::countFragments()
 }
 
 
+std::size_t Database::countUnassociatedFragments(Side aSide, const Pair & aPair)
+{
+    return getFragmentTotals(aSide, aPair).unassociatedCount;
+}
+
+
+stats::FragmentTotals Database::getFragmentTotals(Side aSide, const Pair & aPair)
+{
+    using namespace sqlite_orm;
+    auto timer = mImpl->time("get fragment totals");
+    std::vector<stats::FragmentTotals> found = mImpl->storage.get_all<stats::FragmentTotals>(
+            where(is_equal(&stats::FragmentTotals::base, aPair.base)
+                  && is_equal(&stats::FragmentTotals::quote, aPair.quote)
+                  && is_equal(&stats::FragmentTotals::side, static_cast<int>(aSide))));
+    if (found.empty())
+    {
+        return stats::FragmentTotals{aPair.base, aPair.quote, aSide};
+    }
+    return found.front();
+}
+
+
+void Database::rebuildFragmentTotals()
+{
+    auto timer = mImpl->time("rebuild fragment totals");
+    mImpl->rebuildTotals();
+}
+
+
 std::size_t Database::countBalances(MillisecondsSinceEpoch aStartingFrom)
 {
     using namespace sqlite_orm;
@@ -222,6 +962,7 @@ std::vector<Decimal> Database::getProfitableRates(Side aSide,
                                                   Decimal aRateLimit,
                                                   const Pair & aPair)
 {
+    auto timer = mImpl->time("profitable rates");
     switch(aSide)
     {
         case Side::Sell:
@@ -234,9 +975,103 @@ std::vector<Decimal> Database::getProfitableRates(Side aSide,
 }
 
 
-void Database::assignAvailableFragments(const Order & aOrder)
+std::vector<RateFragments> Database::sumProfitableFragments(Side aSide,
+                                                           Decimal aRateLimit,
+                                                           const Pair & aPair)
+{
+    using namespace sqlite_orm;
+    auto timer = mImpl->time("sum profitable fragments");
+
+    auto sumFragments = [&](auto aRateCondition)
+    {
+        auto rows = mImpl->storage.select(
+                columns(&Fragment::targetRate, sum(&Fragment::baseAmount), count(&Fragment::id)),
+                where(   aRateCondition
+                      && (c(&Fragment::side) = static_cast<int>(aSide))
+                      && (c(&Fragment::base) = aPair.base)
+                      && (c(&Fragment::quote) = aPair.quote)
+                      && (c(&Fragment::composedOrder) = -1l) ), // Fragments not already part of an order
+                group_by(&Fragment::targetRate)
+                );
+
+        std::vector<RateFragments> result;
+        result.reserve(rows.size());
+        for (auto & [rate, amount, count] : rows)
+        {
+            // Same precision fix as in sumFragmentsOfOrder()
+            result.push_back({rate, fromFP(*amount), count});
+        }
+        return result;
+    };
+
+    switch(aSide)
+    {
+        case Side::Sell:
+            return sumFragments(c(&Fragment::targetRate) <= aRateLimit);
+        case Side::Buy:
+            return sumFragments(c(&Fragment::targetRate) >= aRateLimit);
+        default:
+            throw std::domain_error{"Invalid Side enumerator."};
+    }
+}
+
+
+std::vector<RateFragments> Database::sumUnassociatedFragments(Side aSide, const Pair & aPair)
+{
+    using namespace sqlite_orm;
+    auto timer = mImpl->time("sum unassociated fragments");
+
+    auto rows = mImpl->storage.select(
+            columns(&Fragment::targetRate, sum(&Fragment::baseAmount), count(&Fragment::id)),
+            where(   (c(&Fragment::side) = static_cast<int>(aSide))
+                  && (c(&Fragment::base) = aPair.base)
+                  && (c(&Fragment::quote) = aPair.quote)
+                  && (c(&Fragment::composedOrder) = -1l) ), // Fragments not already part of an order
+            group_by(&Fragment::targetRate)
+            );
+
+    std::vector<RateFragments> result;
+    result.reserve(rows.size());
+    for (auto & [rate, amount, count] : rows)
+    {
+        // Same precision fix as in sumFragmentsOfOrder()
+        result.push_back({rate, fromFP(*amount), count});
+    }
+    return result;
+}
+
+
+std::uint64_t Database::getFragmentsGeneration(Side aSide) const
+{
+    return aSide == Side::Sell ? mImpl->sellGeneration : mImpl->buyGeneration;
+}
+
+
+int Database::assignAvailableFragments(const Order & aOrder)
+{
+    Impl::Transaction transaction{*mImpl};
+
+    int count = assignFragments(aOrder);
+    if (count != 0)
+    {
+        mImpl->addToTotals(detail::getContribution(aOrder.side,
+                                                   {aOrder.base, aOrder.quote},
+                                                   aOrder.fragmentsRate,
+                                                   sumFragmentsOfOrder(aOrder),
+                                                   count,
+                                                   true));
+    }
+
+    transaction.commit();
+    return count;
+}
+
+
+int Database::assignFragments(const Order & aOrder)
 {
     using namespace sqlite_orm;
+    auto timer = mImpl->time("assign fragments");
+    mImpl->onFragmentsWrite(aOrder.side);
     // I think there is a bug when trying to compile some clauses.
     // see: https://github.com/fnc12/sqlite_orm/issues/723
     mImpl->storage.update_all(set(c(&Fragment::composedOrder) = aOrder.id),
@@ -248,6 +1083,7 @@ void Database::assignAvailableFragments(const Order & aOrder)
                   && (c(&Fragment::quote) = aOrder.quote)
                   && (c(&Fragment::composedOrder) = -1l) ) // Fragments not already part of an order
             );
+    return mImpl->storage.changes();
 }
 
 
@@ -338,6 +1174,7 @@ std::vector<Fragment> Database::getUnassociatedFragments(Side aSide,
 std::vector<Order> Database::selectOrders(const Pair & aPair, Order::Status aStatus)
 {
     using namespace sqlite_orm;
+    mImpl->awaitOrderWrites();
     return mImpl->storage.get_all<Order>(
             where(is_equal(&Order::status, static_cast<int>(aStatus))
                   && (c(&Order::base) = aPair.base)
@@ -346,9 +1183,148 @@ std::vector<Order> Database::selectOrders(const Pair & aPair, Order::Status aSta
 }
 
 
+std::size_t Database::archiveFulfilledOrders(std::size_t aBatchSize)
+{
+    using namespace sqlite_orm;
+    if (! mImpl->archive)
+    {
+        spdlog::critical("Cannot archive orders, the database was opened without an archive.");
+        throw std::logic_error{"No archive database."};
+    }
+    auto timer = mImpl->time("archive orders");
+
+    // Orders whose spawned fragments are still live must stay available to the spawners.
+    // The conditions are sub-selects, so no statement binds a parameter per order,
+    // and a single transaction ensures each statement selects the same orders.
+    auto archivable = [aBatchSize]()
+    {
+        auto liveOrders = select(&Order::id,
+                where(c(&Order::status) != static_cast<int>(Order::Status::Fulfilled)));
+        auto parents = select(&Fragment::spawningOrder,
+                where(is_equal(&Fragment::composedOrder, -1l)
+                      || in(&Fragment::composedOrder, liveOrders)));
+        return select(&Order::id,
+                where(is_equal(&Order::status, static_cast<int>(Order::Status::Fulfilled))
+                      && not_in(&Order::id, parents)),
+                order_by(&Order::id),
+                limit(static_cast<int>(aBatchSize)));
+    };
+
+    Impl::Transaction transaction{*mImpl};
+
+    std::vector<Order> orders = mImpl->storage.get_all<Order>(
+            where(in(&Order::id, archivable())),
+            order_by(&Order::id));
+    if (orders.empty())
+    {
+        return 0;
+    }
+    std::vector<Fragment> fragments =
+        mImpl->storage.get_all<Fragment>(where(in(&Fragment::composedOrder, archivable())));
+
+    // The archive is written first: if the removal below does not happen,
+    // the next archival replaces the same rows.
+    {
+        auto archiveTransaction = mImpl->archive->transaction_guard();
+        for (const Order & order : orders)
+        {
+            mImpl->archive->replace(order);
+        }
+        for (const Fragment & fragment : fragments)
+        {
+            mImpl->archive->replace(fragment);
+        }
+        archiveTransaction.commit();
+    }
+
+    // Archived fragments are all associated to a fulfilled order: removing them changes neither
+    // the archivable orders, nor the fragment totals, nor the generations of the unassociated fragments.
+    mImpl->storage.remove_all<Fragment>(where(in(&Fragment::composedOrder, archivable())));
+    mImpl->storage.remove_all<Order>(where(in(&Order::id, archivable())));
+    transaction.commit();
+
+    spdlog::debug("Archived {} orders and {} fragments.", orders.size(), fragments.size());
+    return orders.size();
+}
+
+
+std::size_t Database::countArchivedOrders()
+{
+    return mImpl->archive ? mImpl->archive->count<Order>() : 0;
+}
+
+
+void Database::startWriter()
+{
+    if (mImpl->readOnly)
+    {
+        spdlog::critical("Cannot start a writer on read replica of database '{}'.", mImpl->filename);
+        throw std::logic_error{"Read replicas cannot write."};
+    }
+    if (mImpl->writer)
+    {
+        return;
+    }
+    if (detail::isInMemory(mImpl->filename))
+    {
+        // Another connection would open a different database.
+        spdlog::warn("Deferred writes are applied immediately for in-memory databases.");
+        return;
+    }
+    mImpl->writer = std::make_unique<Impl::Writer>(mImpl->filename, *mImpl);
+    spdlog::debug("Database writer started.");
+}
+
+
+void Database::updateDeferred(const Order & aOrder)
+{
+    mImpl->defer([aOrder](Impl::Storage & aStorage)
+                 {
+                     aStorage.update(aOrder);
+                 },
+                 true);
+}
+
+
+void Database::insertDeferred(stats::Launch aLaunch)
+{
+    mImpl->defer([aLaunch](Impl::Storage & aStorage) mutable
+                 {
+                     aStorage.insert(aLaunch);
+                 },
+                 false);
+}
+
+
+void Database::insertDeferred(stats::Balance aBalance)
+{
+    mImpl->defer([aBalance](Impl::Storage & aStorage) mutable
+                 {
+                     aStorage.insert(aBalance);
+                 },
+                 false);
+}
+
+
+void Database::flush()
+{
+    if (mImpl->writer)
+    {
+        if (mImpl->openTransactions != 0)
+        {
+            // The writer could not commit while the transaction holds the lock.
+            spdlog::critical("Cannot flush the deferred writes from within a transaction.");
+            throw std::logic_error{"Flushing the deferred writes from within a transaction."};
+        }
+        auto timer = mImpl->time("flush");
+        mImpl->writer->flush();
+    }
+}
+
+
 struct Database::TransactionGuard::Impl
 {
-    decltype(Database::mImpl->storage.transaction_guard()) guard;
+    Database::Impl::Transaction transaction;
 };
 
 
@@ -357,14 +1333,40 @@ Database::TransactionGuard::~TransactionGuard() = default;
 Database::TransactionGuard Database::startTransaction()
 {
     return TransactionGuard{std::unique_ptr<TransactionGuard::Impl>{
-        new TransactionGuard::Impl{mImpl->storage.transaction_guard()},
+        new TransactionGuard::Impl{Impl::Transaction{*mImpl}},
     }};
 }
 
 
 void Database::commit(TransactionGuard && aGuard)
 {
-    aGuard.mImpl->guard.commit();
+    auto timer = mImpl->time("commit");
+    aGuard.mImpl->transaction.commit();
+}
+
+
+Order Database::insertOrderForFragments(const std::string & aTraderName,
+                                        Side aSide,
+                                        Decimal aFragmentsRate,
+                                        const Pair & aPair)
+{
+    Order order{
+        aTraderName,
+        aPair.base,
+        aPair.quote,
+        Decimal{"0"}, // amount
+        aFragmentsRate,
+        aSide,
+    };
+
+    insert(order);
+    int count = assignFragments(order);
+    order.baseAmount = sumFragmentsOfOrder(order);
+    update(order);
+    mImpl->addToTotals(
+        detail::getContribution(aSide, aPair, aFragmentsRate, order.baseAmount, count, true));
+
+    return order;
 }
 
 
@@ -373,21 +1375,64 @@ Order Database::prepareOrder(const std::string & aTraderName,
                              Decimal aFragmentsRate,
                              const Pair & aPair)
 {
+    auto timer = mImpl->time("prepare order");
+    Impl::Transaction transaction{*mImpl};
+
+    Order order = insertOrderForFragments(aTraderName, aSide, aFragmentsRate, aPair);
+
+    transaction.commit();
+
+    return order;
+}
+
+
+std::vector<Order> Database::prepareOrders(const std::string & aTraderName,
+                                           const std::vector<std::pair<Side, Decimal>> & aRates,
+                                           const Pair & aPair)
+{
+    auto timer = mImpl->time("prepare orders");
+    Impl::Transaction transaction{*mImpl};
+
+    std::vector<Order> orders;
+    orders.reserve(aRates.size());
+    for (const auto & [side, rate] : aRates)
+    {
+        orders.push_back(insertOrderForFragments(aTraderName, side, rate, aPair));
+    }
+
+    transaction.commit();
+
+    return orders;
+}
+
+
+Order Database::preparePlannedOrder(const std::string & aTraderName,
+                                    Side aSide,
+                                    const RateFragments & aPlanned,
+                                    const Pair & aPair)
+{
+    auto timer = mImpl->time("prepare planned order");
     Order order{
         aTraderName,
         aPair.base,
         aPair.quote,
-        Decimal{"0"}, // amount
-        aFragmentsRate,
+        aPlanned.baseAmount,
+        aPlanned.rate,
         aSide,
     };
 
-    auto transaction = mImpl->storage.transaction_guard();
+    Impl::Transaction transaction{*mImpl};
 
     insert(order);
-    assignAvailableFragments(order);
-    order.baseAmount = sumFragmentsOfOrder(order);
-    update(order);
+    int count = assignFragments(order);
+    if (count != aPlanned.count)
+    {
+        spdlog::debug("Fragments at rate {} changed since they were planned, summing them.", aPlanned.rate);
+        order.baseAmount = sumFragmentsOfOrder(order);
+        update(order);
+    }
+    mImpl->addToTotals(
+        detail::getContribution(aSide, aPair, aPlanned.rate, order.baseAmount, count, true));
 
     transaction.commit();
 
@@ -398,8 +1443,23 @@ Order Database::prepareOrder(const std::string & aTraderName,
 void Database::discardOrder(Order & aOrder)
 {
     using namespace sqlite_orm;
+    auto timer = mImpl->time("discard order");
+    mImpl->onFragmentsWrite(aOrder.side);
+
+    Impl::Transaction transaction{*mImpl};
 
-    auto transaction = mImpl->storage.transaction_guard();
+    auto released = mImpl->storage.select(
+            columns(sum(&Fragment::baseAmount), count(&Fragment::id)),
+            where(is_equal(&Fragment::composedOrder, aOrder.id)));
+    if (auto & [amount, count] = released.front(); count != 0)
+    {
+        mImpl->addToTotals(detail::getContribution(aOrder.side,
+                                                   {aOrder.base, aOrder.quote},
+                                                   aOrder.fragmentsRate,
+                                                   fromFP(*amount),
+                                                   count,
+                                                   false));
+    }
 
     mImpl->storage.update_all(set(c(&Fragment::composedOrder) = -1l),
                               where(is_equal(&Fragment::composedOrder, aOrder.id)));
@@ -417,6 +1477,7 @@ void Database::discardOrder(Order & aOrder)
 bool Database::onFillOrder(const FulfilledOrder & aOrder)
 {
     using namespace sqlite_orm;
+    auto timer = mImpl->time("fill order");
 
     // Make it resilient to multiple "fulfill" notifications.
     // e.g. Realizing the order is fulfilled while trying to cancel it, and receiving
@@ -439,5 +1500,12 @@ bool Database::onFillOrder(const FulfilledOrder & aOrder)
     return ! alreadyFilled;
 }
 
+
+const trade::HistogramFamily & Database::getStatementLatencies() const
+{
+    return mImpl->statementLatencies;
+}
+
+
 } // namespace tradebot
 } // namespace ad
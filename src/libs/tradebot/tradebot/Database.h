@@ -3,8 +3,15 @@
 #include "Fragment.h"
 #include "Order.h"
 #include "stats/Balance.h"
+#include "stats/FragmentTotals.h"
 #include "stats/LaunchCount.h"
 
+#include <trademath/Histogram.h>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
 #if not defined(_MSC_VER)
 #include <experimental/propagate_const>
 #endif
@@ -24,14 +31,86 @@ enum class Comparison
 };
 
 
+/// \brief The unassociated fragments at a given rate, summed.
+struct RateFragments
+{
+    Decimal rate;
+    Decimal baseAmount;
+    long count;
+};
+
+
+/// \brief Settings applied to each connection of a `Database`.
+///
+/// The unset values keep the SQLite defaults, see https://www.sqlite.org/pragma.html
+struct DatabaseOptions
+{
+    enum class Synchronous
+    {
+        Off,
+        // In WAL mode, commits do not sync, the WAL is synced on checkpoints.
+        // A power loss can roll back the latest commits, but does not corrupt the database.
+        Normal,
+        Full,
+    };
+
+    enum class TempStore
+    {
+        Default,
+        File,
+        Memory,
+    };
+
+    /// \brief Keep a connection open for the lifetime of the database,
+    /// instead of opening one for each statement.
+    bool persistentConnection{false};
+    /// \brief Maximum number of bytes of the database file mapped in memory.
+    std::optional<std::int64_t> mmapSize;
+    /// \brief Size of the page cache, in pages if positive, in KiB if negative.
+    std::optional<std::int64_t> cacheSize;
+    std::optional<Synchronous> synchronous;
+    std::optional<TempStore> tempStore;
+    /// \brief Time waiting for a lock held by another connection before failing, zero to fail immediately.
+    std::chrono::milliseconds busyTimeout{10000};
+    /// \brief If set, the commits do not checkpoint the WAL when it crosses the automatic threshold.
+    /// Instead, a background thread makes a passive checkpoint with this period,
+    /// and another one for the archive database if there is one.
+    std::optional<std::chrono::milliseconds> checkpointPeriod;
+};
+
+
+/// \brief Options for a named profile:
+/// * "default": SQLite defaults, and a connection per statement.
+/// * "durable": a persistent connection, synchronous FULL, and background checkpoints.
+/// * "fast": as "durable", with synchronous NORMAL, memory mapping, a larger cache and temp store in memory.
+DatabaseOptions makeDatabaseProfile(const std::string & aProfile);
+
+
 class Database
 {
     struct Impl;
 
 public:
-    Database(const std::string & aFilename);
+    /// \param aArchiveFilename If not empty, the database receiving the orders and fragments
+    /// moved by `archiveFulfilledOrders()`.
+    /// \param aOptions Applied to all the connections, including the archive and writer connections.
+    Database(const std::string & aFilename,
+             const std::string & aArchiveFilename = {},
+             DatabaseOptions aOptions = {});
     ~Database();
 
+    /// \brief Open the existing database file `aFilename` for reporting, on its own connections.
+    ///
+    /// The connections are query only, so the replica never takes the write lock:
+    /// in WAL mode, its reads do not delay the trading writer, and are not delayed by it.
+    /// Each statement reads the latest committed state; the statements under a `startTransaction()`
+    /// all read the same WAL snapshot.
+    /// All the write operations fail, with an exception.
+    ///
+    /// \param aOptions Applied to the replica connections. Use a persistent connection
+    /// to avoid opening one for each statement.
+    static Database openReadReplica(const std::string & aFilename, DatabaseOptions aOptions = {});
+
     long insert(Order & aOrder);
     long insert(Order && aOrder)
     { return insert(aOrder); }
@@ -51,6 +130,12 @@ public:
     void update(const Order & aOrder);
     void update(const Fragment & aFragment);
 
+    /// \brief Record the taken home of all the fragments composing `aOrder`.
+    ///
+    /// Only the taken home of the fragments is written, and the totals are updated once
+    /// with the summed difference, instead of once per fragment as `update()` would.
+    void recordTakenHome(const Order & aOrder, const std::vector<Fragment> & aFragments);
+
     Order & reload(Order & aOrder);
     Fragment & reload(Fragment & aFragment);
 
@@ -58,6 +143,21 @@ public:
     std::size_t countOrders();
     Fragment getFragment(decltype(Fragment::id) aIndex);
     std::size_t countFragments();
+    /// \brief Count the fragments of `aSide` not yet associated to an order.
+    ///
+    /// Read from the fragment totals, so it does not scan the fragments.
+    std::size_t countUnassociatedFragments(Side aSide, const Pair & aPair);
+
+    /// \brief The totals of the fragments of `aSide`, maintained in the same transaction as each write
+    /// to the fragments (insertion, update, assignment to an order and discarding of an order).
+    ///
+    /// The totals are zero if no fragment was ever written for this pair and side.
+    stats::FragmentTotals getFragmentTotals(Side aSide, const Pair & aPair);
+
+    /// \brief Recompute all fragment totals from the fragments.
+    ///
+    /// Done when opening a database with fragments but no totals (i.e. created before the totals).
+    void rebuildFragmentTotals();
 
     std::size_t countBalances(MillisecondsSinceEpoch aStartingFrom = 0);
 
@@ -72,8 +172,24 @@ public:
     /// returning fragments with a profitable rate present in the DB.
     std::vector<Decimal> getProfitableRates(Side aSide, Decimal aRateLimit, const Pair & aPair);
 
+    /// \brief Same rates as `getProfitableRates()`, with the sum and count of the fragments at each rate,
+    /// in a single query.
+    std::vector<RateFragments> sumProfitableFragments(Side aSide, Decimal aRateLimit, const Pair & aPair);
+
+    /// \brief Sum and count the unassociated fragments of `aSide` at each rate, in a single query.
+    ///
+    /// The result size is bounded by the number of distinct rates, not the number of fragments.
+    std::vector<RateFragments> sumUnassociatedFragments(Side aSide, const Pair & aPair);
+
     /// \brief Assign to `aOrder` all unasigned fragments matching said order.
-    void assignAvailableFragments(const Order & aOrder);
+    /// \return The number of fragments assigned.
+    int assignAvailableFragments(const Order & aOrder);
+
+    /// \brief Incremented by each write that might change the unassociated fragments of `aSide`.
+    ///
+    /// Allows to know whether values computed from these fragments (e.g. with `sumProfitableFragments()`)
+    /// are still valid. Updates of fragments associated to an order are not accounted for.
+    std::uint64_t getFragmentsGeneration(Side aSide) const;
 
     /// \brief Sum the amounts of all fragments in the database.
     ///
@@ -87,6 +203,19 @@ public:
 
     std::vector<Order> selectOrders(const Pair & aPair, Order::Status aStatus);
 
+    /// \brief Move up to `aBatchSize` fulfilled orders, with the fragments composing them,
+    /// from the main database to the archive database.
+    ///
+    /// An order is only archived once no fragment it spawned is still unassociated,
+    /// or composing an order which is not fulfilled: the spawners can always find the parent orders
+    /// in the main database. The identifiers are preserved in the archive.
+    /// Moving a batch is idempotent, so an interrupted archival is completed by the next one.
+    ///
+    /// \return The number of orders archived, which is below `aBatchSize` once the backlog is archived.
+    std::size_t archiveFulfilledOrders(std::size_t aBatchSize);
+
+    std::size_t countArchivedOrders();
+
 
     //
     // Transaction API
@@ -102,6 +231,32 @@ public:
 
     void commit(TransactionGuard && aGuard);
 
+    //
+    // Deferred writes
+    //
+    // For records which do not have to be durable when the call returns: stats, and order updates
+    // that the recovery in `Trader::cleanup()` does not depend on.
+    // Synchronous writes and reads of the orders first wait for the deferred order updates,
+    // so they are never overtaken: an order update followed by a synchronous one gains nothing from deferral.
+
+    /// \brief Apply the deferred writes from a dedicated thread, with its own connection
+    /// (opened with the same options).
+    ///
+    /// All the writes pending when the thread is available are committed in a single transaction.
+    /// Its transactions and the transactions of the database thread exclude each other.
+    /// Until it is started, and always for in-memory databases, deferred writes are applied immediately.
+    void startWriter();
+
+    void updateDeferred(const Order & aOrder);
+    void insertDeferred(stats::Launch aLaunch);
+    void insertDeferred(stats::Balance aBalance);
+
+    /// \brief Block until all deferred writes are committed.
+    ///
+    /// A failure of the writer is rethrown by the next deferred write or flush.
+    /// Throws if called from within a transaction.
+    void flush();
+
     //
     // High level API
     //
@@ -110,11 +265,42 @@ public:
                        Decimal aFragmentsRate,
                        const Pair & aPair);
 
+    /// \brief Prepare an order for each (side, fragments rate) in `aRates`, in a single transaction.
+    ///
+    /// Equivalent to successive calls to `prepareOrder()`, without committing after each order.
+    std::vector<Order> prepareOrders(const std::string & aTraderName,
+                                     const std::vector<std::pair<Side, Decimal>> & aRates,
+                                     const Pair & aPair);
+
+    /// \brief Prepare an order from fragments summed ahead of time,
+    /// which saves summing them if they did not change since.
+    ///
+    /// If the number of fragments assigned to the order is not the planned count,
+    /// the amount is summed as by `prepareOrder()`.
+    Order preparePlannedOrder(const std::string & aTraderName,
+                              Side aSide,
+                              const RateFragments & aPlanned,
+                              const Pair & aPair);
+
     void discardOrder(Order & aOrder);
 
     bool onFillOrder(const FulfilledOrder & aOrder);
 
+    /// \brief Latency in microseconds of the main statements, labelled by operation.
+    const trade::HistogramFamily & getStatementLatencies() const;
+
 private:
+    explicit Database(std::unique_ptr<Impl> aImpl);
+
+    /// \brief Assign the fragments without updating the totals, see `assignAvailableFragments()`.
+    int assignFragments(const Order & aOrder);
+
+    /// \brief Insert the order and assign its fragments, the caller is responsible for the transaction.
+    Order insertOrderForFragments(const std::string & aTraderName,
+                                  Side aSide,
+                                  Decimal aFragmentsRate,
+                                  const Pair & aPair);
+
 #if not defined(_MSC_VER)
     std::experimental::propagate_const<std::unique_ptr<Impl>> mImpl;
 #else
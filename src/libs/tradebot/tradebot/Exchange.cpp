@@ -256,11 +256,57 @@ std::optional<FulfilledOrder> Exchange::fillMarketOrder(Order & aOrder)
 std::optional<FulfilledOrder> Exchange::fillLimitFokOrder(Order & aOrder,
                                                           Decimal aLimitPrice)
 {
+    if (simulator)
+    {
+        return simulator->fillLimitFokOrder(aOrder, aLimitPrice);
+    }
+    if (limitFokTemplates
+        && aOrder.base == limitFokTemplates->pair.base
+        && aOrder.quote == limitFokTemplates->pair.quote)
+    {
+        const auto & templates = (aOrder.side == Side::Sell) ? limitFokTemplates->sell
+                                                             : limitFokTemplates->buy;
+        if (auto found = templates.find(aLimitPrice); found != templates.end())
+        {
+            return fillOrderImpl(binance::TemplatedOrder{found->second, aOrder.baseAmount, aOrder.clientId()},
+                                 aOrder,
+                                 restApi,
+                                 "limit fok");
+        }
+    }
+
     binance::LimitOrder limitOrder = to_limitFokOrder(aOrder, aLimitPrice);
     return fillOrderImpl(limitOrder, aOrder, restApi, "limit fok");
 }
 
 
+void Exchange::prepareLimitFokTemplates(const Pair & aPair, const std::vector<Decimal> & aPrices)
+{
+    auto templates = std::make_shared<LimitFokTemplates>();
+    templates->pair = aPair;
+    for (const Decimal & price : aPrices)
+    {
+        for (auto [side, destination] : {std::make_pair(binance::Side::SELL, &templates->sell),
+                                         std::make_pair(binance::Side::BUY, &templates->buy)})
+        {
+            destination->emplace(price, binance::OrderTemplate{binance::LimitOrder{
+                binance::OrderBase{
+                    aPair.symbol(),
+                    side,
+                    0, // quantity, not serialised by the template
+                    binance::QuantityUnit::Base,
+                    binance::ClientId{""},
+                },
+                price,
+                binance::TimeInForce::FOK,
+            }});
+        }
+    }
+    spdlog::info("Prepared limit FOK orders templates for {} prices on {}.", aPrices.size(), aPair.symbol());
+    limitFokTemplates = std::move(templates);
+}
+
+
 // Return 400 -2011 if the provided order is not present to be cancelled
 bool Exchange::cancelOrder(const Order & aOrder)
 {
@@ -529,18 +575,15 @@ bool Exchange::openUserStream(Stream::ReceiveCallback aOnMessage,
                                // So it introduces concurrent execution of http requests
                                // (potentially complicating proper implementation of "quotas observation and waiting periods").
                                // TODO potentially have it post the request to be executed on the main thread.
+                               // On a shared executor, the (blocking) request occupies one of its threads.
                                std::bind(&binance::Api::pingSpotListenKey, restApi),
-                               LISTEN_KEY_REFRESH_PERIOD
-                           ));
+                               LISTEN_KEY_REFRESH_PERIOD,
+                               executor
+                           ),
+                           executor);
 
     // Block until the websocket either connects or fails to do so.
-    std::unique_lock<std::mutex> lock{spotUserStream->mutex};
-    spotUserStream->statusCondition.wait(lock,
-                                         [&stream = *spotUserStream]()
-                                         {
-                                             return stream.status != Stream::Initialize;
-                                         });
-    return spotUserStream->status == Stream::Connected;
+    return spotUserStream->waitConnection();
 }
 
 
@@ -552,7 +595,8 @@ void Exchange::closeUserStream()
 
 bool Exchange::openMarketStream(const std::string & aStreamName,
                                 Stream::ReceiveCallback aOnMessage,
-                                Stream::UnintendedCloseCallback aOnUnintededClose)
+                                Stream::UnintendedCloseCallback aOnGap,
+                                RollingStream::Options aOptions)
 {
     WebsocketDestination marketStreamDestination{
         restApi.getEndpoints().websocketHost,
@@ -562,16 +606,13 @@ bool Exchange::openMarketStream(const std::string & aStreamName,
 
     marketStream.emplace(std::move(marketStreamDestination),
                          std::move(aOnMessage),
-                         std::move(aOnUnintededClose));
+                         std::move(aOnGap),
+                         &RollingStream::marketStreamSequence,
+                         std::move(aOptions),
+                         executor);
 
-    // Block until the websocket either connects or fails to do so.
-    std::unique_lock<std::mutex> lock{marketStream->mutex};
-    marketStream->statusCondition.wait(lock,
-                                       [&stream = *marketStream]()
-                                       {
-                                           return stream.status != Stream::Initialize;
-                                       });
-    return marketStream->status == Stream::Connected;
+    // Block until the initial websocket either connects or fails to do so.
+    return marketStream->waitConnection();
 }
 
 
@@ -581,5 +622,86 @@ void Exchange::closeMarketStream()
 }
 
 
+bool Exchange::openCombinedMarketStream(StreamRouter::Handlers aHandlers,
+                                        Stream::UnintendedCloseCallback aOnUnintededClose,
+                                        net::WebSocket::Compression aCompression)
+{
+    std::string streams;
+    for (const auto & [streamName, handler] : aHandlers)
+    {
+        streams += (streams.empty() ? "" : "/") + streamName;
+    }
+
+    WebsocketDestination combinedStreamDestination{
+        restApi.getEndpoints().websocketHost,
+        restApi.getEndpoints().websocketPort,
+        "/stream" + (streams.empty() ? "" : "?streams=" + streams)
+    };
+
+    // Close a previous stream before replacing the router it is dispatching to.
+    combinedMarketStream.reset();
+    marketStreamRouter = std::make_shared<StreamRouter>(std::move(aHandlers));
+
+    combinedMarketStream.emplace(std::move(combinedStreamDestination),
+                                 [router = marketStreamRouter](Json aMessage)
+                                 {
+                                     router->route(std::move(aMessage));
+                                 },
+                                 std::move(aOnUnintededClose),
+                                 nullptr,
+                                 executor,
+                                 std::move(aCompression));
+
+    // Block until the websocket either connects or fails to do so.
+    return combinedMarketStream->waitConnection();
+}
+
+
+void Exchange::closeCombinedMarketStream()
+{
+    combinedMarketStream.reset();
+    marketStreamRouter.reset();
+}
+
+
+bool Exchange::subscribeMarketStream(const std::string & aStreamName,
+                                     Stream::ReceiveCallback aOnMessage)
+{
+    if (! combinedMarketStream)
+    {
+        spdlog::critical("Cannot subscribe to '{}', the combined market stream is not opened.",
+                         aStreamName);
+        throw std::logic_error{"Subscription requires an opened combined market stream."};
+    }
+
+    // Register the handler first, so the first messages following subscription are routed.
+    marketStreamRouter->add(aStreamName, std::move(aOnMessage));
+    if (! combinedMarketStream->async_send(marketStreamRouter->makeRequest("SUBSCRIBE", {aStreamName})))
+    {
+        marketStreamRouter->remove(aStreamName);
+        return false;
+    }
+    return true;
+}
+
+
+bool Exchange::unsubscribeMarketStream(const std::string & aStreamName)
+{
+    if (! combinedMarketStream)
+    {
+        spdlog::critical("Cannot unsubscribe from '{}', the combined market stream is not opened.",
+                         aStreamName);
+        throw std::logic_error{"Unsubscription requires an opened combined market stream."};
+    }
+
+    if (! combinedMarketStream->async_send(marketStreamRouter->makeRequest("UNSUBSCRIBE", {aStreamName})))
+    {
+        return false;
+    }
+    marketStreamRouter->remove(aStreamName);
+    return true;
+}
+
+
 } // namespace tradebot
 } // namespace ad
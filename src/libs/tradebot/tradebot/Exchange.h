@@ -5,10 +5,13 @@
 #include "Order.h"
 #include "Stream.h"
 #include "SymbolFilters.h"
+#include "ThreadPool.h"
 #include "stats/Balance.h"
 
 #include <binance/Api.h>
 
+#include <map>
+
 
 namespace ad {
 namespace tradebot {
@@ -22,6 +25,28 @@ enum class Execution
 };
 
 
+/// \brief Fills orders in-process, instead of sending them to the exchange.
+///
+/// Allows to run a `Trader` against simulated market conditions (e.g. backtesting).
+class OrderSimulator
+{
+public:
+    virtual ~OrderSimulator() = default;
+
+    /// \return The fulfilled order, or an empty optional if the order expired.
+    virtual std::optional<FulfilledOrder> fillLimitFokOrder(Order & aOrder, Decimal aLimitPrice) = 0;
+};
+
+
+/// \brief Limit FOK orders of a pair pre-serialised at given prices, for each side.
+struct LimitFokTemplates
+{
+    Pair pair;
+    std::map<Decimal, binance::OrderTemplate> sell;
+    std::map<Decimal, binance::OrderTemplate> buy;
+};
+
+
 struct Exchange
 {
     /// \return "NOTEXISTING" if the exchange engine does not know the order, otherwise returns
@@ -44,9 +69,16 @@ struct Exchange
 
     std::optional<FulfilledOrder> fillMarketOrder(Order & aOrder);
 
+    /// \brief Uses the pre-serialised order if `aLimitPrice` is one of the `limitFokTemplates` prices.
     std::optional<FulfilledOrder> fillLimitFokOrder(Order & aOrder,
                                                     Decimal aLimitPrice);
 
+    /// \brief Pre-serialise the limit FOK orders of `aPair` at each of `aPrices` (e.g. the ladder stops),
+    /// on both sides, replacing `limitFokTemplates`.
+    ///
+    /// \attention Not thread safe, it is intended to be called before sending orders.
+    void prepareLimitFokTemplates(const Pair & aPair, const std::vector<Decimal> & aPrices);
+
     /// \return true if the order was cancelled, false otherwise
     ///         (because it was not present, already cancelled, etc.).
     bool cancelOrder(const Order & aOrder);
@@ -101,15 +133,53 @@ struct Exchange
 
     /// \brief Blocks while opening a websocket to get market stream.
     ///
-    /// \return `true` if the websocket connected successfully, `false` otherwise.
+    /// The connection is transparently replaced before Binance closes it (24h),
+    /// or if it closes unexpectedly, without duplicated messages (see `RollingStream`).
+    ///
+    /// \param aOnGap Invoked when the connection was replaced without overlap,
+    /// so messages might have been missed.
+    ///
+    /// \return `true` if the initial websocket connected successfully, `false` otherwise.
+    /// Even on failure, the stream will keep trying to reconnect until closed.
     bool openMarketStream(const std::string & aStreamName,
                           Stream::ReceiveCallback aOnMessage,
-                          Stream::UnintendedCloseCallback aOnUnintededClose = [](){});
+                          Stream::UnintendedCloseCallback aOnGap = [](){},
+                          RollingStream::Options aOptions = {});
     void closeMarketStream();
 
+    /// \brief Blocks while opening a single websocket to a Binance combined market stream.
+    ///
+    /// Each message received is dispatched to the handler registered for its stream name.
+    /// Streams can later be added or removed without reconnecting,
+    /// see `subscribeMarketStream()` and `unsubscribeMarketStream()`.
+    ///
+    /// \note Binance stream names are lower case (e.g. `dogeusdt@aggTrade`).
+    ///
+    /// \return `true` if the websocket connected successfully, `false` otherwise.
+    bool openCombinedMarketStream(StreamRouter::Handlers aHandlers,
+                                  Stream::UnintendedCloseCallback aOnUnintededClose = [](){},
+                                  net::WebSocket::Compression aCompression = {});
+    void closeCombinedMarketStream();
+
+    /// \brief Live subscription to an additional stream on the opened combined market stream.
+    /// \return `false` if the request could not be queued (outbound queue full).
+    bool subscribeMarketStream(const std::string & aStreamName, Stream::ReceiveCallback aOnMessage);
+    /// \brief Live unsubscription of a stream from the opened combined market stream.
+    /// \return `false` if the request could not be queued (outbound queue full).
+    bool unsubscribeMarketStream(const std::string & aStreamName);
+
     binance::Api restApi;
+    /// \brief If set, the streams and their timers run on this shared executor,
+    /// instead of each starting its own thread.
+    ThreadPool * executor{nullptr};
     std::optional<Stream> spotUserStream;
-    std::optional<Stream> marketStream;
+    std::optional<RollingStream> marketStream;
+    std::optional<Stream> combinedMarketStream;
+    std::shared_ptr<StreamRouter> marketStreamRouter;
+    /// \brief If set, limit FOK orders are filled by the simulator instead of the exchange.
+    std::unique_ptr<OrderSimulator> simulator;
+    /// \brief Read only once prepared, so the orders can be sent from several threads.
+    std::shared_ptr<const LimitFokTemplates> limitFokTemplates;
 };
 
 
@@ -0,0 +1,60 @@
+#include "RateLimiter.h"
+
+#include "Logging.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+
+namespace ad {
+namespace tradebot {
+
+
+RateLimiter::RateLimiter(double aRatePerSecond, double aBurst, Now aNow, Sleep aSleep) :
+    ratePerSecond{aRatePerSecond},
+    burst{aBurst},
+    now{aNow ? std::move(aNow) : Now{&Clock::now}},
+    sleep{aSleep ? std::move(aSleep)
+                 : Sleep{[](std::chrono::duration<double> aDuration){ std::this_thread::sleep_for(aDuration); }}},
+    tokens{aBurst},
+    refillTime{now()}
+{
+    if (ratePerSecond <= 0 || burst < 1)
+    {
+        spdlog::critical("Invalid rate limit of {} per second with bursts of {}.", ratePerSecond, burst);
+        throw std::invalid_argument{"Rate limits must allow at least one operation."};
+    }
+}
+
+
+bool RateLimiter::acquire()
+{
+    std::chrono::duration<double> wait{0};
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        const Clock::time_point time = now();
+        tokens = std::min(burst,
+                          tokens + std::chrono::duration<double>(time - refillTime).count() * ratePerSecond);
+        refillTime = time;
+
+        // Reserve the token even if it is not available yet, so later threads wait after this one.
+        tokens -= 1;
+        if (tokens < 0)
+        {
+            wait = std::chrono::duration<double>{-tokens / ratePerSecond};
+        }
+    }
+
+    if (wait.count() > 0)
+    {
+        sleep(wait);
+        return true;
+    }
+    return false;
+}
+
+
+} // namespace tradebot
+} // namespace ad
@@ -0,0 +1,49 @@
+#pragma once
+
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+
+namespace ad {
+namespace tradebot {
+
+
+/// \brief A token bucket, bounding the rate of an operation shared by several threads.
+///
+/// Allows bursts of up to `aBurst` operations, then `aRatePerSecond` operations per second.
+/// Over any duration `d` (in seconds), at most `aBurst + aRatePerSecond * d` operations are allowed.
+class RateLimiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Now = std::function<Clock::time_point()>;
+    using Sleep = std::function<void(std::chrono::duration<double>)>;
+
+    /// \param aNow Defaults to `Clock::now()`.
+    /// \param aSleep Defaults to sleeping the calling thread.
+    /// Both are called concurrently when the limiter is shared by several threads.
+    RateLimiter(double aRatePerSecond, double aBurst, Now aNow = {}, Sleep aSleep = {});
+
+    /// \brief Block until the operation is allowed. Thread safe.
+    ///
+    /// The waiting threads are allowed in their order of arrival.
+    /// \return `true` if it had to wait.
+    bool acquire();
+
+private:
+    const double ratePerSecond;
+    const double burst;
+    const Now now;
+    const Sleep sleep;
+
+    std::mutex mutex;
+    // Negative when the next tokens are already reserved by waiting threads.
+    double tokens;
+    Clock::time_point refillTime;
+};
+
+
+} // namespace tradebot
+} // namespace ad
@@ -5,11 +5,120 @@
 
 #include <trademath/Spawn.h>
 
+#include <algorithm>
+#include <unordered_map>
+
 
 namespace ad {
 namespace tradebot {
 
 
+/// \brief Bounded cache of the fragments rate of parent orders, read by spawners.
+///
+/// The fragments composing an order usually come from a few parent orders.
+/// Parent orders are fulfilled, so their rate does not change and it is read once
+/// from the database for all the fragments of the completed order.
+class ParentOrders
+{
+public:
+    static constexpr std::size_t gDefaultCapacity = 256;
+
+    explicit ParentOrders(Database & aDatabase, std::size_t aCapacity = gDefaultCapacity) :
+        database{aDatabase},
+        capacity{aCapacity}
+    {}
+
+    /// \return The fragments rate of the order with id `aOrderId`.
+    Decimal getFragmentsRate(decltype(Order::id) aOrderId)
+    {
+        if (auto found = rates.find(aOrderId); found != rates.end())
+        {
+            return found->second;
+        }
+
+        if (rates.size() >= capacity)
+        {
+            // Simplest bound: the typical order has far fewer parents than the capacity.
+            rates.clear();
+        }
+        return rates.emplace(aOrderId, database.getOrder(aOrderId).fragmentsRate).first->second;
+    }
+
+    std::size_t size() const
+    { return rates.size(); }
+
+private:
+    Database & database;
+    std::size_t capacity;
+    std::unordered_map<decltype(Order::id), Decimal> rates;
+};
+
+
+/// \brief Flat buffer of the spawns of an order, consolidated to a single amount per target rate.
+///
+/// The buffer is meant to be reused from one order to the next, so it does not allocate once
+/// its capacity is sufficient.
+class SpawnBuffer
+{
+public:
+    struct Entry
+    {
+        Decimal rate;
+        Decimal base;
+        std::size_t sequence;
+    };
+
+    void clear()
+    { entries.clear(); }
+
+    template <class T_iterator>
+    void append(T_iterator aBegin, const T_iterator aEnd);
+
+    /// \brief Sort the entries by increasing rate, summing in place the amounts of identical rates.
+    ///
+    /// Amounts are summed in the order they were appended.
+    void consolidate();
+
+    const std::vector<Entry> & getEntries() const
+    { return entries; }
+
+private:
+    std::vector<Entry> entries;
+};
+
+
+template <class T_iterator>
+void SpawnBuffer::append(T_iterator aBegin, const T_iterator aEnd)
+{
+    for(; aBegin != aEnd; ++aBegin)
+    {
+        entries.push_back(Entry{aBegin->rate, aBegin->base, entries.size()});
+    }
+}
+
+
+inline void SpawnBuffer::consolidate()
+{
+    // std::sort does not allocate, contrary to std::stable_sort: the sequence keeps the append order.
+    std::sort(entries.begin(), entries.end(), [](const Entry & aLhs, const Entry & aRhs)
+            {
+                return aLhs.rate < aRhs.rate
+                       || (aLhs.rate == aRhs.rate && aLhs.sequence < aRhs.sequence);
+            });
+
+    auto consolidated = entries.begin();
+    for (auto entry = entries.begin(); entry != entries.end(); ++consolidated)
+    {
+        *consolidated = *entry;
+        for (++entry; entry != entries.end() && entry->rate == consolidated->rate; ++entry)
+        {
+            consolidated->base += entry->base;
+        }
+    }
+    entries.erase(consolidated, entries.end());
+}
+
+
 class SpawnerBase
 {
 public:
@@ -25,21 +134,79 @@ public:
     SpawnerBase(const SpawnerBase &) = delete;
     SpawnerBase & operator=(const SpawnerBase &) = delete;
 
+    /// \param aParents Gives the rate of the parent order of `aFilledFragment`,
+    /// it should be shared by all the fragments composing `aOrder`.
     virtual Result
     computeResultingFragments(const Fragment & aFilledFragment,
                               const FulfilledOrder & aOrder,
-                              Database & aDatabase) = 0;
+                              ParentOrders & aParents) = 0;
+
+    /// \brief Convenience overload for a single fragment.
+    Result
+    computeResultingFragments(const Fragment & aFilledFragment,
+                              const FulfilledOrder & aOrder,
+                              Database & aDatabase)
+    {
+        ParentOrders parents{aDatabase};
+        return computeResultingFragments(aFilledFragment, aOrder, parents);
+    }
+
+    /// \brief Compute the spawns of all the fragments composing `aOrder`, appending them to `aSpawns`
+    /// and assigning the taken home of each fragment.
+    ///
+    /// The default implementation makes a virtual call to `computeResultingFragments()` per fragment.
+    virtual void
+    computeOrderSpawns(std::vector<Fragment> & aFilledFragments,
+                       const FulfilledOrder & aOrder,
+                       ParentOrders & aParents,
+                       SpawnBuffer & aSpawns)
+    {
+        for (Fragment & fragment : aFilledFragments)
+        {
+            auto [spawns, takenHome] = computeResultingFragments(fragment, aOrder, aParents);
+            fragment.takenHome = std::move(takenHome);
+            aSpawns.append(spawns.begin(), spawns.end());
+        }
+    }
+};
+
+
+/// \brief Base for spawners implementing `computeOrderSpawns()` with static calls
+/// to `T_derived::computeResultingFragments()`, that the compiler can inline.
+///
+/// There is then a single virtual call per order, instead of one per fragment.
+template <class T_derived>
+class StaticSpawner : public SpawnerBase
+{
+public:
+    void
+    computeOrderSpawns(std::vector<Fragment> & aFilledFragments,
+                       const FulfilledOrder & aOrder,
+                       ParentOrders & aParents,
+                       SpawnBuffer & aSpawns) override
+    {
+        T_derived & derived = static_cast<T_derived &>(*this);
+        for (Fragment & fragment : aFilledFragments)
+        {
+            // Qualified call: not dispatched through the virtual table.
+            auto [spawns, takenHome] = derived.T_derived::computeResultingFragments(fragment, aOrder, aParents);
+            fragment.takenHome = std::move(takenHome);
+            aSpawns.append(spawns.begin(), spawns.end());
+        }
+    }
 };
 
 
 /// \brief Does not spawn any counter fragments.
-class NullSpawner : public SpawnerBase
+class NullSpawner : public StaticSpawner<NullSpawner>
 {
 public:
+    using SpawnerBase::computeResultingFragments;
+
     Result
     computeResultingFragments(const Fragment & aFilledFragment,
                               const FulfilledOrder & aOrder,
-                              Database & aDatabase) override
+                              ParentOrders & aParents) override
     {
         switch (aFilledFragment.side)
         {
@@ -6,45 +6,54 @@
 
 #include <boost/asio/post.hpp>
 
+#include <algorithm>
+
 
 namespace ad {
 namespace tradebot {
 
 
-RefreshTimer::RefreshTimer(MaintenanceOperation aOperation, Duration aPeriod) :
+RefreshTimer::RefreshTimer(MaintenanceOperation aOperation, Duration aPeriod, ThreadPool * aExecutor) :
     operation{std::move(aOperation)},
     period{std::move(aPeriod)},
+    ownedContext{aExecutor ? nullptr : std::make_unique<boost::asio::io_context>()},
+    strand{boost::asio::make_strand(aExecutor ? aExecutor->getContext() : *ownedContext)},
     timer{
-        ioContext,
+        strand,
         period
-    },
-    thread{
-        [this]()
-        {
-            try
-            {
-                async_wait();
-                ioContext.run();
-            }
-            catch (std::exception & aException)
-            {
-                spdlog::error("Refresh timer run was interrupted by exception: {}.",
-                              aException.what());
-            }
+    }
+{
+    async_wait();
 
-            if (! intendedClose)
+    if (ownedContext)
+    {
+        thread = std::thread{
+            [this]()
             {
-                spdlog::error("Refresh timer stopped without application consent.");
+                try
+                {
+                    ownedContext->run();
+                }
+                catch (std::exception & aException)
+                {
+                    spdlog::error("Refresh timer run was interrupted by exception: {}.",
+                                  aException.what());
+                }
+
+                if (! intendedClose)
+                {
+                    spdlog::error("Refresh timer stopped without application consent.");
+                }
             }
-        }
+        };
     }
-{}
+}
 
 
 RefreshTimer::~RefreshTimer()
 {
-    // This object cannot be destroyed until the io_context is done running
-    // so it is safe to capture it in a lambda executed on the io_context thread.
+    // This object cannot be destroyed until the last handler completed
+    // so it is safe to capture it in a lambda executed on the timer strand.
     boost::asio::post(
         timer.get_executor(),
         [this]
@@ -60,16 +69,54 @@ RefreshTimer::~RefreshTimer()
             intendedClose = true;
         });
 
-    thread.join(); // From this point, intendedClose is known to be `true`.
+    if (thread.joinable())
+    {
+        thread.join(); // From this point, intendedClose is known to be `true`.
+    }
+    else
+    {
+        // On a shared executor, wait for the single outstanding timer handler.
+        std::unique_lock<std::mutex> lock{stopMutex};
+        stopCondition.wait(lock, [this](){ return stopped; });
+    }
     spdlog::debug("Refresh timer successfully stopped.");
 }
 
 
+void RefreshTimer::trigger()
+{
+    boost::asio::post(
+        timer.get_executor(),
+        [this]
+        {
+            if (! intendedClose)
+            {
+                operation();
+            }
+        });
+}
+
+
 void RefreshTimer::onTimer(const boost::system::error_code & aErrorCode)
 {
-    if (aErrorCode == boost::asio::error::operation_aborted)
+    // timer closed value is changed in the strand running the handlers
+    // so it cannot race,
+    // and as importantly it cannot change value "in the middle" of the if body.
+    if (intendedClose)
     {
-        spdlog::debug("Refresh timer aborted.");
+        if (aErrorCode == boost::asio::error::operation_aborted)
+        {
+            spdlog::debug("Refresh timer aborted.");
+        }
+        else
+        {
+            spdlog::debug("Timer was closed while the handler was already queued. Not restarting it.");
+        }
+
+        // Notify while holding the lock: the destructor cannot complete before it is released.
+        std::scoped_lock<std::mutex> lock{stopMutex};
+        stopped = true;
+        stopCondition.notify_one();
         return;
     }
     else if (aErrorCode)
@@ -77,25 +124,23 @@ void RefreshTimer::onTimer(const boost::system::error_code & aErrorCode)
         spdlog::error("Error on refresh timer: {}. Will try to go on.", aErrorCode.message());
     }
 
-    // timer closed value is changed in the same thread running io_context
-    // so it cannot race,
-    // and as importantly it cannot change value "in the middle" of the if body.
-    if (! intendedClose)
+    try
     {
         operation();
-        timer.expires_after(period);
-        async_wait();
     }
-    else
+    catch (std::exception & aException)
     {
-        spdlog::debug("Timer was closed while the handler was already queued. Not restarting it.");
+        spdlog::error("Refresh timer operation raised an exception: {}. Will try to go on.",
+                      aException.what());
     }
+    timer.expires_after(period);
+    async_wait();
 }
 
 
 void RefreshTimer::async_wait()
 {
-    // The io_context running the completion handled is a data membmer of `this`
+    // The handler is guaranteed to complete before `this` is destroyed (see destructor).
     timer.async_wait(std::bind(&RefreshTimer::onTimer,
                                this,
                                std::placeholders::_1));
@@ -111,9 +156,13 @@ void onStreamReceive(const std::string & aMessage, Stream::ReceiveCallback aOnMe
 Stream::Stream(WebsocketDestination aDestination,
                ReceiveCallback aOnMessage,
                UnintendedCloseCallback aOnUnintededClose,
-               std::unique_ptr<RefreshTimer> aKeepAlive) :
+               std::unique_ptr<RefreshTimer> aKeepAlive,
+               ThreadPool * aExecutor,
+               net::WebSocket::Compression aCompression) :
     keepAlive{std::move(aKeepAlive)},
+    onUnintendedClose{std::move(aOnUnintededClose)},
     websocket{
+        aExecutor ? &aExecutor->getContext() : nullptr,
         // On connect
         [this]()
         {
@@ -122,57 +171,45 @@ Stream::Stream(WebsocketDestination aDestination,
                 std::scoped_lock<std::mutex> lock{mutex};
                 status = Connected;
             }
-            statusCondition.notify_one();
+            statusCondition.notify_all();
         },
         // On Message
         [onMessage = std::move(aOnMessage)](const std::string & aMessage)
         {
             onStreamReceive(aMessage, onMessage);
-        }
-    },
-    websocketThread{
-        [this,
-         destination = std::move(aDestination),
-         onUnintededClose = std::move(aOnUnintededClose)]()
+        },
+        // On close
+        [this]()
         {
-            try
-            {
-                websocket.run(destination.host, destination.port, destination.target);
-            }
-            catch (std::exception & aException)
-            {
-                spdlog::error("Websocket run was interrupted by exception: {}.", aException.what());
-            }
-
-            // Mark the stream as Done
-            Status previousStatus;
-            {
-                std::scoped_lock<std::mutex> lock{mutex};
-                previousStatus = status;
-                status = Done;
-            }
-            // Will unlock openUserStream() in case the websocket never connected.
-            statusCondition.notify_one();
+            onWebsocketDone();
+        }
+    }
+{
+    websocket.setCompression(aCompression);
 
-            // Note: there is still potential for the websocket to disconnect between the moment
-            // this flag is set to false and the moment websocket.async_close() does complete.
-            // Although this would still be an unintended close situation, no special case is made
-            // because the websocket not running anymore is what is wanted.
-            if (! intendedClose)
+    if (aExecutor)
+    {
+        websocket.async_run(aDestination.host, aDestination.port, aDestination.target);
+    }
+    else
+    {
+        websocketThread = std::thread{
+            [this, destination = std::move(aDestination)]()
             {
-                if (previousStatus == Status::Connected)
+                try
                 {
-                    spdlog::warn("User data stream websocket closed without application consent.");
+                    websocket.run(destination.host, destination.port, destination.target);
                 }
-                else if (previousStatus == Status::Initialize)
+                catch (std::exception & aException)
                 {
-                    spdlog::warn("User data stream websocket could not connect.");
+                    spdlog::error("Websocket run was interrupted by exception: {}.", aException.what());
                 }
-                onUnintededClose();
+                // No-op if the close callback already completed.
+                onWebsocketDone();
             }
-        }
+        };
     }
-{}
+}
 
 
 Stream::~Stream()
@@ -194,10 +231,544 @@ Stream::~Stream()
 
     intendedClose = true;
     websocket.async_close();
-    websocketThread.join();
+    if (websocketThread.joinable())
+    {
+        websocketThread.join();
+    }
+    else
+    {
+        // On a shared executor, wait for the websocket to stop running.
+        std::unique_lock<std::mutex> lock{mutex};
+        statusCondition.wait(lock, [this](){ return status == Status::Done; });
+    }
     spdlog::debug("Exchange stream successfully closed.");
 }
 
 
+void Stream::onWebsocketDone()
+{
+    Status previousStatus;
+    {
+        std::scoped_lock<std::mutex> lock{mutex};
+        if (status == Status::Done)
+        {
+            return;
+        }
+        previousStatus = status;
+    }
+
+    // Note: there is still potential for the websocket to disconnect between the moment
+    // this flag is set to false and the moment websocket.async_close() does complete.
+    // Although this would still be an unintended close situation, no special case is made
+    // because the websocket not running anymore is what is wanted.
+    if (! intendedClose)
+    {
+        if (previousStatus == Status::Connected)
+        {
+            spdlog::warn("User data stream websocket closed without application consent.");
+        }
+        else if (previousStatus == Status::Initialize)
+        {
+            spdlog::warn("User data stream websocket could not connect.");
+        }
+        onUnintendedClose();
+    }
+
+    // Mark the stream as Done
+    // Will unlock openUserStream() in case the websocket never connected.
+    // Notified while holding the lock: the destructor might be waiting for this status,
+    // so `this` must not be accessed once the lock is released.
+    std::scoped_lock<std::mutex> lock{mutex};
+    status = Done;
+    statusCondition.notify_all();
+}
+
+
+bool Stream::async_send(const std::string & aMessage)
+{
+    return websocket.async_send(aMessage);
+}
+
+
+bool Stream::waitConnection()
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    statusCondition.wait(lock, [this]()
+                               {
+                                   return status != Status::Initialize;
+                               });
+    return status == Status::Connected;
+}
+
+
+bool Stream::isConnected()
+{
+    std::scoped_lock<std::mutex> lock{mutex};
+    return status == Status::Connected;
+}
+
+
+net::WebSocket::Statistics Stream::getStatistics() const
+{
+    return websocket.getStatistics();
+}
+
+
+bool Stream::isDone()
+{
+    std::scoped_lock<std::mutex> lock{mutex};
+    return status == Status::Done;
+}
+
+
+void Stream::async_close()
+{
+    intendedClose = true;
+    websocket.async_close();
+}
+
+
+StreamRouter::StreamRouter(Handlers aHandlers) :
+    handlers{std::move(aHandlers)}
+{}
+
+
+void StreamRouter::route(Json aMessage)
+{
+    if (auto streamName = aMessage.find("stream"); streamName != aMessage.end())
+    {
+        Stream::ReceiveCallback handler;
+        {
+            std::scoped_lock<std::mutex> lock{mutex};
+            if (auto found = handlers.find(streamName->get<std::string>()); found != handlers.end())
+            {
+                // Copied, so the handler is not invoked while holding the lock.
+                handler = found->second;
+            }
+        }
+
+        if (handler)
+        {
+            handler(std::move(aMessage.at("data")));
+        }
+        else
+        {
+            // Messages might still arrive for a short period after unsubscribing.
+            spdlog::trace("No handler for combined stream '{}', message discarded.",
+                          streamName->get<std::string>());
+        }
+    }
+    // Responses to live requests
+    else if (aMessage.contains("id"))
+    {
+        if (aMessage.contains("error"))
+        {
+            spdlog::error("Combined stream request {} failed: {}.",
+                          aMessage.at("id").dump(),
+                          aMessage.at("error").dump());
+        }
+        else
+        {
+            spdlog::debug("Combined stream request {} succeeded.", aMessage.at("id").dump());
+        }
+    }
+    else
+    {
+        spdlog::warn("Unexpected message on combined stream: {}.", aMessage.dump());
+    }
+}
+
+
+void StreamRouter::add(const std::string & aStreamName, Stream::ReceiveCallback aOnMessage)
+{
+    std::scoped_lock<std::mutex> lock{mutex};
+    handlers.insert_or_assign(aStreamName, std::move(aOnMessage));
+}
+
+
+void StreamRouter::remove(const std::string & aStreamName)
+{
+    std::scoped_lock<std::mutex> lock{mutex};
+    handlers.erase(aStreamName);
+}
+
+
+std::vector<std::string> StreamRouter::listStreams() const
+{
+    std::scoped_lock<std::mutex> lock{mutex};
+    std::vector<std::string> result;
+    std::transform(handlers.begin(), handlers.end(), std::back_inserter(result),
+                   [](const auto & aEntry)
+                   {
+                       return aEntry.first;
+                   });
+    return result;
+}
+
+
+std::string StreamRouter::makeRequest(const std::string & aMethod,
+                                      const std::vector<std::string> & aStreamNames)
+{
+    return Json{
+        {"method", aMethod},
+        {"params", aStreamNames},
+        {"id", nextRequestId++},
+    }.dump();
+}
+
+
+namespace {
+
+
+void accumulate(net::WebSocket::Statistics & aTotal, const net::WebSocket::Statistics & aStatistics)
+{
+    aTotal.messagesReceived += aStatistics.messagesReceived;
+    aTotal.messagesSent += aStatistics.messagesSent;
+    aTotal.payloadBytesReceived += aStatistics.payloadBytesReceived;
+    aTotal.payloadBytesSent += aStatistics.payloadBytesSent;
+    aTotal.wireBytesReceived += aStatistics.wireBytesReceived;
+    aTotal.wireBytesSent += aStatistics.wireBytesSent;
+}
+
+
+void logStatistics(const std::string & aContext, const net::WebSocket::Statistics & aStatistics)
+{
+    spdlog::info("{}: received {} messages, {} payload bytes for {} bytes on the wire ({:.1f}%).",
+                 aContext,
+                 aStatistics.messagesReceived,
+                 aStatistics.payloadBytesReceived,
+                 aStatistics.wireBytesReceived,
+                 aStatistics.payloadBytesReceived == 0 ?
+                    0. : 100. * aStatistics.wireBytesReceived / aStatistics.payloadBytesReceived);
+}
+
+
+} // anonymous namespace
+
+
+RollingStream::RollingStream(WebsocketDestination aDestination,
+                             Stream::ReceiveCallback aOnMessage,
+                             Stream::UnintendedCloseCallback aOnGap,
+                             SequenceExtractor aExtractSequence,
+                             Options aOptions,
+                             ThreadPool * aExecutor) :
+    destination{std::move(aDestination)},
+    onMessage{std::move(aOnMessage)},
+    onGap{std::move(aOnGap)},
+    extractSequence{std::move(aExtractSequence)},
+    options{std::move(aOptions)},
+    executor{aExecutor},
+    healthCheck{std::make_unique<RefreshTimer>(std::bind(&RollingStream::maintain, this),
+                                               options.checkPeriod,
+                                               executor)}
+{
+    std::scoped_lock<std::mutex> lock{mutex};
+    active = connect();
+}
+
+
+RollingStream::~RollingStream()
+{
+    std::vector<std::unique_ptr<Connection>> connections;
+    {
+        std::scoped_lock<std::mutex> lock{mutex};
+        closing = true;
+        connections = std::move(retired);
+        connections.push_back(std::move(active));
+        connections.push_back(std::move(replacement));
+    }
+    // Waits for the websockets to stop, they might be waiting on the mutex to deliver a message.
+    connections.clear();
+    // The close callbacks of the connections might trigger the health check until this point.
+    healthCheck.reset();
+}
+
+
+net::WebSocket::Statistics RollingStream::getStatistics()
+{
+    std::scoped_lock<std::mutex> lock{mutex};
+    net::WebSocket::Statistics result = pastStatistics;
+    for (const auto & connection : retired)
+    {
+        accumulate(result, connection->stream->getStatistics());
+    }
+    for (const Connection * connection : {active.get(), replacement.get()})
+    {
+        if (connection)
+        {
+            accumulate(result, connection->stream->getStatistics());
+        }
+    }
+    return result;
+}
+
+
+bool RollingStream::waitConnection()
+{
+    Stream * initial;
+    {
+        std::scoped_lock<std::mutex> lock{mutex};
+        initial = active->stream.get();
+    }
+    return initial->waitConnection();
+}
+
+
+std::unique_ptr<RollingStream::Connection> RollingStream::connect()
+{
+    auto connection = std::make_unique<Connection>();
+    // The connection is heap allocated, so its address is stable for the callbacks.
+    Connection * raw = connection.get();
+    connection->stream = std::make_unique<Stream>(
+        destination,
+        [this, raw](Json aMessage)
+        {
+            raw->lastReceived = Clock::now().time_since_epoch().count();
+            deliver(*raw, std::move(aMessage));
+        },
+        [this, raw]()
+        {
+            raw->closed = true;
+            healthCheck->trigger();
+        },
+        nullptr,
+        executor,
+        options.compression);
+    return connection;
+}
+
+
+void RollingStream::deliver(Connection & aConnection, Json aMessage)
+{
+    std::optional<Sequence> sequence = extractSequence(aMessage);
+
+    std::scoped_lock<std::mutex> lock{mutex};
+    if (! sequence)
+    {
+        if (&aConnection == active.get())
+        {
+            onMessage(std::move(aMessage));
+        }
+        return;
+    }
+
+    if (&aConnection == active.get())
+    {
+        if (sequencer.receiveActive(*sequence))
+        {
+            onMessage(std::move(aMessage));
+        }
+    }
+    else if (&aConnection == replacement.get())
+    {
+        sequencer.receiveReplacement(std::move(aMessage), *sequence);
+    }
+    else
+    {
+        // Retired connection.
+        return;
+    }
+
+    if (replacement && sequencer.isOverlapping())
+    {
+        spdlog::info("Switching over to the replacement stream connection.");
+        switchOver();
+    }
+}
+
+
+void RollingStream::switchOver()
+{
+    for (Json & message : sequencer.switchOver())
+    {
+        onMessage(std::move(message));
+    }
+    retire(std::exchange(active, std::move(replacement)));
+}
+
+
+void RollingStream::maintain()
+{
+    // Destroyed after the mutex is released.
+    std::vector<std::unique_ptr<Connection>> done;
+    bool gap = false;
+    {
+        std::scoped_lock<std::mutex> lock{mutex};
+        if (closing)
+        {
+            return;
+        }
+
+        // Connections are closed asynchronously: waiting for them here could block the executor
+        // thread needed to complete their close.
+        auto stillClosing = std::partition(retired.begin(), retired.end(),
+                                           [](const auto & aConnection)
+                                           {
+                                               return ! aConnection->stream->isDone();
+                                           });
+        std::move(stillClosing, retired.end(), std::back_inserter(done));
+        retired.erase(stillClosing, retired.end());
+        for (const auto & connection : done)
+        {
+            net::WebSocket::Statistics statistics = connection->stream->getStatistics();
+            logStatistics("Closed stream connection", statistics);
+            accumulate(pastStatistics, statistics);
+        }
+
+        const Clock::time_point now = Clock::now();
+
+        if (replacement && replacement->closed)
+        {
+            spdlog::warn("Replacement stream connection closed before switch over, will retry.");
+            retire(std::move(replacement));
+            // Do not reopen during the same pass: retrying at the next period prevents a tight
+            // reconnection loop when the replacement cannot connect.
+            return;
+        }
+
+        // The switch over on overlap is made as the messages are delivered.
+        if (replacement && replacement->stream->isConnected())
+        {
+            bool timedOut = (now - replacement->openedAt) >= options.switchoverTimeout;
+            if (active->closed || timedOut)
+            {
+                spdlog::warn("Switching over to the replacement stream connection without observed overlap,"
+                             " messages might have been missed.");
+                gap = true;
+                switchOver();
+            }
+        }
+        else if (! replacement)
+        {
+            if (active->closed)
+            {
+                spdlog::warn("Stream connection closed without a replacement, reconnecting.");
+                replacement = connect();
+            }
+            else if ((now - active->openedAt) >= options.rolloverAge)
+            {
+                spdlog::info("Stream connection is close to the server deadline, opening its replacement.");
+                replacement = connect();
+            }
+            else if (options.staleAfter != Clock::duration::zero()
+                     && (now - active->lastActivity()) >= options.staleAfter)
+            {
+                spdlog::warn("Stream connection did not receive any message for {} seconds, opening its replacement.",
+                             std::chrono::duration_cast<std::chrono::seconds>(options.staleAfter).count());
+                replacement = connect();
+            }
+
+            if (replacement)
+            {
+                sequencer.resetReplacement();
+            }
+        }
+    }
+
+    done.clear();
+    if (gap)
+    {
+        onGap();
+    }
+}
+
+
+void RollingStream::retire(std::unique_ptr<Connection> aConnection)
+{
+    aConnection->stream->async_close();
+    retired.push_back(std::move(aConnection));
+}
+
+
+bool SwitchoverSequencer::receiveActive(const StreamSequence & aSequence)
+{
+    auto [delivered, inserted] = deliveredIds.try_emplace(aSequence.channel, aSequence.id);
+    if (! inserted)
+    {
+        if (aSequence.id <= delivered->second)
+        {
+            return false;
+        }
+        delivered->second = aSequence.id;
+    }
+    return true;
+}
+
+
+void SwitchoverSequencer::receiveReplacement(Json aMessage, const StreamSequence & aSequence)
+{
+    auto [received, inserted] =
+        replacementIds.try_emplace(aSequence.channel, Received{aSequence.id, aSequence.id});
+    if (! inserted)
+    {
+        received->second.last = std::max(received->second.last, aSequence.id);
+    }
+    held.push_back({std::move(aMessage), aSequence});
+}
+
+
+bool SwitchoverSequencer::isOverlapping() const
+{
+    if (replacementIds.empty())
+    {
+        return false;
+    }
+    for (const auto & [channel, received] : replacementIds)
+    {
+        auto delivered = deliveredIds.find(channel);
+        if (delivered == deliveredIds.end() || delivered->second < received.first)
+        {
+            // Messages between the last delivered and the first received by the replacement might exist.
+            return false;
+        }
+    }
+    return true;
+}
+
+
+std::vector<Json> SwitchoverSequencer::switchOver()
+{
+    std::vector<Json> result;
+    for (Held & message : held)
+    {
+        if (receiveActive(message.sequence))
+        {
+            result.push_back(std::move(message.message));
+        }
+    }
+    resetReplacement();
+    return result;
+}
+
+
+void SwitchoverSequencer::resetReplacement()
+{
+    replacementIds.clear();
+    held.clear();
+}
+
+
+std::optional<RollingStream::Sequence> RollingStream::marketStreamSequence(const Json & aMessage)
+{
+    std::string channel;
+    const Json * payload = &aMessage;
+    if (auto stream = aMessage.find("stream"); stream != aMessage.end() && aMessage.contains("data"))
+    {
+        channel = stream->get<std::string>();
+        payload = &aMessage.at("data");
+    }
+
+    // Aggregate trade id, order book update id, partial book depth update id, trade id.
+    for (const char * key : {"a", "u", "lastUpdateId", "t"})
+    {
+        if (auto id = payload->find(key); id != payload->end() && id->is_number_integer())
+        {
+            return Sequence{std::move(channel), id->get<long long>()};
+        }
+    }
+    return std::nullopt;
+}
+
+
 } // namespace tradebot
 } // namespace ad
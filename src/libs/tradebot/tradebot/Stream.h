@@ -1,15 +1,23 @@
 #pragma once
 
 
+#include "ThreadPool.h"
+
 #include <binance/Api.h>
 
 #include <websocket/WebSocket.h>
 
 #include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
 
+#include <chrono>
 #include <condition_variable>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <thread>
+#include <vector>
 
 
 namespace ad {
@@ -28,11 +36,17 @@ public:
     using MaintenanceOperation = std::function<void(void)>;
     using Duration = std::chrono::milliseconds;
 
-    RefreshTimer(MaintenanceOperation aOperation, Duration aPeriod);
+    /// \param aExecutor If provided, the timer runs on this shared executor.
+    /// Otherwise, it starts its own thread.
+    RefreshTimer(MaintenanceOperation aOperation, Duration aPeriod, ThreadPool * aExecutor = nullptr);
     ~RefreshTimer();
 
     void async_wait();
 
+    /// \brief Runs the operation as soon as possible on the timer thread,
+    /// without affecting the period.
+    void trigger();
+
 private:
     void onTimer(const boost::system::error_code & aErrorCode);
 
@@ -41,9 +55,16 @@ private:
     Duration period;
 
     bool intendedClose{false};
-    boost::asio::io_context ioContext;
+    // Only set when the timer does not run on a shared executor.
+    std::unique_ptr<boost::asio::io_context> ownedContext;
+    boost::asio::strand<boost::asio::io_context::executor_type> strand;
     boost::asio::steady_timer timer;
     std::thread thread;
+
+    // Allows the destructor to wait for the last handler, when running on a shared executor.
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    bool stopped{false};
 };
 
 
@@ -74,18 +95,50 @@ public:
     using UnintendedCloseCallback = std::function<void(void)>;
 
     // Made public so std::optional::emplace can access it
+    /// \param aExecutor If provided, the websocket runs on this shared executor.
+    /// Otherwise, it starts its own thread.
+    /// \param aCompression The permessage-deflate settings offered to the server.
     Stream(WebsocketDestination aDestination,
            ReceiveCallback aOnMessage,
            UnintendedCloseCallback aOnUnintededClose,
-           std::unique_ptr<RefreshTimer> aKeepAlive = nullptr);
+           std::unique_ptr<RefreshTimer> aKeepAlive = nullptr,
+           ThreadPool * aExecutor = nullptr,
+           net::WebSocket::Compression aCompression = {});
     ~Stream();
 
+    /// \brief Queue a message to be sent on the stream websocket, thread safe.
+    /// \return `false` if the outbound queue is full, the message is then dropped.
+    bool async_send(const std::string & aMessage);
+
+    /// \brief Blocks until the websocket either connects or fails to do so.
+    ///
+    /// \return `true` if the websocket connected successfully, `false` otherwise.
+    bool waitConnection();
+
+    /// \brief Non-blocking: `true` if the websocket is currently connected.
+    bool isConnected();
+
+    /// \brief Non-blocking: `true` once the websocket stopped running.
+    bool isDone();
+
+    /// \brief Thread safe.
+    net::WebSocket::Statistics getStatistics() const;
+
+    /// \brief Requests the websocket to close, without waiting for it to complete.
+    ///
+    /// This is an intended close, so the unintended close callback will not be invoked.
+    /// The destructor still waits for the websocket to stop running.
+    void async_close();
+
 private:
     Stream(const Stream &) = delete;
     Stream(Stream &&) = delete;
     Stream & operator = (const Stream &) = delete;
     Stream & operator = (Stream &&) = delete;
 
+    /// \brief Invoked once the websocket stopped running.
+    void onWebsocketDone();
+
     // Synchronization mechanism for status variable (allowing to wait for connection)
     std::mutex mutex;
     std::condition_variable statusCondition;
@@ -94,11 +147,211 @@ private:
     // An optional refresh timer, if periodic refresh is needed by the connected stream.
     std::unique_ptr<RefreshTimer> keepAlive;
 
-    net::WebSocket websocket;
+    UnintendedCloseCallback onUnintendedClose;
     std::atomic<bool> intendedClose{false}; // accessed from both the thread destruction stream an the inner thread.
+    net::WebSocket websocket;
+    // Only started when the websocket does not run on a shared executor.
     std::thread websocketThread;
 };
 
 
+/// \brief Dispatches the messages of a Binance combined stream to a handler per stream name.
+///
+/// Combined stream messages are wrapped as `{"stream":"<streamName>","data":<rawPayload>}`,
+/// the handler registered for `streamName` receives the raw payload.
+/// Handlers can be added and removed while the stream is running,
+/// they are invoked from the thread running the websocket.
+class StreamRouter
+{
+public:
+    using Handlers = std::map<std::string, Stream::ReceiveCallback>;
+
+    explicit StreamRouter(Handlers aHandlers = {});
+
+    void route(Json aMessage);
+
+    void add(const std::string & aStreamName, Stream::ReceiveCallback aOnMessage);
+    void remove(const std::string & aStreamName);
+
+    std::vector<std::string> listStreams() const;
+
+    /// \brief Returns the payload of a live request (SUBSCRIBE, UNSUBSCRIBE, ...)
+    /// on the combined stream.
+    std::string makeRequest(const std::string & aMethod,
+                            const std::vector<std::string> & aStreamNames);
+
+private:
+    mutable std::mutex mutex;
+    Handlers handlers;
+    std::atomic<long> nextRequestId{1};
+};
+
+
+/// \brief The channel and sequence id of a stream message.
+struct StreamSequence
+{
+    std::string channel;
+    long long id;
+};
+
+
+/// \brief Delivery state of a `RollingStream`, so each sequenced message is delivered once and in order
+/// across the switch over from the active connection to its replacement.
+///
+/// The two connections can lag each other either way. The messages of the replacement are held back
+/// until, on each channel it received, the active connection delivered a message the replacement
+/// also received. From there, the replacement covers all the messages the active connection did not deliver.
+class SwitchoverSequencer
+{
+public:
+    /// \brief Record a message of the active connection.
+    /// \return True if the message was not delivered yet, and must be.
+    bool receiveActive(const StreamSequence & aSequence);
+
+    /// \brief Hold back a message of the replacement connection.
+    void receiveReplacement(Json aMessage, const StreamSequence & aSequence);
+
+    /// \return True if the replacement received messages, and overlaps the delivered messages
+    /// on each of their channels.
+    bool isOverlapping() const;
+
+    /// \brief Make the replacement the active connection.
+    /// \return The held back messages which were not delivered yet, in reception order.
+    std::vector<Json> switchOver();
+
+    /// \brief Forget the replacement state, when a new replacement is opened.
+    void resetReplacement();
+
+private:
+    struct Received
+    {
+        long long first;
+        long long last;
+    };
+
+    struct Held
+    {
+        Json message;
+        StreamSequence sequence;
+    };
+
+    std::map<std::string, long long> deliveredIds;
+    std::map<std::string, Received> replacementIds;
+    std::vector<Held> held;
+};
+
+
+/// \brief A market stream replacing its websocket connection before Binance closes it,
+/// so no message is missed across reconnections (make-before-break).
+///
+/// Binance closes stream connections after 24 hours. A replacement connection is opened
+/// when the active connection gets close to this deadline, when it stops receiving messages
+/// for too long, or when it closes unexpectedly.
+/// Both connections are read concurrently until the replacement is proven to be in sync
+/// (see `SwitchoverSequencer`), at which point the previous connection is closed.
+///
+/// Messages are de-duplicated by their sequence id (e.g. the aggregate trade id),
+/// independently for each channel. Messages without sequence id are only delivered from
+/// the active connection.
+///
+/// \note The receive callback is invoked while holding a lock, which guarantees the ordering
+/// of messages coming from distinct connections. It should return quickly.
+class RollingStream
+{
+public:
+    using Sequence = StreamSequence;
+
+    /// \brief Returns the channel and sequence id of a message, if it has one.
+    using SequenceExtractor = std::function<std::optional<Sequence>(const Json &)>;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        /// \brief Age at which a connection is replaced, before Binance closes it at 24h.
+        Clock::duration rolloverAge{std::chrono::hours{23}};
+        /// \brief A connection not receiving any message for this long is replaced.
+        /// A zero duration disables this check.
+        Clock::duration staleAfter{Clock::duration::zero()};
+        /// \brief If no overlap was observed after this long (e.g. no trades on the market),
+        /// the replacement is promoted anyway.
+        Clock::duration switchoverTimeout{std::chrono::minutes{2}};
+        /// \brief Period at which the health of the connections is checked.
+        RefreshTimer::Duration checkPeriod{std::chrono::seconds{5}};
+        /// \brief permessage-deflate settings of each connection.
+        net::WebSocket::Compression compression{};
+    };
+
+    /// \param aOnGap Invoked when the active connection closed before a replacement was in sync,
+    /// so messages might have been missed.
+    RollingStream(WebsocketDestination aDestination,
+                  Stream::ReceiveCallback aOnMessage,
+                  Stream::UnintendedCloseCallback aOnGap,
+                  SequenceExtractor aExtractSequence,
+                  Options aOptions,
+                  ThreadPool * aExecutor = nullptr);
+    ~RollingStream();
+
+    /// \brief Blocks until the initial connection either connects or fails to do so.
+    bool waitConnection();
+
+    /// \brief Statistics of all the connections, including the replaced ones. Thread safe.
+    net::WebSocket::Statistics getStatistics();
+
+    /// \brief Default sequence extractor, for both raw and combined market streams.
+    ///
+    /// Uses the aggregate trade id, the order book update id or the trade id,
+    /// whichever the message has. The channel is the stream name for combined streams.
+    static std::optional<Sequence> marketStreamSequence(const Json & aMessage);
+
+private:
+    struct Connection
+    {
+        Clock::time_point openedAt{Clock::now()};
+        std::atomic<Clock::rep> lastReceived{0}; // 0 while nothing was received
+        std::atomic<bool> closed{false};
+        std::unique_ptr<Stream> stream;
+
+        /// \brief Time of the last received message, or of the opening if none was received.
+        Clock::time_point lastActivity() const
+        {
+            Clock::rep received = lastReceived;
+            return received == 0 ? openedAt : Clock::time_point{Clock::duration{received}};
+        }
+    };
+
+    RollingStream(const RollingStream &) = delete;
+    RollingStream & operator = (const RollingStream &) = delete;
+
+    std::unique_ptr<Connection> connect();
+    void deliver(Connection & aConnection, Json aMessage);
+    /// \brief Promotes the replacement, delivering its held back messages. Requires the mutex.
+    void switchOver();
+    /// \brief Requests the connection to close, it is destroyed once done. Requires the mutex.
+    void retire(std::unique_ptr<Connection> aConnection);
+    /// \brief Runs on the health check timer thread.
+    void maintain();
+
+    WebsocketDestination destination;
+    Stream::ReceiveCallback onMessage;
+    Stream::UnintendedCloseCallback onGap;
+    SequenceExtractor extractSequence;
+    Options options;
+    ThreadPool * executor;
+
+    // Protects the connection pointers and the delivery state.
+    std::mutex mutex;
+    std::unique_ptr<Connection> active;
+    std::unique_ptr<Connection> replacement;
+    std::vector<std::unique_ptr<Connection>> retired;
+    SwitchoverSequencer sequencer;
+    // Accumulates the statistics of the destroyed connections.
+    net::WebSocket::Statistics pastStatistics;
+    bool closing{false};
+
+    std::unique_ptr<RefreshTimer> healthCheck;
+};
+
+
 } // namespace tradebot
 } // namespace ad
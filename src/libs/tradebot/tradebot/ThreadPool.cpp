@@ -0,0 +1,97 @@
+#include "ThreadPool.h"
+
+#include <spdlog/spdlog.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace ad {
+namespace tradebot {
+
+
+namespace {
+
+
+void pinCurrentThread(int aCpu)
+{
+#if defined(__linux__)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(aCpu, &cpuSet);
+    if (int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet); error != 0)
+    {
+        spdlog::error("Cannot pin executor thread to CPU {}, error code {}.", aCpu, error);
+    }
+    else
+    {
+        spdlog::debug("Executor thread pinned to CPU {}.", aCpu);
+    }
+#else
+    spdlog::warn("CPU pinning is not supported on this platform, ignoring CPU {}.", aCpu);
+#endif
+}
+
+
+} // anonymous namespace
+
+
+ThreadPool::ThreadPool(std::size_t aThreadCount, std::vector<int> aCpus) :
+    cpus{std::move(aCpus)},
+    ioContext{static_cast<int>(aThreadCount)}, // concurrency hint
+    workGuard{boost::asio::make_work_guard(ioContext)}
+{
+    if (aThreadCount == 0)
+    {
+        spdlog::critical("An executor requires at least one thread.");
+        throw std::invalid_argument{"Executor thread count must be positive."};
+    }
+
+    for (std::size_t index = 0; index != aThreadCount; ++index)
+    {
+        threads.emplace_back(&ThreadPool::runThread, this, index);
+    }
+    spdlog::info("Executor started with {} thread(s).", aThreadCount);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    workGuard.reset();
+    ioContext.stop();
+    for (std::thread & thread : threads)
+    {
+        thread.join();
+    }
+    spdlog::debug("Executor successfully stopped.");
+}
+
+
+void ThreadPool::runThread(std::size_t aIndex)
+{
+    if (! cpus.empty())
+    {
+        pinCurrentThread(cpus[aIndex % cpus.size()]);
+    }
+
+    // An exception escaping a handler must not stop the thread,
+    // other websockets and timers are sharing it.
+    for (;;)
+    {
+        try
+        {
+            ioContext.run();
+            break;
+        }
+        catch (std::exception & aException)
+        {
+            spdlog::error("Executor handler raised an exception: {}. Resuming.", aException.what());
+        }
+    }
+}
+
+
+} // namespace tradebot
+} // namespace ad
@@ -0,0 +1,62 @@
+#pragma once
+
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <thread>
+#include <vector>
+
+
+namespace ad {
+namespace tradebot {
+
+
+/// \brief A fixed number of threads running a single shared io_context.
+///
+/// Allows several websockets and timers to share a few threads,
+/// instead of each owning a thread and an io_context.
+/// The handlers of each websocket or timer are serialized through their own strand.
+class ThreadPool
+{
+public:
+    /// \param aThreadCount Number of threads running the io_context.
+    /// \param aCpus If not empty, each thread is pinned to a CPU from this list (in a round-robin fashion).
+    explicit ThreadPool(std::size_t aThreadCount = 1, std::vector<int> aCpus = {});
+
+    /// \attention All the websockets and timers using the pool should be closed
+    /// before it is destroyed, pending handlers are not executed.
+    ~ThreadPool();
+
+    boost::asio::io_context & getContext();
+
+    std::size_t size() const;
+
+private:
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator = (const ThreadPool &) = delete;
+
+    void runThread(std::size_t aIndex);
+
+    std::vector<int> cpus;
+    boost::asio::io_context ioContext;
+    // Keeps the threads running while there is no pending work.
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> workGuard;
+    std::vector<std::thread> threads;
+};
+
+
+inline boost::asio::io_context & ThreadPool::getContext()
+{
+    return ioContext;
+}
+
+
+inline std::size_t ThreadPool::size() const
+{
+    return threads.size();
+}
+
+
+} // namespace tradebot
+} // namespace ad
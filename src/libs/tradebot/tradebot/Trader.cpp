@@ -2,8 +2,13 @@
 
 #include "Logging.h"
 
+#include <boost/asio/post.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
 
 namespace ad {
 namespace tradebot {
@@ -74,7 +79,8 @@ void Trader::sendExistingOrder(Execution aExecution, Order & aOrder)
     // Send the order to the exchange
     database.update(aOrder.setStatus(Order::Status::Sending));
     // Note: placeOrder() marks the order Active.
-    database.update(exchange.placeOrder(aOrder, aExecution));
+    // An order left Sending is resolved against the exchange by cleanup(), this write can be deferred.
+    database.updateDeferred(exchange.placeOrder(aOrder, aExecution));
 }
 
 
@@ -173,73 +179,38 @@ bool Trader::cancel(Order & aOrder)
 }
 
 
-struct SpawnMap
-{
-    template <class T_iterator>
-    void appendFrom(FragmentId aParent, T_iterator aBegin, const T_iterator aEnd)
-    {
-        for(; aBegin != aEnd; ++aBegin)
-        {
-            data[aBegin->rate].emplace_back(aParent, aBegin->base);
-        }
-    }
-
-    std::map<
-        Decimal /*target price*/,
-        std::vector<
-            std::pair<FragmentId /*parent*/, Decimal /*spawned base amount*/>
-        >
-    > data;
-};
-
-
-std::vector<Fragment> consolidate(const SpawnMap & aSpawnMap,
-                                  const FulfilledOrder & aSpawningOrder)
-{
-    std::vector<Fragment> result;
-    for (const auto & rateEntry : aSpawnMap.data)
-    {
-        Decimal accumulatedBaseAmount = std::accumulate(
-                rateEntry.second.begin(), rateEntry.second.end(),
-                Decimal{0},
-                [](const Decimal & acc, const auto & pair)
-                {
-                    return acc + pair.second;
-                });
-        result.push_back(Fragment{
-                aSpawningOrder.base,
-                aSpawningOrder.quote,
-                accumulatedBaseAmount,
-                rateEntry.first,
-                reverse(aSpawningOrder.side),
-                0, /* taken home */
-                aSpawningOrder.id});
-    }
-    return result;
-}
-
-
 void Trader::spawnFragments(const FulfilledOrder & aOrder)
 {
-    SpawnMap spawnMap;
-
-    for(Fragment & fragment : database.getFragmentsComposing(aOrder))
-    {
-        auto [spawns, takenHome] =
-            spawner->computeResultingFragments(fragment, aOrder, database);
-
-        fragment.takenHome = std::move(takenHome);
-        database.update(fragment);
-
-        spawnMap.appendFrom(fragment.id, spawns.begin(), spawns.end());
-    }
-
-    for (Fragment & newFragment : consolidate(spawnMap, aOrder))
+    spawnBuffer.clear();
+    // Parent orders are shared by many of the fragments.
+    ParentOrders parents{database};
+
+    std::vector<Fragment> fragments = database.getFragmentsComposing(aOrder);
+    spawner->computeOrderSpawns(fragments, aOrder, parents, spawnBuffer);
+    // The totals are updated once for the whole order.
+    database.recordTakenHome(aOrder, fragments);
+
+    spawnBuffer.consolidate();
+
+    // A single fragment is reused for all the inserts.
+    Fragment newFragment{
+        aOrder.base,
+        aOrder.quote,
+        0,
+        0,
+        reverse(aOrder.side),
+        0, /* taken home */
+        aOrder.id
+    };
+    for (const SpawnBuffer::Entry & spawn : spawnBuffer.getEntries())
     {
         // Use isEqual to remove rounding errors that would make it just above zero
         // and also discard invalid negative amounts, in case they arise.
-        if (! isEqual(newFragment.baseAmount, 0) && newFragment.baseAmount > 0)
+        if (! isEqual(spawn.base, 0) && spawn.base > 0)
         {
+            newFragment.baseAmount = spawn.base;
+            newFragment.targetRate = spawn.rate;
+            newFragment.id = -1;
             database.insert(newFragment);
         }
         else
@@ -247,7 +218,7 @@ void Trader::spawnFragments(const FulfilledOrder & aOrder)
             spdlog::warn("Spawning fragments for order '{}' proposed a fragment with invalid amount {}."
                           " Ignoring it.",
                           aOrder.getIdentity(),
-                          newFragment.baseAmount);
+                          spawn.base);
         }
     }
 }
@@ -267,9 +238,10 @@ stats::Balance Trader::assembleBalance()
     auto computePotential = [&](const Side aSide) -> std::pair<Decimal /*base*/, Decimal /*quote*/>
     {
         std::pair<Decimal, Decimal> accumulators{0, 0};
-        for(const auto & fragment : database.getUnassociatedFragments(aSide, pair))
+        // Fragments are summed per rate by the database, so memory does not grow with their count.
+        for(const RateFragments & fragments : database.sumUnassociatedFragments(aSide, pair))
         {
-            trade::Spawn spawn{fragment.targetRate, trade::Base(fragment.baseAmount)};
+            trade::Spawn spawn{fragments.rate, trade::Base(fragments.baseAmount)};
             accumulators.first = trade::accumulateAmount<trade::Base>(accumulators.first, spawn);
             accumulators.second = trade::accumulateAmount<trade::Quote>(accumulators.second, spawn);
         }
@@ -308,6 +280,7 @@ bool Trader::completeFulfilledOrder(const FulfilledOrder & aFulfilledOrder)
     }
 
     database.commit(std::move(transaction));
+    latency->onCommitted();
     return result;
 }
 
@@ -370,7 +343,7 @@ void Trader::cleanup()
 
 void Trader::recordLaunch()
 {
-    database.insert(stats::Launch{});
+    database.insertDeferred(stats::Launch{});
 }
 
 
@@ -378,7 +351,7 @@ void Trader::recordBalance(const MillisecondsSinceEpoch aTime)
 {
     stats::Balance balance = assembleBalance();
     balance.time = aTime;
-    database.insert(balance);
+    database.insertDeferred(balance);
 }
 
 
@@ -402,16 +375,56 @@ FulfilledOrder Trader::fillNewMarketOrder(Order & aOrder)
 }
 
 
+std::optional<FulfilledOrder> Trader::sendLimitFokOrder(Order & aOrder,
+                                                        Decimal aLimitRate,
+                                                        Predicate & aPredicate,
+                                                        stats::LatencyRecorder * aLatency)
+{
+    std::optional<FulfilledOrder> fulfilled;
+    // Book version when the latest attempt expired, there is no point resending against the same book.
+    std::optional<std::uint64_t> expiredVersion;
+    while(aPredicate())
+    {
+        std::uint64_t bookVersion = 0;
+        if (orderBook)
+        {
+            bookVersion = orderBook->getVersion();
+            std::optional<Decimal> available = orderBook->availableQuantity(aOrder.side, aLimitRate);
+            if (available && (*available < aOrder.baseAmount || expiredVersion == bookVersion))
+            {
+                ++fokCounters->deferred;
+                orderBook->waitForUpdate(bookVersion, fokDeferral);
+                continue;
+            }
+        }
+
+        if (orderRateLimiter && orderRateLimiter->acquire())
+        {
+            ++fokCounters->throttled;
+        }
+        if (aLatency) aLatency->onSent();
+        ++fokCounters->placed;
+        fulfilled = exchange.fillLimitFokOrder(aOrder, aLimitRate);
+        if (aLatency) aLatency->onResponse();
+        if (fulfilled)
+        {
+            ++fokCounters->filled;
+            break;
+        }
+        ++fokCounters->expired;
+        expiredVersion = bookVersion;
+    }
+    return fulfilled;
+}
+
+
 std::optional<FulfilledOrder> Trader::fillExistingLimitFokOrder(Order & aOrder,
                                                                 Decimal aLimitRate,
                                                                 Predicate & aPredicate)
 {
     database.update(aOrder.setStatus(Order::Status::Sending));
 
-    std::optional<FulfilledOrder> fulfilled;
-    while(   aPredicate()
-          && ! (fulfilled = exchange.fillLimitFokOrder(aOrder, aLimitRate)).has_value())
-    {}
+    std::optional<FulfilledOrder> fulfilled = sendLimitFokOrder(aOrder, aLimitRate, aPredicate, latency.get());
 
     if (fulfilled)
     {
@@ -426,18 +439,228 @@ std::optional<FulfilledOrder> Trader::fillExistingLimitFokOrder(Order & aOrder,
 }
 
 
+namespace {
+
+
+    /// \brief Orders sent concurrently, and their outcomes as they arrive.
+    ///
+    /// Shared with the dispatched tasks, so it outlives the trader call even if it throws.
+    struct Dispatch
+    {
+        struct Completion
+        {
+            std::size_t index;
+            std::optional<FulfilledOrder> fulfilled;
+            std::exception_ptr error;
+        };
+
+        void push(Completion aCompletion)
+        {
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                completions.push_back(std::move(aCompletion));
+            }
+            arrived.notify_one();
+        }
+
+        Completion pop()
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            arrived.wait(lock, [this](){ return ! completions.empty(); });
+            Completion completion = std::move(completions.front());
+            completions.pop_front();
+            return completion;
+        }
+
+        std::vector<Order> orders;
+        std::vector<Decimal> limitRates;
+        Trader::Predicate predicate;
+
+        std::mutex mutex;
+        std::condition_variable arrived;
+        std::deque<Completion> completions;
+    };
+
+
+} // anonymous namespace
+
+
+std::pair<std::size_t, std::size_t>
+Trader::makeAndFillConcurrently(Interval aRateInterval,
+                                SymbolFilters aFilters,
+                                Predicate aPredicate)
+{
+    auto limitRate = [&aRateInterval](Side aSide)
+    {
+        return aSide == Side::Sell ? aRateInterval.front : aRateInterval.back;
+    };
+
+    std::vector<std::pair<Side, Decimal>> rates;
+    for (Side side : {Side::Sell, Side::Buy})
+    {
+        for (const Decimal rate : database.getProfitableRates(side, limitRate(side), pair))
+        {
+            rates.emplace_back(side, rate);
+        }
+    }
+
+    auto dispatch = std::make_shared<Dispatch>();
+    dispatch->predicate = std::move(aPredicate);
+    for (Order & order : database.prepareOrders(name, rates, pair))
+    {
+        if (detail::testAmountFilters(order, limitRate(order.side), aFilters)
+            && detail::testPriceFilters(order, limitRate(order.side), aFilters))
+        {
+            detail::filterAmountTickSize(order, aFilters);
+            dispatch->limitRates.push_back(limitRate(order.side));
+            dispatch->orders.push_back(std::move(order));
+        }
+        else
+        {
+            spdlog::warn("Order '{}' will not be placed because it does not pass amount filters.",
+                         order.getIdentity());
+            database.discardOrder(order);
+        }
+    }
+    latency->onPrepared();
+
+    {
+        auto transaction = database.startTransaction();
+        for (Order & order : dispatch->orders)
+        {
+            database.update(order.setStatus(Order::Status::Sending));
+        }
+        database.commit(std::move(transaction));
+    }
+
+    latency->onSent();
+    for (std::size_t index = 0; index != dispatch->orders.size(); ++index)
+    {
+        // The pool threads bound the number of orders in flight, the rate limiter their send rate.
+        boost::asio::post(orderDispatcher->getContext(), [this, dispatch, index]()
+        {
+            Dispatch::Completion completion{index, {}, nullptr};
+            try
+            {
+                // Each task only accesses its own order, the database is not used outside of the caller thread.
+                completion.fulfilled = sendLimitFokOrder(dispatch->orders[index],
+                                                         dispatch->limitRates[index],
+                                                         dispatch->predicate,
+                                                         nullptr);
+            }
+            catch (...)
+            {
+                completion.error = std::current_exception();
+            }
+            dispatch->push(std::move(completion));
+        });
+    }
+
+    // Completions are recorded as they arrive, each in its own transaction (see completeFulfilledOrder()).
+    std::size_t sellCount = 0;
+    std::size_t buyCount = 0;
+    std::exception_ptr firstError;
+    for (std::size_t received = 0; received != dispatch->orders.size(); ++received)
+    {
+        Dispatch::Completion completion = dispatch->pop();
+        Order & order = dispatch->orders[completion.index];
+        if (received == 0)
+        {
+            latency->onResponse();
+        }
+
+        if (completion.error)
+        {
+            // As in the sequential mode, the order is left Sending for the next cleanup().
+            spdlog::error("Sending order '{}' failed.", order.getIdentity());
+            if (! firstError)
+            {
+                firstError = completion.error;
+            }
+        }
+        else if (completion.fulfilled)
+        {
+            completeFulfilledOrder(*completion.fulfilled);
+            ++(order.side == Side::Sell ? sellCount : buyCount);
+        }
+        else
+        {
+            spdlog::debug("Predicate interrupted limit FOK filling loop.");
+            database.update(order.setStatus(Order::Status::Inactive));
+            database.discardOrder(order);
+        }
+    }
+
+    if (firstError)
+    {
+        std::rethrow_exception(firstError);
+    }
+
+    spdlog::info("From rate interval [{}, {}] on {}, concurrently filled {} sell orders and {} buy orders.",
+            aRateInterval.front,
+            aRateInterval.back,
+            pair.symbol(),
+            sellCount,
+            buyCount);
+
+    return {sellCount, buyCount};
+}
+
+
 std::pair<std::size_t, std::size_t>
 Trader::makeAndFillProfitableOrders(Interval aRateInterval,
                                     SymbolFilters aFilters,
-                                    Predicate aPredicate)
+                                    Predicate aPredicate,
+                                    const OrderPlan * aPlan)
 {
-    auto makeAndFill = [this, aFilters, &predicate = aPredicate]
+    if (orderDispatcher)
+    {
+        return makeAndFillConcurrently(aRateInterval, aFilters, std::move(aPredicate));
+    }
+
+    bool isPlanned = aPlan
+                     && aPlan->interval.front == aRateInterval.front
+                     && aPlan->interval.back == aRateInterval.back;
+
+    auto makeAndFill = [this, aFilters, &predicate = aPredicate, aPlan, isPlanned]
                        (Side aSide, Decimal aRate) -> std::size_t
     {
+        // Generation of the side fragments the plan is valid for, empty when there is no valid plan.
+        std::optional<std::uint64_t> planGeneration;
+        std::vector<RateFragments> candidates;
+        if (isPlanned
+            && database.getFragmentsGeneration(aSide)
+               == (aSide == Side::Sell ? aPlan->sellGeneration : aPlan->buyGeneration))
+        {
+            planGeneration = database.getFragmentsGeneration(aSide);
+            candidates = (aSide == Side::Sell ? aPlan->sells : aPlan->buys);
+        }
+        else
+        {
+            for (const Decimal rate : database.getProfitableRates(aSide, aRate, pair))
+            {
+                candidates.push_back({rate, 0, 0});
+            }
+        }
+
         std::size_t counter = 0;
-        for (const Decimal rate : database.getProfitableRates(aSide, aRate, pair))
+        for (const RateFragments & candidate : candidates)
         {
-            Order order = database.prepareOrder(name, aSide, rate, pair);
+            // Once the plan is invalidated (e.g. a discarded order), the remaining rates are summed.
+            if (planGeneration && *planGeneration != database.getFragmentsGeneration(aSide))
+            {
+                planGeneration.reset();
+            }
+
+            Order order = planGeneration ?
+                database.preparePlannedOrder(name, aSide, candidate, pair)
+                : database.prepareOrder(name, aSide, candidate.rate, pair);
+            if (planGeneration)
+            {
+                // Accounts for the assignment of the fragments to this order.
+                planGeneration = database.getFragmentsGeneration(aSide);
+            }
+            latency->onPrepared();
             // TODO: it is a complication to forward a rate that takes over the fragment rate in passing the order
             // I have to dig around and understand what is the fragment rate used for,
             // to see if we could override it in the order directly: order.fragmentsRate = aRate
@@ -480,5 +703,39 @@ Trader::makeAndFillProfitableOrders(Interval aRateInterval,
 }
 
 
+OrderPlan Trader::planProfitableOrders(Interval aInterval, const SymbolFilters & aFilters)
+{
+    OrderPlan plan{
+        aInterval,
+        database.getFragmentsGeneration(Side::Sell),
+        database.getFragmentsGeneration(Side::Buy),
+        {},
+        {},
+    };
+
+    auto planSide = [&](Side aSide, Decimal aRate, std::vector<RateFragments> & aDestination)
+    {
+        for (RateFragments & fragments : database.sumProfitableFragments(aSide, aRate, pair))
+        {
+            // Same filters as makeAndFillProfitableOrders(), which would discard the order.
+            if (testAmount(aFilters, fragments.baseAmount, aRate) && testPrice(aFilters, aRate))
+            {
+                aDestination.push_back(std::move(fragments));
+            }
+            else
+            {
+                spdlog::debug("Planned order for fragments at rate {} would not pass the filters at {}.",
+                              fragments.rate,
+                              aRate);
+            }
+        }
+    };
+
+    planSide(Side::Sell, aInterval.front, plan.sells);
+    planSide(Side::Buy, aInterval.back, plan.buys);
+    return plan;
+}
+
+
 } // namespace tradebot
 } // namespace ad
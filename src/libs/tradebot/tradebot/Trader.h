@@ -3,8 +3,15 @@
 
 #include "Database.h"
 #include "Exchange.h"
+#include "RateLimiter.h"
 #include "Spawner.h"
 #include "SymbolFilters.h"
+#include "ThreadPool.h"
+
+#include "marketdata/OrderBook.h"
+
+#include "stats/Counters.h"
+#include "stats/Latency.h"
 
 #include <trademath/Interval.h>
 
@@ -13,6 +20,21 @@ namespace ad {
 namespace tradebot {
 
 
+/// \brief The orders an interval change would place, computed ahead of the change
+/// (see `Trader::planProfitableOrders()`).
+struct OrderPlan
+{
+    Interval interval;
+    /// \brief Fragments generation of each side when the plan was computed,
+    /// the plan of a side is only valid while it did not change.
+    std::uint64_t sellGeneration;
+    std::uint64_t buyGeneration;
+    /// \brief The fragments to place for each rate passing the symbol filters, in placement order.
+    std::vector<RateFragments> sells;
+    std::vector<RateFragments> buys;
+};
+
+
 struct Trader
 {
     using Predicate = std::function<bool(void)>;
@@ -27,6 +49,17 @@ private:
     std::optional<FulfilledOrder> fillExistingLimitFokOrder(Order & aOrder,
                                                             Decimal aLimitRate,
                                                             Predicate & aPredicate);
+    /// \brief Send the limit FOK order until it fills or the predicate returns false.
+    ///
+    /// Does not access the database, so it might be called from the `orderDispatcher` threads.
+    /// \param aLatency The recorder to stamp, if any (it is not thread safe).
+    std::optional<FulfilledOrder> sendLimitFokOrder(Order & aOrder,
+                                                    Decimal aLimitRate,
+                                                    Predicate & aPredicate,
+                                                    stats::LatencyRecorder * aLatency);
+    std::pair<std::size_t, std::size_t> makeAndFillConcurrently(Interval aInterval,
+                                                                SymbolFilters aFilters,
+                                                                Predicate aPredicate);
 
 public: // should be private, but requires testing
     bool completeFulfilledOrder(const FulfilledOrder & aFulfilledOrder);
@@ -92,11 +125,22 @@ public:
     /// \param aPredicate A function called before each attempt to place an order, that will
     /// interrupt the procedure if it returns false.
     ///
+    /// If `orderDispatcher` is set, all the orders are prepared in a single transaction, then sent
+    /// concurrently, each order retrying until it fills or the predicate returns false
+    /// (so the predicate must be thread safe). Fulfilled orders are completed as they arrive.
+    ///
     /// \return A pair containing the number of filled sell orders and buy orders.
+    /// \param aPlan If it was computed for `aInterval` and its fragments did not change since,
+    /// the orders are prepared from the plan instead of querying the fragments (sequential mode only).
     std::pair<std::size_t /*filled sell*/, std::size_t /*filled buy*/>
     makeAndFillProfitableOrders(Interval aInterval,
                                 SymbolFilters aFilters,
-                                Predicate aPredicate = [](){return true;});
+                                Predicate aPredicate = [](){return true;},
+                                const OrderPlan * aPlan = nullptr);
+
+    /// \brief Compute the orders `makeAndFillProfitableOrders()` would place for `aInterval`,
+    /// without writing to the database.
+    OrderPlan planProfitableOrders(Interval aInterval, const SymbolFilters & aFilters);
 
     /// \brief To be called when an order did complete on the exchange, with its already accumulated
     /// fulfillment.
@@ -110,6 +154,28 @@ public:
     Database database;
     Exchange exchange;
     std::unique_ptr<SpawnerBase> spawner{std::make_unique<NullSpawner>()};
+    /// \brief Latency of the market-to-order stages, stamped only while a trace is begun.
+    std::unique_ptr<stats::LatencyRecorder> latency{std::make_unique<stats::LatencyRecorder>()};
+    std::unique_ptr<stats::FokCounters> fokCounters{std::make_unique<stats::FokCounters>()};
+    /// \brief If set, a limit FOK order is only sent when the visible book could fill it,
+    /// otherwise it is deferred until the book changes (an unknown or stale book does not defer).
+    ///
+    /// The book only shows its top levels (a single one with `@bookTicker`): when they all match
+    /// the limit, the liquidity is unknown and the order is sent. An order is held back only when
+    /// the visible levels end before the limit, and do not cover its whole amount. Orders are never
+    /// resized, since they aggregate whole fragments.
+    std::shared_ptr<const marketdata::OrderBook> orderBook;
+    /// \brief Maximum wait for a book update while an order is deferred, before evaluating the predicate again.
+    std::chrono::milliseconds fokDeferral{100};
+    /// \brief If set, each limit FOK order waits for it before being sent,
+    /// sequentially or from the `orderDispatcher` threads alike.
+    std::shared_ptr<RateLimiter> orderRateLimiter;
+    /// \brief If set, the orders of an interval are sent concurrently on this pool,
+    /// with at most as many orders in flight as the pool has threads.
+    /// The send rate is bounded by `orderRateLimiter`.
+    std::unique_ptr<ThreadPool> orderDispatcher;
+    /// \brief Reused by `spawnFragments()`.
+    SpawnBuffer spawnBuffer;
 };
 
 
@@ -0,0 +1,99 @@
+#include "AggregateTrade.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+
+namespace ad {
+namespace tradebot {
+namespace marketdata {
+
+
+std::int64_t parseFixedPoint(std::string_view aValue)
+{
+    auto fail = [aValue]()
+    {
+        spdlog::critical("Cannot parse '{}' as a fixed point value with 8 decimals.", std::string{aValue});
+        throw std::invalid_argument{"Invalid fixed point value."};
+    };
+
+    bool negative = ! aValue.empty() && aValue.front() == '-';
+    if (negative)
+    {
+        aValue.remove_prefix(1);
+    }
+    if (aValue.empty())
+    {
+        fail();
+    }
+
+    constexpr std::int64_t gMax = std::numeric_limits<std::int64_t>::max();
+    std::int64_t result = 0;
+    int decimals = -1; // -1 until the decimal separator is encountered
+    for (char character : aValue)
+    {
+        if (character == '.' && decimals == -1)
+        {
+            decimals = 0;
+        }
+        else if (character >= '0' && character <= '9')
+        {
+            if (decimals == 8)
+            {
+                // Trailing zeros do not lose precision
+                if (character != '0')
+                {
+                    fail();
+                }
+                continue;
+            }
+            if (result > (gMax - (character - '0')) / 10)
+            {
+                fail();
+            }
+            result = result * 10 + (character - '0');
+            if (decimals != -1)
+            {
+                ++decimals;
+            }
+        }
+        else
+        {
+            fail();
+        }
+    }
+
+    for (int missing = 8 - std::max(decimals, 0); missing != 0; --missing)
+    {
+        if (result > gMax / 10)
+        {
+            fail();
+        }
+        result *= 10;
+    }
+    return negative ? -result : result;
+}
+
+
+AggregateTrade AggregateTrade::fromJson(const Json & aMessage)
+{
+    return AggregateTrade{
+        aMessage.at("E").get<MillisecondsSinceEpoch>(),
+        aMessage.at("T").get<MillisecondsSinceEpoch>(),
+        aMessage.at("a").get<std::int64_t>(),
+        aMessage.at("f").get<std::int64_t>(),
+        aMessage.at("l").get<std::int64_t>(),
+        parseFixedPoint(aMessage.at("p").get_ref<const std::string &>()),
+        parseFixedPoint(aMessage.at("q").get_ref<const std::string &>()),
+        aMessage.at("m").get<bool>(),
+    };
+}
+
+
+} // namespace marketdata
+} // namespace tradebot
+} // namespace ad
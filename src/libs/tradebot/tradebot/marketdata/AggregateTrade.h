@@ -0,0 +1,59 @@
+#pragma once
+
+
+#include <binance/Json.h>
+#include <binance/Time.h>
+
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+
+namespace ad {
+namespace tradebot {
+namespace marketdata {
+
+
+/// \brief Prices and quantities are stored as fixed point integers with 8 decimals,
+/// which is the precision of the values sent by Binance.
+constexpr std::int64_t gFixedPointScale = 100'000'000;
+
+
+/// \brief Parse a decimal string (e.g. "26012.34000000") as a fixed point integer with 8 decimals.
+///
+/// \throw std::invalid_argument if the string is not a decimal number, or has more than 8 decimals
+/// (the value could not be represented exactly).
+std::int64_t parseFixedPoint(std::string_view aValue);
+
+inline double toDouble(std::int64_t aFixedPoint)
+{
+    return static_cast<double>(aFixedPoint) / gFixedPointScale;
+}
+
+
+/// \brief An aggregate trade, as a fixed size record.
+///
+/// The layout is part of the archive file format, changing it requires to bump the archive version.
+struct AggregateTrade
+{
+    /// \brief Decode an aggTrade market stream message.
+    static AggregateTrade fromJson(const Json & aMessage);
+
+    MillisecondsSinceEpoch eventTime;
+    MillisecondsSinceEpoch tradeTime;
+    std::int64_t aggregateTradeId;
+    std::int64_t firstTradeId;
+    std::int64_t lastTradeId;
+    std::int64_t price;     // fixed point, see gFixedPointScale
+    std::int64_t quantity;  // fixed point, see gFixedPointScale
+    std::uint8_t buyerIsMaker;
+    std::uint8_t reserved[7]{};
+};
+
+static_assert(sizeof(AggregateTrade) == 64, "AggregateTrade record must be 64 bytes.");
+static_assert(std::is_trivially_copyable_v<AggregateTrade>, "AggregateTrade record must be trivially copyable.");
+
+
+} // namespace marketdata
+} // namespace tradebot
+} // namespace ad
@@ -0,0 +1,120 @@
+#include "OrderBook.h"
+
+#include <boost/algorithm/string/case_conv.hpp>
+
+
+namespace ad {
+namespace tradebot {
+namespace marketdata {
+
+
+namespace {
+
+
+    std::vector<OrderBook::Level> readLevels(const Json & aLevels)
+    {
+        std::vector<OrderBook::Level> levels;
+        levels.reserve(aLevels.size());
+        for (const Json & level : aLevels)
+        {
+            levels.push_back({
+                Decimal{level.at(0).get<std::string>()},
+                Decimal{level.at(1).get<std::string>()},
+            });
+        }
+        return levels;
+    }
+
+
+} // anonymous namespace
+
+
+OrderBook::OrderBook(std::chrono::milliseconds aMaximumAge) :
+    maximumAge{aMaximumAge}
+{}
+
+
+void OrderBook::onBookTicker(const Json & aMessage)
+{
+    replace({{Decimal{aMessage.at("b").get<std::string>()}, Decimal{aMessage.at("B").get<std::string>()}}},
+            {{Decimal{aMessage.at("a").get<std::string>()}, Decimal{aMessage.at("A").get<std::string>()}}});
+}
+
+
+void OrderBook::onPartialDepth(const Json & aMessage)
+{
+    replace(readLevels(aMessage.at("bids")), readLevels(aMessage.at("asks")));
+}
+
+
+void OrderBook::replace(std::vector<Level> aBids, std::vector<Level> aAsks)
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        bids = std::move(aBids);
+        asks = std::move(aAsks);
+        updateTime = std::chrono::steady_clock::now();
+        ++version;
+    }
+    updated.notify_all();
+}
+
+
+std::optional<Decimal> OrderBook::availableQuantity(Side aOrderSide, Decimal aLimitPrice) const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    if (version == 0 || std::chrono::steady_clock::now() - updateTime > maximumAge)
+    {
+        return {};
+    }
+
+    // A sell order matches the bids at or above its limit, a buy order the asks at or below.
+    const std::vector<Level> & levels = (aOrderSide == Side::Sell) ? bids : asks;
+    Decimal result{0};
+    for (const Level & level : levels)
+    {
+        if ((aOrderSide == Side::Sell && level.price < aLimitPrice)
+            || (aOrderSide == Side::Buy && level.price > aLimitPrice))
+        {
+            return result;
+        }
+        result += level.quantity;
+    }
+    // The book is truncated after the last visible level.
+    if (! levels.empty())
+    {
+        return {};
+    }
+    return result;
+}
+
+
+std::uint64_t OrderBook::getVersion() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return version;
+}
+
+
+bool OrderBook::waitForUpdate(std::uint64_t aVersion, std::chrono::milliseconds aTimeout) const
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    return updated.wait_for(lock, aTimeout, [this, aVersion](){ return version > aVersion; });
+}
+
+
+std::string OrderBook::getBookTickerStreamName(const std::string & aSymbol)
+{
+    return boost::algorithm::to_lower_copy(aSymbol) + "@bookTicker";
+}
+
+
+std::string OrderBook::getPartialDepthStreamName(const std::string & aSymbol, int aLevels)
+{
+    return boost::algorithm::to_lower_copy(aSymbol) + "@depth" + std::to_string(aLevels) + "@100ms";
+}
+
+
+} // namespace marketdata
+} // namespace tradebot
+} // namespace ad
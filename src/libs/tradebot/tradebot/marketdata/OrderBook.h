@@ -0,0 +1,84 @@
+#pragma once
+
+
+#include "../Fragment.h"
+
+#include <binance/Json.h>
+
+#include <trademath/Decimal.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+
+namespace ad {
+namespace tradebot {
+namespace marketdata {
+
+
+/// \brief The visible top levels of the exchange order book for a symbol,
+/// maintained from the `@bookTicker` or the partial `@depth<levels>` market streams.
+///
+/// It is updated from the market stream thread, and queried by the trader
+/// before sending limit Fill Or Kill orders, so it is thread safe.
+class OrderBook
+{
+public:
+    struct Level
+    {
+        Decimal price;
+        Decimal quantity;
+    };
+
+    /// \param aMaximumAge Older book data is considered unknown by `availableQuantity()`.
+    explicit OrderBook(std::chrono::milliseconds aMaximumAge = std::chrono::seconds{2});
+
+    /// \brief Replace the book with the best bid and ask of a `@bookTicker` message.
+    void onBookTicker(const Json & aMessage);
+
+    /// \brief Replace the book with the levels of a partial `@depth<levels>` message.
+    void onPartialDepth(const Json & aMessage);
+
+    /// \brief Quantity visible on the opposite side of the book, at prices an order
+    /// of side `aOrderSide` with limit `aLimitPrice` would match.
+    ///
+    /// \return An empty optional if the book is unknown or too old to be trusted,
+    /// or if all the visible levels match the limit: deeper levels the book does not show
+    /// might match too, so the actual quantity is unknown.
+    std::optional<Decimal> availableQuantity(Side aOrderSide, Decimal aLimitPrice) const;
+
+    /// \brief Incremented by each update, to detect changes since a previous observation.
+    std::uint64_t getVersion() const;
+
+    /// \brief Block until the version is newer than `aVersion`, or the timeout expires.
+    ///
+    /// \return `true` if the book was updated.
+    bool waitForUpdate(std::uint64_t aVersion, std::chrono::milliseconds aTimeout) const;
+
+    /// \brief Name of the stream to subscribe to for the best bid and ask, e.g. `dogeusdt@bookTicker`.
+    static std::string getBookTickerStreamName(const std::string & aSymbol);
+
+    /// \brief Name of the stream to subscribe to for partial depth, e.g. `dogeusdt@depth5@100ms`.
+    static std::string getPartialDepthStreamName(const std::string & aSymbol, int aLevels);
+
+private:
+    void replace(std::vector<Level> aBids, std::vector<Level> aAsks);
+
+    std::chrono::milliseconds maximumAge;
+
+    mutable std::mutex mutex;
+    mutable std::condition_variable updated;
+    // Best level first: decreasing prices for bids, increasing prices for asks.
+    std::vector<Level> bids;
+    std::vector<Level> asks;
+    std::chrono::steady_clock::time_point updateTime{};
+    std::uint64_t version{0};
+};
+
+
+} // namespace marketdata
+} // namespace tradebot
+} // namespace ad
@@ -0,0 +1,80 @@
+#include "Recorder.h"
+
+#include <spdlog/spdlog.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <ctime>
+
+
+namespace ad {
+namespace tradebot {
+namespace marketdata {
+
+
+namespace {
+
+    const MillisecondsSinceEpoch gDay = 24 * 60 * 60 * 1000;
+
+} // anonymous namespace
+
+
+Recorder::Recorder(std::filesystem::path aDirectory, std::string aSymbol) :
+    directory{std::move(aDirectory)},
+    symbol{boost::to_upper_copy(std::move(aSymbol))}
+{
+    std::filesystem::create_directories(directory);
+}
+
+
+void Recorder::record(const Json & aMessage)
+{
+    record(AggregateTrade::fromJson(aMessage));
+}
+
+
+void Recorder::record(const AggregateTrade & aTrade)
+{
+    MillisecondsSinceEpoch day = dayOf(aTrade.tradeTime);
+    if (! writer || writer->day() != day)
+    {
+        if (writer)
+        {
+            spdlog::info("Closing trade archive '{}' with {} records.",
+                         writer->getPath().string(), writer->size());
+        }
+        // Close the previous day before opening the next.
+        writer.reset();
+        writer.emplace(getArchivePath(day), symbol, day);
+        spdlog::info("Recording {} aggregate trades to '{}'.", symbol, writer->getPath().string());
+    }
+    writer->append(aTrade);
+}
+
+
+std::string Recorder::getStreamName() const
+{
+    return boost::to_lower_copy(symbol) + "@aggTrade";
+}
+
+
+std::filesystem::path Recorder::getArchivePath(MillisecondsSinceEpoch aDay) const
+{
+    std::time_t time = aDay / 1000;
+    std::tm calendar;
+    gmtime_r(&time, &calendar);
+    char date[9];
+    std::strftime(date, sizeof(date), "%Y%m%d", &calendar);
+    return directory / (symbol + "-aggTrade-" + date + ".bin");
+}
+
+
+MillisecondsSinceEpoch Recorder::dayOf(MillisecondsSinceEpoch aTime)
+{
+    return aTime - (aTime % gDay);
+}
+
+
+} // namespace marketdata
+} // namespace tradebot
+} // namespace ad
@@ -0,0 +1,46 @@
+#pragma once
+
+
+#include "TradeArchive.h"
+
+#include <optional>
+
+
+namespace ad {
+namespace tradebot {
+namespace marketdata {
+
+
+/// \brief Record the aggregate trades of a symbol in daily archive files.
+///
+/// Each UTC day (of the trade time) goes to its own file "<SYMBOL>-aggTrade-<YYYYMMDD>.bin"
+/// in the recorder directory.
+///
+/// \attention Not thread safe, it is intended to be called from the market stream callback.
+class Recorder
+{
+public:
+    Recorder(std::filesystem::path aDirectory, std::string aSymbol);
+
+    /// \brief Decode and record an aggTrade market stream message.
+    void record(const Json & aMessage);
+
+    void record(const AggregateTrade & aTrade);
+
+    /// \brief Name of the market stream to subscribe to, e.g. with `Exchange::openMarketStream()`.
+    std::string getStreamName() const;
+
+    std::filesystem::path getArchivePath(MillisecondsSinceEpoch aDay) const;
+
+    static MillisecondsSinceEpoch dayOf(MillisecondsSinceEpoch aTime);
+
+private:
+    std::filesystem::path directory;
+    std::string symbol;
+    std::optional<TradeFileWriter> writer;
+};
+
+
+} // namespace marketdata
+} // namespace tradebot
+} // namespace ad
@@ -0,0 +1,339 @@
+#include "TradeArchive.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace ad {
+namespace tradebot {
+namespace marketdata {
+
+
+namespace {
+
+
+    // Grow the archive by 64 MiB at once.
+    const std::uint64_t gChunkRecords = 1 << 20;
+
+    const MillisecondsSinceEpoch gMinute = 60 * 1000;
+
+
+    [[noreturn]] void throwSystemError(const std::string & aOperation, const std::filesystem::path & aPath)
+    {
+        int error = errno;
+        spdlog::critical("Cannot {} archive file '{}': {}.", aOperation, aPath.string(), std::strerror(error));
+        throw std::system_error{error, std::generic_category(), "Archive file " + aOperation + " failed."};
+    }
+
+
+    std::size_t bytesFor(std::uint64_t aRecords)
+    {
+        return sizeof(ArchiveHeader) + aRecords * sizeof(AggregateTrade);
+    }
+
+
+    void checkHeader(const ArchiveHeader & aHeader, const std::filesystem::path & aPath)
+    {
+        if (std::memcmp(aHeader.magic, ArchiveHeader::gMagic, sizeof(aHeader.magic)) != 0
+            || aHeader.version != ArchiveHeader::gVersion
+            || aHeader.recordSize != sizeof(AggregateTrade))
+        {
+            spdlog::critical("File '{}' is not a trade archive in version {}.",
+                             aPath.string(), ArchiveHeader::gVersion);
+            throw std::runtime_error{"Invalid trade archive header."};
+        }
+    }
+
+
+    MillisecondsSinceEpoch minuteOf(MillisecondsSinceEpoch aTime)
+    {
+        return aTime - (aTime % gMinute);
+    }
+
+
+} // anonymous namespace
+
+
+FileDescriptor::~FileDescriptor()
+{
+    if (descriptor != -1)
+    {
+        ::close(descriptor);
+    }
+}
+
+
+FileDescriptor & FileDescriptor::operator = (FileDescriptor && aOther) noexcept
+{
+    if (this != &aOther)
+    {
+        if (descriptor != -1)
+        {
+            ::close(descriptor);
+        }
+        descriptor = std::exchange(aOther.descriptor, -1);
+    }
+    return *this;
+}
+
+
+TradeFileWriter::TradeFileWriter(const std::filesystem::path & aPath,
+                                 const std::string & aSymbol,
+                                 MillisecondsSinceEpoch aDay) :
+    path{aPath}
+{
+    if (aSymbol.size() >= sizeof(ArchiveHeader::symbol))
+    {
+        spdlog::critical("Symbol '{}' is too long for the trade archive header.", aSymbol);
+        throw std::invalid_argument{"Symbol too long for a trade archive."};
+    }
+
+    // The descriptors are closed by their members if the constructor throws.
+    if (! (file = FileDescriptor{::open(path.c_str(), O_RDWR | O_CREAT, 0644)}))
+    {
+        throwSystemError("open", path);
+    }
+
+    struct stat status;
+    if (::fstat(file.get(), &status) == -1)
+    {
+        throwSystemError("stat", path);
+    }
+
+    if (status.st_size == 0)
+    {
+        map(gChunkRecords);
+        std::memcpy(header->magic, ArchiveHeader::gMagic, sizeof(header->magic));
+        header->version = ArchiveHeader::gVersion;
+        header->recordSize = sizeof(AggregateTrade);
+        std::strncpy(header->symbol, aSymbol.c_str(), sizeof(header->symbol));
+        header->day = aDay;
+        header->recordCount = 0;
+    }
+    else
+    {
+        if (static_cast<std::size_t>(status.st_size) < sizeof(ArchiveHeader))
+        {
+            spdlog::critical("Existing file '{}' is too small to be a trade archive.", path.string());
+            throw std::runtime_error{"Invalid trade archive size."};
+        }
+        map((status.st_size - sizeof(ArchiveHeader)) / sizeof(AggregateTrade));
+        try
+        {
+            checkHeader(*header, path);
+            if (header->day != aDay || aSymbol != header->symbol || header->recordCount > capacity)
+            {
+                spdlog::critical("Existing trade archive '{}' does not match symbol '{}' on day {}.",
+                                 path.string(), aSymbol, aDay);
+                throw std::runtime_error{"Mismatching trade archive."};
+            }
+        }
+        catch (...)
+        {
+            // The destructor does not run, and must not truncate a file which is not ours anyway.
+            unmap();
+            throw;
+        }
+        if (header->recordCount != 0)
+        {
+            lastIndexedMinute = minuteOf(records[header->recordCount - 1].tradeTime);
+        }
+        spdlog::info("Reopened trade archive '{}', appending after {} records.",
+                     path.string(), header->recordCount);
+    }
+
+    if (! (indexFile = FileDescriptor{::open(indexPath(path).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644)}))
+    {
+        int error = errno;
+        unmap();
+        errno = error;
+        throwSystemError("open index of", path);
+    }
+}
+
+
+TradeFileWriter::~TradeFileWriter()
+{
+    if (header != nullptr)
+    {
+        std::uint64_t count = header->recordCount;
+        unmap();
+        // Remove the preallocated space
+        if (::ftruncate(file.get(), bytesFor(count)) == -1)
+        {
+            spdlog::error("Cannot truncate trade archive '{}': {}.", path.string(), std::strerror(errno));
+        }
+    }
+}
+
+
+std::filesystem::path TradeFileWriter::indexPath(const std::filesystem::path & aArchivePath)
+{
+    std::filesystem::path result{aArchivePath};
+    return result += ".idx";
+}
+
+
+void TradeFileWriter::map(std::uint64_t aCapacity)
+{
+    if (::ftruncate(file.get(), bytesFor(aCapacity)) == -1)
+    {
+        throwSystemError("resize", path);
+    }
+
+    mapping = ::mmap(nullptr, bytesFor(aCapacity), PROT_READ | PROT_WRITE, MAP_SHARED, file.get(), 0);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        throwSystemError("map", path);
+    }
+    capacity = aCapacity;
+    header = static_cast<ArchiveHeader *>(mapping);
+    records = reinterpret_cast<AggregateTrade *>(header + 1);
+}
+
+
+void TradeFileWriter::unmap()
+{
+    if (mapping != nullptr)
+    {
+        ::munmap(mapping, bytesFor(capacity));
+        mapping = nullptr;
+        header = nullptr;
+        records = nullptr;
+    }
+}
+
+
+void TradeFileWriter::append(const AggregateTrade & aTrade)
+{
+    std::uint64_t count = header->recordCount;
+    if (count == capacity)
+    {
+        std::uint64_t previousCapacity = capacity;
+        unmap();
+        map(previousCapacity + gChunkRecords);
+    }
+
+    records[count] = aTrade;
+    // Readers mapping the file concurrently rely on the count to only see complete records.
+    std::atomic_thread_fence(std::memory_order_release);
+    header->recordCount = count + 1;
+
+    if (MillisecondsSinceEpoch minute = minuteOf(aTrade.tradeTime); minute != lastIndexedMinute)
+    {
+        IndexEntry entry{minute, count};
+        if (::write(indexFile.get(), &entry, sizeof(entry)) != sizeof(entry))
+        {
+            spdlog::error("Cannot write index entry of trade archive '{}': {}.", path.string(), std::strerror(errno));
+        }
+        lastIndexedMinute = minute;
+    }
+}
+
+
+TradeFileReader::TradeFileReader(const std::filesystem::path & aPath)
+{
+    int file = ::open(aPath.c_str(), O_RDONLY);
+    if (file == -1)
+    {
+        throwSystemError("open", aPath);
+    }
+
+    struct stat status;
+    if (::fstat(file, &status) == -1
+        || static_cast<std::size_t>(status.st_size) < sizeof(ArchiveHeader))
+    {
+        ::close(file);
+        spdlog::critical("File '{}' is too small to be a trade archive.", aPath.string());
+        throw std::runtime_error{"Invalid trade archive size."};
+    }
+
+    mappedBytes = status.st_size;
+    mapping = ::mmap(nullptr, mappedBytes, PROT_READ, MAP_SHARED, file, 0);
+    // The mapping remains valid after the file descriptor is closed.
+    ::close(file);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        throwSystemError("map", aPath);
+    }
+    ::madvise(mapping, mappedBytes, MADV_SEQUENTIAL);
+
+    header = static_cast<const ArchiveHeader *>(mapping);
+    try
+    {
+        checkHeader(*header, aPath);
+    }
+    catch (...)
+    {
+        ::munmap(mapping, mappedBytes);
+        throw;
+    }
+    records = reinterpret_cast<const AggregateTrade *>(header + 1);
+    count = std::min<std::uint64_t>(header->recordCount,
+                                    (mappedBytes - sizeof(ArchiveHeader)) / sizeof(AggregateTrade));
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (std::ifstream indexStream{TradeFileWriter::indexPath(aPath), std::ios::binary})
+    {
+        IndexEntry entry;
+        while (indexStream.read(reinterpret_cast<char *>(&entry), sizeof(entry)))
+        {
+            index.push_back(entry);
+        }
+    }
+}
+
+
+TradeFileReader::~TradeFileReader()
+{
+    if (mapping != nullptr)
+    {
+        ::munmap(mapping, mappedBytes);
+    }
+}
+
+
+const AggregateTrade * TradeFileReader::lowerBound(MillisecondsSinceEpoch aTime) const
+{
+    const AggregateTrade * first = begin();
+    const AggregateTrade * last = end();
+
+    // First entry for a minute after aTime's minute.
+    auto next = std::upper_bound(index.begin(), index.end(), minuteOf(aTime),
+                                 [](MillisecondsSinceEpoch aMinute, const IndexEntry & aEntry)
+                                 {
+                                     return aMinute < aEntry.minute;
+                                 });
+    if (next != index.end())
+    {
+        last = records + std::min(next->record, count);
+    }
+    if (next != index.begin())
+    {
+        first = records + std::min(std::prev(next)->record, count);
+    }
+
+    return std::lower_bound(first, last, aTime,
+                            [](const AggregateTrade & aTrade, MillisecondsSinceEpoch aValue)
+                            {
+                                return aTrade.tradeTime < aValue;
+                            });
+}
+
+
+} // namespace marketdata
+} // namespace tradebot
+} // namespace ad
@@ -0,0 +1,157 @@
+#pragma once
+
+
+#include "AggregateTrade.h"
+
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace ad {
+namespace tradebot {
+namespace marketdata {
+
+
+/// \brief Header at the beginning of each archive file, followed by the AggregateTrade records.
+struct ArchiveHeader
+{
+    static constexpr char gMagic[8] = {'A', 'D', 'T', 'R', 'A', 'D', 'E', 'S'};
+    static constexpr std::uint32_t gVersion = 1;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    char symbol[16];
+    /// \brief Midnight (UTC) of the day covered by the file.
+    MillisecondsSinceEpoch day;
+    /// \brief Number of complete records, updated after each record is written.
+    std::uint64_t recordCount;
+    std::uint8_t reserved[16];
+};
+
+static_assert(sizeof(ArchiveHeader) == 64, "ArchiveHeader must be 64 bytes.");
+
+
+/// \brief Entry of the index file, associating a minute to its first record.
+struct IndexEntry
+{
+    MillisecondsSinceEpoch minute;
+    std::uint64_t record;
+};
+
+
+/// \brief Owns a POSIX file descriptor, closed on destruction.
+class FileDescriptor
+{
+public:
+    FileDescriptor() = default;
+    explicit FileDescriptor(int aDescriptor) :
+        descriptor{aDescriptor}
+    {}
+    ~FileDescriptor();
+
+    FileDescriptor(FileDescriptor && aOther) noexcept :
+        descriptor{std::exchange(aOther.descriptor, -1)}
+    {}
+    FileDescriptor & operator = (FileDescriptor && aOther) noexcept;
+
+    /// \return True if the descriptor is valid.
+    explicit operator bool() const
+    { return descriptor != -1; }
+
+    int get() const
+    { return descriptor; }
+
+private:
+    int descriptor{-1};
+};
+
+
+/// \brief Append AggregateTrade records to a memory mapped archive file.
+///
+/// The file grows by chunks, and is truncated to its actual content on destruction.
+/// An existing file is reopened, new records being appended after the existing ones.
+/// Alongside, an index file (same path with ".idx" extension) receives an entry for
+/// the first record of each minute.
+///
+/// \attention Not thread safe: records must be appended by a single thread.
+class TradeFileWriter
+{
+public:
+    TradeFileWriter(const std::filesystem::path & aPath,
+                    const std::string & aSymbol,
+                    MillisecondsSinceEpoch aDay);
+    ~TradeFileWriter();
+
+    /// \brief Records are expected in increasing trade time.
+    void append(const AggregateTrade & aTrade);
+
+    std::uint64_t size() const
+    { return header->recordCount; }
+
+    MillisecondsSinceEpoch day() const
+    { return header->day; }
+
+    const std::filesystem::path & getPath() const
+    { return path; }
+
+    static std::filesystem::path indexPath(const std::filesystem::path & aArchivePath);
+
+private:
+    TradeFileWriter(const TradeFileWriter &) = delete;
+    TradeFileWriter & operator = (const TradeFileWriter &) = delete;
+
+    void map(std::uint64_t aCapacity);
+    void unmap();
+
+    std::filesystem::path path;
+    FileDescriptor file;
+    FileDescriptor indexFile;
+    void * mapping{nullptr};
+    std::uint64_t capacity{0}; // in records
+    ArchiveHeader * header{nullptr};
+    AggregateTrade * records{nullptr};
+    MillisecondsSinceEpoch lastIndexedMinute{-1};
+};
+
+
+/// \brief Read-only memory mapped view of an archive file.
+class TradeFileReader
+{
+public:
+    explicit TradeFileReader(const std::filesystem::path & aPath);
+    ~TradeFileReader();
+
+    const ArchiveHeader & getHeader() const
+    { return *header; }
+
+    std::uint64_t size() const
+    { return count; }
+
+    const AggregateTrade * begin() const
+    { return records; }
+
+    const AggregateTrade * end() const
+    { return records + count; }
+
+    /// \brief First record with a trade time not before `aTime`, using the index to narrow the search.
+    const AggregateTrade * lowerBound(MillisecondsSinceEpoch aTime) const;
+
+private:
+    TradeFileReader(const TradeFileReader &) = delete;
+    TradeFileReader & operator = (const TradeFileReader &) = delete;
+
+    void * mapping{nullptr};
+    std::size_t mappedBytes{0};
+    const ArchiveHeader * header{nullptr};
+    const AggregateTrade * records{nullptr};
+    std::uint64_t count{0};
+    std::vector<IndexEntry> index;
+};
+
+
+} // namespace marketdata
+} // namespace tradebot
+} // namespace ad
@@ -20,7 +20,7 @@ NaiveDownSpread::NaiveDownSpread(trade::Ladder aLadder, trade::ProportionsMap aP
 
 SpawnerBase::Result NaiveDownSpread::computeResultingFragments(const Fragment & aFilledFragment,
                                                                const FulfilledOrder & aOrder,
-                                                               Database & aDatabase)
+                                                               ParentOrders & aParents)
 {
     switch (aFilledFragment.side)
     {
@@ -34,10 +34,10 @@ SpawnerBase::Result NaiveDownSpread::computeResultingFragments(const Fragment &
         }
         case Side::Buy:
         {
-            Order parentOrder = aDatabase.getOrder(aFilledFragment.spawningOrder);
             // taken home is 0
             return {
-                {trade::Spawn{parentOrder.fragmentsRate, trade::Base{aFilledFragment.baseAmount}}},
+                {trade::Spawn{aParents.getFragmentsRate(aFilledFragment.spawningOrder),
+                              trade::Base{aFilledFragment.baseAmount}}},
                 Decimal{0}
             };
         }
@@ -16,15 +16,17 @@ namespace spawner {
 /// The implicit taken home is the remaining quote that was not spread down after a `Sell`.
 /// This spawner is naive, because it can easily exhaust a stop by spreading it down continuously
 /// (in case where the rate alternates for some period between two neighbor stops).
-class NaiveDownSpread : public SpawnerBase
+class NaiveDownSpread : public StaticSpawner<NaiveDownSpread>
 {
 public:
     NaiveDownSpread(trade::Ladder aLadder, trade::ProportionsMap aProportions);
 
+    using SpawnerBase::computeResultingFragments;
+
     Result
     computeResultingFragments(const Fragment & aFilledFragment,
                               const FulfilledOrder & aOrder,
-                              Database & aDatabase) override;
+                              ParentOrders & aParents) override;
 
 
     trade::ProportionSpreader downSpreader;
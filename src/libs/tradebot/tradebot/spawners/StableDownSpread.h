@@ -6,6 +6,7 @@
 #include <tradebot/Logging.h>
 
 #include <trademath/Spawn.h>
+#include <trademath/SpawnBatch.h>
 
 
 namespace ad {
@@ -31,12 +32,14 @@ namespace spawner {
 
 
 template <TMP_PARAM_LIST>
-class StableDownSpread : public SpawnerBase
+class StableDownSpread : public StaticSpawner<StableDownSpread<TMP_ARGS>>
 {
 private:
     void filterSpawnedAmount(Decimal & aSpawned, Decimal & aTakenHome);
 
 public:
+    using Result = SpawnerBase::Result;
+
     StableDownSpread(T_spreader aSpreader,
                      Decimal aTakeHomeFactorInitialSell,
                      Decimal aTakeHomeFactorSubsequentSell,
@@ -44,21 +47,33 @@ public:
 
     Decimal amountTickSize() const;
 
+    using SpawnerBase::computeResultingFragments;
+
     Result
     computeResultingFragments(const Fragment & aFilledFragment,
                               const FulfilledOrder & aOrder,
-                              Database & aDatabase) override;
+                              ParentOrders & aParents) override;
+
+    /// \brief Spread the initial sells of `aOrder` as a single batch, the other fragments
+    /// being handled one at a time.
+    ///
+    /// The results are identical to calling `computeResultingFragments()` for each fragment.
+    void
+    computeOrderSpawns(std::vector<Fragment> & aFilledFragments,
+                       const FulfilledOrder & aOrder,
+                       ParentOrders & aParents,
+                       SpawnBuffer & aSpawns) override;
 
     Result onFirstSell(const Fragment & aFilledFragment,
                        const FulfilledOrder & aOrder);
 
     Result onSubsequentBuy(const Fragment & aFilledFragment,
                            const FulfilledOrder & aOrder,
-                           Database & aDatabase);
+                           ParentOrders & aParents);
 
     Result onSubsequentSell(const Fragment & aFilledFragment,
                             const FulfilledOrder & aOrder,
-                            Database & aDatabase);
+                            ParentOrders & aParents);
 
     T_spreader downSpreader;
 
@@ -93,7 +108,7 @@ template <TMP_PARAM_LIST>
 SpawnerBase::Result
 StableDownSpread<TMP_ARGS>::computeResultingFragments(const Fragment & aFilledFragment,
                                                       const FulfilledOrder & aOrder,
-                                                      Database & aDatabase)
+                                                      ParentOrders & aParents)
 {
     switch (aFilledFragment.side)
     {
@@ -105,7 +120,7 @@ StableDownSpread<TMP_ARGS>::computeResultingFragments(const Fragment & aFilledFr
             }
             else
             {
-                return onSubsequentSell(aFilledFragment, aOrder, aDatabase);
+                return onSubsequentSell(aFilledFragment, aOrder, aParents);
             }
         }
         case Side::Buy:
@@ -116,7 +131,7 @@ StableDownSpread<TMP_ARGS>::computeResultingFragments(const Fragment & aFilledFr
                     boost::lexical_cast<std::string>(aFilledFragment));
                 throw std::logic_error{"StableDownSpread encountered an initial Buy fragment."};
             }
-            return onSubsequentBuy(aFilledFragment, aOrder, aDatabase);
+            return onSubsequentBuy(aFilledFragment, aOrder, aParents);
         }
         default:
             throw std::domain_error{"Invalid Side enumerator."};
@@ -124,6 +139,57 @@ StableDownSpread<TMP_ARGS>::computeResultingFragments(const Fragment & aFilledFr
 }
 
 
+template <TMP_PARAM_LIST>
+void
+StableDownSpread<TMP_ARGS>::computeOrderSpawns(std::vector<Fragment> & aFilledFragments,
+                                               const FulfilledOrder & aOrder,
+                                               ParentOrders & aParents,
+                                               SpawnBuffer & aSpawns)
+{
+    auto isInitialSell = [](const Fragment & aFragment)
+    {
+        return aFragment.side == Side::Sell && aFragment.isInitial();
+    };
+
+    // Same amounts as onFirstSell()
+    std::vector<Decimal> amounts;
+    std::vector<Decimal> rates;
+    for (const Fragment & fragment : aFilledFragments)
+    {
+        if (isInitialSell(fragment))
+        {
+            amounts.push_back(fragment.baseAmount * aOrder.executionRate * (1-takeHomeFactorInitialSell));
+            rates.push_back(fragment.targetRate);
+        }
+    }
+
+    trade::SpawnBatch batch;
+    if (! amounts.empty())
+    {
+        downSpreader.template spreadDownBatch<trade::Quote>(amounts, rates, batch);
+    }
+
+    std::size_t batchId = 0;
+    for (Fragment & fragment : aFilledFragments)
+    {
+        if (isInitialSell(fragment))
+        {
+            std::vector<trade::Spawn> spawns = batch.getSpawns(batchId);
+            fragment.takenHome = fragment.baseAmount * aOrder.executionRate - batch.accumulations[batchId];
+            aSpawns.append(spawns.begin(), spawns.end());
+            ++batchId;
+        }
+        else
+        {
+            // Qualified call: not dispatched through the virtual table.
+            auto [spawns, takenHome] = StableDownSpread::computeResultingFragments(fragment, aOrder, aParents);
+            fragment.takenHome = std::move(takenHome);
+            aSpawns.append(spawns.begin(), spawns.end());
+        }
+    }
+}
+
+
 template <TMP_PARAM_LIST>
 SpawnerBase::Result
 StableDownSpread<TMP_ARGS>::onFirstSell(const Fragment & aFilledFragment,
@@ -146,13 +212,12 @@ template <TMP_PARAM_LIST>
 SpawnerBase::Result
 StableDownSpread<TMP_ARGS>::onSubsequentBuy(const Fragment & aFilledFragment,
                                             const FulfilledOrder & aOrder,
-                                            Database & aDatabase)
+                                            ParentOrders & aParents)
 {
     // For a Buy fragment, its parent order is a Sell.
-    Order parentSellOrder = aDatabase.getOrder(aFilledFragment.spawningOrder);
     // This spawner is stable because it spawns a Sell at the same rate as the parent of the current Buy. 
     // (i.e., each fragment will ping pong between a fixed buy and a fixed sell rate)
-    Decimal spawnedSellRate = parentSellOrder.fragmentsRate;
+    Decimal spawnedSellRate = aParents.getFragmentsRate(aFilledFragment.spawningOrder);
 
     // Sanity check
     {
@@ -201,11 +266,10 @@ template <TMP_PARAM_LIST>
 SpawnerBase::Result
 StableDownSpread<TMP_ARGS>::onSubsequentSell(const Fragment & aFilledFragment,
                                              const FulfilledOrder & aOrder,
-                                             Database & aDatabase)
+                                             ParentOrders & aParents)
 {
     // For a Sell fragment, its parent order is a Buy.
-    Order parentBuyOrder = aDatabase.getOrder(aFilledFragment.spawningOrder);
-    Decimal spawnedBuyRate = parentBuyOrder.fragmentsRate;
+    Decimal spawnedBuyRate = aParents.getFragmentsRate(aFilledFragment.spawningOrder);
 
     // Sanity check
     {
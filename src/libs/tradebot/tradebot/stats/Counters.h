@@ -0,0 +1,30 @@
+#pragma once
+
+
+#include <atomic>
+#include <cstdint>
+
+
+namespace ad {
+namespace tradebot {
+namespace stats {
+
+
+/// \brief Outcomes of limit Fill Or Kill orders sent to the exchange.
+///
+/// Incremented by the trader, might be read from any thread.
+struct FokCounters
+{
+    std::atomic<std::uint64_t> placed{0};
+    std::atomic<std::uint64_t> expired{0};
+    std::atomic<std::uint64_t> filled{0};
+    /// \brief Waits for a book update instead of sending an order the visible liquidity could not fill.
+    std::atomic<std::uint64_t> deferred{0};
+    /// \brief Orders which waited for the order rate limiter before being sent.
+    std::atomic<std::uint64_t> throttled{0};
+};
+
+
+} // namespace stats
+} // namespace tradebot
+} // namespace ad
@@ -0,0 +1,36 @@
+#pragma once
+
+
+#include "../Fragment.h"
+
+#include <trademath/Decimal.h>
+
+
+namespace ad {
+namespace tradebot {
+namespace stats {
+
+
+/// \brief Totals of the fragments of a pair on one side, maintained by the `Database` on each write.
+struct FragmentTotals
+{
+    Coin base;
+    Coin quote;
+    Side side;
+
+    // Base of the fragments not associated to an order
+    Decimal unassociatedBase{0};
+    // Quote value of the base above, at the target rate of each fragment
+    Decimal unassociatedQuote{0};
+    long unassociatedCount{0};
+
+    // Taken home by all fragments of this side (quote for sells, base for buys)
+    Decimal takenHome{0};
+
+    long id{-1}; // auto-increment by ORM
+};
+
+
+} // namespace stats
+} // namespace tradebot
+} // namespace ad
@@ -0,0 +1,135 @@
+#include "Latency.h"
+
+#include <spdlog/spdlog.h>
+
+#include <stdexcept>
+#include <utility>
+
+
+namespace ad {
+namespace tradebot {
+namespace stats {
+
+
+const char * to_string(LatencyStage aStage)
+{
+    switch(aStage)
+    {
+        case LatencyStage::EventToReceive:
+            return "event->receive";
+        case LatencyStage::ReceiveToDequeue:
+            return "receive->dequeue";
+        case LatencyStage::DequeueToPrepared:
+            return "dequeue->prepared";
+        case LatencyStage::PreparedToSent:
+            return "prepared->sent";
+        case LatencyStage::SentToResponse:
+            return "sent->response";
+        case LatencyStage::ResponseToCommit:
+            return "response->commit";
+        case LatencyStage::ReceiveToFirstCommit:
+            return "receive->first commit";
+        default:
+            throw std::domain_error{"Invalid LatencyStage enumerator."};
+    }
+}
+
+
+LatencyTrace LatencyRecorder::receive(MillisecondsSinceEpoch aEventTime)
+{
+    LatencyTrace trace{aEventTime};
+    // The exchange clock might be ahead of the local clock, clamp to zero.
+    MillisecondsSinceEpoch now = getTimestamp();
+    histograms[static_cast<std::size_t>(LatencyStage::EventToReceive)]
+        .record(now > aEventTime ? (now - aEventTime) * 1000 : 0);
+    return trace;
+}
+
+
+void LatencyRecorder::record(LatencyStage aStage, Clock::time_point aFrom, Clock::time_point aTo)
+{
+    histograms[static_cast<std::size_t>(aStage)].record(
+        std::chrono::duration_cast<std::chrono::microseconds>(aTo - aFrom).count());
+}
+
+
+void LatencyRecorder::stamp(LatencyStage aStage)
+{
+    if (current)
+    {
+        Clock::time_point now = Clock::now();
+        record(aStage, previousStamp, now);
+        previousStamp = now;
+    }
+}
+
+
+void LatencyRecorder::begin(const LatencyTrace & aTrace)
+{
+    current = aTrace;
+    committed = false;
+    previousStamp = Clock::now();
+    record(LatencyStage::ReceiveToDequeue, aTrace.received, previousStamp);
+}
+
+
+void LatencyRecorder::end()
+{
+    current.reset();
+}
+
+
+void LatencyRecorder::onPrepared()
+{
+    stamp(LatencyStage::DequeueToPrepared);
+}
+
+
+void LatencyRecorder::onSent()
+{
+    stamp(LatencyStage::PreparedToSent);
+}
+
+
+void LatencyRecorder::onResponse()
+{
+    stamp(LatencyStage::SentToResponse);
+}
+
+
+void LatencyRecorder::onCommitted()
+{
+    stamp(LatencyStage::ResponseToCommit);
+    if (current && ! std::exchange(committed, true))
+    {
+        record(LatencyStage::ReceiveToFirstCommit, current->received, previousStamp);
+    }
+}
+
+
+void LatencyRecorder::dump()
+{
+    for (std::size_t stage = 0; stage != histograms.size(); ++stage)
+    {
+        trade::Histogram::Summary summary = histograms[stage].summarize();
+        if (summary.count != 0)
+        {
+            spdlog::info("Latency '{}' (us) over {} samples: min {}, mean {:.1f}, p50 {}, p90 {}, p99 {}, p99.9 {}, max {}.",
+                         to_string(static_cast<LatencyStage>(stage)),
+                         summary.count,
+                         summary.min,
+                         summary.mean,
+                         summary.p50,
+                         summary.p90,
+                         summary.p99,
+                         summary.p999,
+                         summary.max);
+            histograms[stage].reset();
+        }
+    }
+}
+
+
+} // namespace stats
+} // namespace tradebot
+} // namespace ad
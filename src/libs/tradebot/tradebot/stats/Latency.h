@@ -0,0 +1,98 @@
+#pragma once
+
+
+#include <binance/Time.h>
+
+#include <trademath/Histogram.h>
+
+#include <array>
+#include <chrono>
+#include <optional>
+
+
+namespace ad {
+namespace tradebot {
+namespace stats {
+
+
+/// \brief Stages of the market-to-order path, each measured in its own histogram.
+enum class LatencyStage
+{
+    // Exchange event time ("E") to reception by the stream. Includes the clock skew with the exchange.
+    EventToReceive,
+    // Reception by the stream to dequeuing by the main loop.
+    ReceiveToDequeue,
+    // Previous stamp (dequeue, or previous order commit) to the order being prepared in database.
+    DequeueToPrepared,
+    // Prepared order (or previous expired FOK attempt) to the request being sent.
+    PreparedToSent,
+    // Request sent to the exchange response, for each FOK attempt.
+    SentToResponse,
+    // Exchange response to the fulfillment being committed to database.
+    ResponseToCommit,
+    // Reception by the stream to the first commit: the market-to-order latency.
+    ReceiveToFirstCommit,
+
+    // Keep last
+    _End,
+};
+
+
+const char * to_string(LatencyStage aStage);
+
+
+/// \brief Timestamps carried along with a market event, from the stream to the main loop.
+struct LatencyTrace
+{
+    using Clock = std::chrono::steady_clock;
+
+    MillisecondsSinceEpoch eventTime;
+    Clock::time_point received{Clock::now()};
+};
+
+
+/// \brief Record the latency of each stage on the market-to-order path, in microseconds.
+///
+/// `receive()` might be called from any thread (typically the stream).
+/// All other stamps are expected from the thread handling the event (the main loop):
+/// they are recorded against the trace given to `begin()`, and ignored outside of `begin()`/`end()`.
+class LatencyRecorder
+{
+public:
+    using Clock = LatencyTrace::Clock;
+
+    /// \brief Record the exchange-to-reception stage.
+    /// \param aEventTime The exchange event time ("E" field of market streams).
+    LatencyTrace receive(MillisecondsSinceEpoch aEventTime);
+
+    void begin(const LatencyTrace & aTrace);
+    void end();
+
+    void onPrepared();
+    void onSent();
+    void onResponse();
+    void onCommitted();
+
+    const trade::Histogram & get(LatencyStage aStage) const
+    { return histograms[static_cast<std::size_t>(aStage)]; }
+
+    /// \brief Log the summary of each stage with at least one value, then reset the histograms.
+    void dump();
+
+private:
+    void record(LatencyStage aStage, Clock::time_point aFrom, Clock::time_point aTo);
+    /// \brief Stamp the current time, recording it from the previous stamp.
+    void stamp(LatencyStage aStage);
+
+    std::array<trade::Histogram, static_cast<std::size_t>(LatencyStage::_End)> histograms;
+
+    // Only accessed from the thread handling the events
+    std::optional<LatencyTrace> current;
+    Clock::time_point previousStamp;
+    bool committed{false};
+};
+
+
+} // namespace stats
+} // namespace tradebot
+} // namespace ad
@@ -11,17 +11,28 @@ namespace ad {
 namespace trade {
 
 
+/// \brief A function known by its primitive, so it can be integrated.
+///
+/// The primitive type is deduced from the initializer (e.g. a lambda), so integration
+/// is statically dispatched and can be inlined in `spawnIntegration()`.
+/// `Function<>` type-erases the primitive, when it must be chosen at runtime.
+template <class T_primitive = std::function<Decimal(Decimal)>>
 struct Function
 {
-    using Function_t = std::function<Decimal(Decimal)>;
+    using Function_t = T_primitive;
 
-    Decimal integrate(Decimal aLowValue, Decimal aHighValue);
+    Decimal integrate(Decimal aLowValue, Decimal aHighValue) const;
 
     Function_t primitive;
 };
 
 
-inline Decimal Function::integrate(Decimal aLowValue, Decimal aHighValue)
+template <class T_primitive>
+Function(T_primitive) -> Function<T_primitive>;
+
+
+template <class T_primitive>
+inline Decimal Function<T_primitive>::integrate(Decimal aLowValue, Decimal aHighValue) const
 {
     return primitive(aHighValue) - primitive(aLowValue);
 }
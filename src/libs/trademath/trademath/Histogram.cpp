@@ -0,0 +1,168 @@
+#include "Histogram.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace ad {
+namespace trade {
+
+
+namespace {
+
+
+int mostSignificantBit(std::uint64_t aValue)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(aValue);
+#else
+    int result = 0;
+    while (aValue >>= 1)
+    {
+        ++result;
+    }
+    return result;
+#endif
+}
+
+
+} // anonymous namespace
+
+
+std::size_t Histogram::bucketIndex(std::uint64_t aValue)
+{
+    if (aValue < gSubBucketCount)
+    {
+        return static_cast<std::size_t>(aValue);
+    }
+
+    int msb = mostSignificantBit(aValue);
+    if (msb >= gMaxBits)
+    {
+        return gBucketCount - 1;
+    }
+    // The first group is the linear range [0, gSubBucketCount[
+    int group = msb - gSubBucketBits + 1;
+    std::uint64_t subBucket = (aValue >> (group - 1)) - gSubBucketCount;
+    return static_cast<std::size_t>(group * gSubBucketCount + subBucket);
+}
+
+
+std::uint64_t Histogram::bucketLowerBound(std::size_t aIndex)
+{
+    std::size_t group = aIndex / gSubBucketCount;
+    std::uint64_t subBucket = aIndex % gSubBucketCount;
+    return (group == 0) ? subBucket : ((gSubBucketCount + subBucket) << (group - 1));
+}
+
+
+std::uint64_t Histogram::bucketUpperBound(std::size_t aIndex)
+{
+    return (aIndex + 1 >= gBucketCount) ?
+        std::numeric_limits<std::uint64_t>::max()
+        : bucketLowerBound(aIndex + 1) - 1;
+}
+
+
+void Histogram::record(std::uint64_t aValue)
+{
+    buckets[bucketIndex(aValue)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    valueSum.fetch_add(aValue, std::memory_order_relaxed);
+
+    std::uint64_t current = minimum.load(std::memory_order_relaxed);
+    while (aValue < current
+           && ! minimum.compare_exchange_weak(current, aValue, std::memory_order_relaxed))
+    {}
+    current = maximum.load(std::memory_order_relaxed);
+    while (aValue > current
+           && ! maximum.compare_exchange_weak(current, aValue, std::memory_order_relaxed))
+    {}
+}
+
+
+std::uint64_t Histogram::count() const
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+
+std::uint64_t Histogram::sum() const
+{
+    return valueSum.load(std::memory_order_relaxed);
+}
+
+
+std::uint64_t Histogram::valueAtPercentile(double aPercentile) const
+{
+    if (aPercentile < 0. || aPercentile > 100.)
+    {
+        spdlog::critical("Percentile {} is outside of [0, 100].", aPercentile);
+        throw std::invalid_argument{"Invalid percentile."};
+    }
+
+    std::uint64_t recorded = count();
+    if (recorded == 0)
+    {
+        return 0;
+    }
+
+    // At least the first value
+    std::uint64_t target =
+        std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(aPercentile / 100. * recorded)));
+    std::uint64_t accumulated = 0;
+    for (std::size_t index = 0; index != gBucketCount; ++index)
+    {
+        accumulated += buckets[index].load(std::memory_order_relaxed);
+        if (accumulated >= target)
+        {
+            return std::min(bucketUpperBound(index), maximum.load(std::memory_order_relaxed));
+        }
+    }
+    // Concurrent recording might have incremented total after the buckets were read.
+    return maximum.load(std::memory_order_relaxed);
+}
+
+
+Histogram::Summary Histogram::summarize() const
+{
+    std::uint64_t recorded = count();
+    return Summary{
+        recorded,
+        recorded ? minimum.load(std::memory_order_relaxed) : 0,
+        maximum.load(std::memory_order_relaxed),
+        recorded ? static_cast<double>(valueSum.load(std::memory_order_relaxed)) / recorded : 0.,
+        valueAtPercentile(50.),
+        valueAtPercentile(90.),
+        valueAtPercentile(99.),
+        valueAtPercentile(99.9),
+    };
+}
+
+
+void Histogram::reset()
+{
+    for (auto & bucket : buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    valueSum.store(0, std::memory_order_relaxed);
+    minimum.store(std::numeric_limits<std::uint64_t>::max(), std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+
+Histogram & HistogramFamily::get(const std::string & aLabel)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    // Histogram is neither copyable nor movable, construct it in place.
+    return histograms.try_emplace(aLabel).first->second;
+}
+
+
+} // namespace trade
+} // namespace ad
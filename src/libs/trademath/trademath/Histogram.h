@@ -0,0 +1,132 @@
+#pragma once
+
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+
+
+namespace ad {
+namespace trade {
+
+
+/// \brief Histogram of non-negative integer values, with a bounded relative error (HDR-style).
+///
+/// Values are counted in log-linear buckets: values below `gSubBucketCount` have their own bucket,
+/// then each power of two range is divided in `gSubBucketCount` linear buckets,
+/// bounding the relative error to `1 / gSubBucketCount` (about 3%).
+///
+/// Recording is lock-free (relaxed atomic operations), so values can be recorded from any thread,
+/// concurrently with reading. Readings are not a consistent snapshot while recording goes on.
+class Histogram
+{
+public:
+    static constexpr int gSubBucketBits = 5;
+    static constexpr std::uint64_t gSubBucketCount = std::uint64_t{1} << gSubBucketBits;
+    /// \brief Values at or above `2^gMaxBits` are counted in the last bucket.
+    static constexpr int gMaxBits = 40;
+    static constexpr std::size_t gBucketCount = (gMaxBits - gSubBucketBits + 1) * gSubBucketCount;
+
+    struct Summary
+    {
+        std::uint64_t count;
+        std::uint64_t min;
+        std::uint64_t max;
+        double mean;
+        std::uint64_t p50;
+        std::uint64_t p90;
+        std::uint64_t p99;
+        std::uint64_t p999;
+    };
+
+    void record(std::uint64_t aValue);
+
+    std::uint64_t count() const;
+
+    /// \brief Sum of all recorded values.
+    std::uint64_t sum() const;
+
+    /// \param aPercentile In [0, 100].
+    /// \return The highest value equivalent to the bucket containing the percentile
+    /// (clamped to the recorded maximum), `0` if the histogram is empty.
+    std::uint64_t valueAtPercentile(double aPercentile) const;
+
+    Summary summarize() const;
+
+    /// \attention Values recorded concurrently with the reset might be partially accounted for.
+    void reset();
+
+    static std::size_t bucketIndex(std::uint64_t aValue);
+    static std::uint64_t bucketLowerBound(std::size_t aIndex);
+    static std::uint64_t bucketUpperBound(std::size_t aIndex);
+
+private:
+    std::array<std::atomic<std::uint64_t>, gBucketCount> buckets{};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> valueSum{0};
+    std::atomic<std::uint64_t> minimum{std::numeric_limits<std::uint64_t>::max()};
+    std::atomic<std::uint64_t> maximum{0};
+};
+
+
+/// \brief Histograms identified by a label (e.g. an endpoint, a statement).
+///
+/// Histograms are created on first access, and are never removed:
+/// the returned references remain valid for the lifetime of the family.
+class HistogramFamily
+{
+public:
+    Histogram & get(const std::string & aLabel);
+
+    /// \brief Invoke `aVisitor(const std::string & aLabel, const Histogram & aHistogram)`
+    /// for each histogram, in label order.
+    ///
+    /// \attention The family is locked during the visit, the visitor must not call `get()`.
+    template <class T_visitor>
+    void forEach(T_visitor && aVisitor) const
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        for (const auto & [label, histogram] : histograms)
+        {
+            aVisitor(label, histogram);
+        }
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, Histogram> histograms;
+};
+
+
+/// \brief Record the microseconds elapsed between construction and destruction into a histogram.
+class ScopedTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ScopedTimer(Histogram & aHistogram) :
+        histogram{aHistogram}
+    {}
+
+    ~ScopedTimer()
+    {
+        histogram.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer & operator=(const ScopedTimer &) = delete;
+
+private:
+    Histogram & histogram;
+    Clock::time_point start{Clock::now()};
+};
+
+
+} // namespace trade
+} // namespace ad
@@ -0,0 +1,60 @@
+#include "IntervalTracker.h"
+
+#include "DecimalLog.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+
+namespace ad {
+namespace trade {
+
+
+std::optional<Interval> IntervalTracker::update(Decimal aLatestPrice)
+{
+    trade::Ladder::const_reverse_iterator newLowerBound =
+        std::find_if(ladder.crbegin(), ladder.crend(), [&, this](auto stop)
+            {
+                return stop <= aLatestPrice;
+            });
+
+    if (   newLowerBound == ladder.crend()
+        || newLowerBound == ladder.crbegin())
+    {
+        if (ladder.size())
+        {
+            spdlog::warn("Price {} is out of the ladder interval [{}, {}].",
+                    aLatestPrice,
+                    ladder.front(),
+                    ladder.back());
+        }
+        else
+        {
+            spdlog::critical("Empty ladder is not allowed in an interval tracker.");
+            throw std::runtime_error{"The interval tracker ladder is empty."};
+        }
+    }
+
+    if (newLowerBound != std::exchange(lowerBound, newLowerBound))
+    {
+        return Interval{lowerBound == ladder.crend()   ? *(lowerBound-1) : *lowerBound,
+                        lowerBound == ladder.crbegin() ?     *lowerBound : *(lowerBound-1)};
+    }
+    else
+    {
+        return {};
+    }
+}
+
+
+void IntervalTracker::reset()
+{
+    lowerBound = ladder.crend();
+}
+
+
+} // namespace trade
+} // namespace ad
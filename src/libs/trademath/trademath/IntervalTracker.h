@@ -0,0 +1,27 @@
+#pragma once
+
+
+#include "Interval.h"
+#include "Ladder.h"
+
+#include <optional>
+
+
+namespace ad {
+namespace trade {
+
+
+struct IntervalTracker
+{
+    /// \return `true` if the latest price made the interval change.
+    std::optional<Interval> update(Decimal aLatestPrice);
+
+    void reset();
+
+    trade::Ladder ladder;
+    trade::Ladder::const_reverse_iterator lowerBound{ladder.crend()};
+};
+
+
+} // namespace trade
+} // namespace ad
@@ -5,6 +5,7 @@
 
 #include <boost/serialization/strong_typedef.hpp>
 
+#include <algorithm>
 #include <numeric>
 
 
@@ -161,6 +162,23 @@ spawnIntegration(const T_amount aAmount,
 }
 
 
+/// \brief Spawn `aProportion` of `aAmount` at `aRate`, the base being floored to `aAmountTickSize` if not zero.
+template <class T_amount>
+Spawn makeProportionSpawn(const T_amount aAmount, Decimal aProportion, Decimal aRate,
+                          Decimal aAmountTickSize)
+{
+    Decimal amount = (Decimal)aAmount * aProportion;
+    Spawn spawn{aRate, T_amount{amount}};
+    if (aAmountTickSize != 0) // we would expect compilers to optimize that away on default value
+    {
+        // Always apply the tick size to base value
+        // (For the moment binance only allow placing limit orders by giving the base value).
+        spawn.base = applyTickSizeFloor(spawn.base, aAmountTickSize);
+    }
+    return spawn;
+}
+
+
 /// \brief Compute a vector of `Spawn` and the corresponding accumulated base amount from a proportions' range.
 /// Can apply a tick size, filtering in `Base` values.
 ///
@@ -177,19 +195,13 @@ spawnProportions(const T_amount aAmount,
                  Decimal aAmountTickSize = Decimal{0})
 {
     std::vector<Spawn> result;
+    result.reserve(std::min<std::size_t>(std::distance(aStopBegin, aStopEnd),
+                                         std::distance(aProportionsBegin, aProportionsEnd)));
     Decimal accumulation{0};
 
     auto makeSpawn = [aAmount, aAmountTickSize](Decimal aProportion, Decimal aRate)
     {
-        Decimal amount = (Decimal)aAmount * aProportion;
-        Spawn spawn{aRate, T_amount{amount}};
-        if (aAmountTickSize != 0) // we would expect compilers to optimize that away on default value
-        {
-            // Always apply the tick size to base value
-            // (For the moment binance only allow placing limit orders by giving the base value).
-            spawn.base = applyTickSizeFloor(spawn.base, aAmountTickSize);
-        }
-        return spawn;
+        return makeProportionSpawn(aAmount, aProportion, aRate, aAmountTickSize);
     };
 
     while(aStopBegin != aStopEnd && aProportionsBegin != aProportionsEnd)
@@ -0,0 +1,206 @@
+#pragma once
+
+
+#include "Spawn.h"
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+
+namespace ad {
+namespace trade {
+
+
+/// \brief The spawns of a batch of fragments, as a structure of arrays.
+///
+/// The spawns of fragment `i` are in `[offsets[i], offsets[i+1])`.
+/// `clear()` keeps the capacity, so a batch reused across calls stops allocating.
+struct SpawnBatch
+{
+    void clear();
+
+    /// \return The number of fragments in the batch.
+    std::size_t size() const
+    { return accumulations.size(); }
+
+    /// \return The spawns of fragment `aFragment`, as the scalar spreader would return them.
+    std::vector<Spawn> getSpawns(std::size_t aFragment) const;
+
+    /// \brief Append the result of a spread for one fragment.
+    void append(const std::vector<Spawn> & aSpawns, Decimal aAccumulation);
+
+    std::vector<std::size_t> offsets{0};
+    std::vector<Decimal> rates;
+    std::vector<Decimal> bases;
+    /// \brief The accumulated amount of each fragment, in the amount type of the spread.
+    std::vector<Decimal> accumulations;
+    /// \brief Count of spawns computed with `Decimal` instead of the integer kernel.
+    std::size_t decimalSpawns{0};
+
+    // Scratch space of the integer kernel, kept to avoid allocations.
+    std::vector<std::uint64_t> tickCounts;
+    std::vector<std::uint8_t> exact;
+};
+
+
+inline void SpawnBatch::clear()
+{
+    offsets.resize(1);
+    rates.clear();
+    bases.clear();
+    accumulations.clear();
+    decimalSpawns = 0;
+}
+
+
+inline std::vector<Spawn> SpawnBatch::getSpawns(std::size_t aFragment) const
+{
+    std::vector<Spawn> result;
+    result.reserve(offsets[aFragment + 1] - offsets[aFragment]);
+    for (std::size_t spawnId = offsets[aFragment]; spawnId != offsets[aFragment + 1]; ++spawnId)
+    {
+        result.emplace_back(rates[spawnId], Base{bases[spawnId]});
+    }
+    return result;
+}
+
+
+inline void SpawnBatch::append(const std::vector<Spawn> & aSpawns, Decimal aAccumulation)
+{
+    for (const Spawn & spawn : aSpawns)
+    {
+        rates.push_back(spawn.rate);
+        bases.push_back(spawn.base);
+    }
+    offsets.push_back(rates.size());
+    accumulations.push_back(aAccumulation);
+    decimalSpawns += aSpawns.size();
+}
+
+
+/// \brief Scaled integer arithmetic reproducing the `Decimal` spawn computations.
+///
+/// The integer results are only used where they are known to be identical to the `Decimal` ones:
+/// * the inputs are exactly representable, and below bounds where `Decimal` products are exact,
+/// * the tick size inverse is exact, so `Decimal` floors exact values exactly,
+/// * for `Quote` amounts, the division by the rate is inexact with `Decimal`: the exact quotient
+///   must be far enough from a tick for the `Decimal` rounding not to change the floor.
+namespace fixed {
+
+
+using Wide = unsigned __int128;
+
+static_assert(EXCHANGE_DECIMALS == 8, "Scales below assume 8 exchange decimals.");
+
+/// \brief Rates, proportions and tick sizes are scaled by 10^8.
+constexpr std::uint64_t gScale = 100'000'000;
+/// \brief Amounts are scaled by 10^16, because they are often the product of two exchange values.
+constexpr std::uint64_t gAmountScale = gScale * gScale;
+
+constexpr std::uint64_t gMaxAmount = 1'000'000;
+constexpr std::uint64_t gMaxProportion = 1;
+constexpr std::uint64_t gMaxRate = 100'000'000;
+constexpr std::uint64_t gMaxTickSize = 1'000;
+
+/// \brief Relative distance to a tick under which the `Decimal` floor of a quotient is not trusted.
+constexpr std::uint64_t gQuotientMargin = 1'000'000'000;
+
+
+/// \return `aValue` scaled by `aScale`, if it is exactly representable and not above `aMaximum`.
+inline std::optional<Wide> toFixed(Decimal aValue, std::uint64_t aScale, std::uint64_t aMaximum)
+{
+    if (aValue < 0 || aValue > aMaximum)
+    {
+        return std::nullopt;
+    }
+    Decimal integral = trunc(aValue);
+    Decimal fractional = (aValue - integral) * aScale;
+    if (fractional != trunc(fractional))
+    {
+        return std::nullopt;
+    }
+    return Wide{integral.convert_to<std::uint64_t>()} * aScale + fractional.convert_to<std::uint64_t>();
+}
+
+
+/// \brief A tick size usable by the integer kernel.
+struct TickSize
+{
+    /// \return The tick size if it is not zero, and its `Decimal` inverse is exact.
+    static std::optional<TickSize> make(Decimal aTickSize);
+
+    Decimal value;
+    std::uint64_t scaled;
+};
+
+
+inline std::optional<TickSize> TickSize::make(Decimal aTickSize)
+{
+    std::optional<Wide> scaled = toFixed(aTickSize, gScale, gMaxTickSize);
+    if (! scaled || *scaled == 0 || gScale % *scaled != 0)
+    {
+        return std::nullopt;
+    }
+    // applyTickSizeFloor() divides by the tick size, i.e. multiplies by its computed inverse.
+    if (Decimal{1} / aTickSize != Decimal{static_cast<std::uint64_t>(gScale / *scaled)})
+    {
+        return std::nullopt;
+    }
+    return TickSize{aTickSize, static_cast<std::uint64_t>(*scaled)};
+}
+
+
+/// \brief Compute the tick counts of `aAmount * aProportions[i]`, for `Base` amounts.
+///
+/// All results are exact (`aExact` is set for each element).
+inline void computeTickCounts(Base,
+                              Wide aAmount,
+                              const std::uint64_t * aProportions,
+                              const std::uint64_t * /*aRates*/,
+                              std::size_t aCount,
+                              std::uint64_t aTickSize,
+                              std::uint64_t * aTickCounts,
+                              std::uint8_t * aExact)
+{
+    const Wide denominator = Wide{gAmountScale} * aTickSize;
+    for (std::size_t i = 0; i != aCount; ++i)
+    {
+        aTickCounts[i] = static_cast<std::uint64_t>((aAmount * aProportions[i]) / denominator);
+        aExact[i] = 1;
+    }
+}
+
+
+/// \brief Compute the tick counts of `aAmount * aProportions[i] / aRates[i]`, for `Quote` amounts.
+///
+/// `aExact` is cleared for the elements whose quotient is too close to a tick.
+inline void computeTickCounts(Quote,
+                              Wide aAmount,
+                              const std::uint64_t * aProportions,
+                              const std::uint64_t * aRates,
+                              std::size_t aCount,
+                              std::uint64_t aTickSize,
+                              std::uint64_t * aTickCounts,
+                              std::uint8_t * aExact)
+{
+    for (std::size_t i = 0; i != aCount; ++i)
+    {
+        const Wide numerator = aAmount * aProportions[i];
+        const Wide denominator = Wide{gScale} * aRates[i] * aTickSize;
+        const Wide quotient = numerator / denominator;
+        const Wide remainder = numerator - quotient * denominator;
+        const Wide margin = denominator / gQuotientMargin;
+        aTickCounts[i] = static_cast<std::uint64_t>(quotient);
+        aExact[i] = (remainder > margin) && (denominator - remainder > margin)
+                    && (quotient <= std::numeric_limits<std::uint64_t>::max());
+    }
+}
+
+
+} // namespace fixed
+
+
+} // namespace trade
+} // namespace ad
@@ -3,9 +3,16 @@
 
 #include "Ladder.h"
 #include "Spawn.h"
+#include "SpawnBatch.h"
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <stdexcept>
+
 
 namespace ad {
 namespace trade {
@@ -19,19 +26,128 @@ using ProportionsMap = std::vector<std::pair<Decimal/*max rate*/, std::vector<De
 
 struct ProportionSpreader
 {
+    /// \brief Precomputes, for each ladder stop, the proportions to spread with.
+    ///
+    /// \param aLadder Must be strictly increasing.
+    /// \param aMaxRateToProportions Must not be empty.
+    ProportionSpreader(Ladder aLadder,
+                       ProportionsMap aMaxRateToProportions,
+                       Decimal aAmountTickSize = trade::gDefaultTickSize);
+
+    template <class T_amount>
+    SpawnResult<T_amount> spreadDown(T_amount aAmount, Decimal aFromRate) const;
+    template <class T_amount>
+    SpawnResult<T_amount> spreadUp(T_amount aAmount, Decimal aFromRate) const;
+
+    /// \brief Spread each fragment of a structure of arrays, appending to `aOutput`.
+    ///
+    /// The results are identical to calling `spreadDown()` for each fragment, most spawns
+    /// being computed with scaled integers (see `fixed::computeTickCounts()`).
     template <class T_amount>
-    SpawnResult<T_amount> spreadDown(T_amount aAmount, Decimal aFromRate);
+    void spreadDownBatch(const std::vector<Decimal> & aAmounts,
+                         const std::vector<Decimal> & aFromRates,
+                         SpawnBatch & aOutput) const;
     template <class T_amount>
-    SpawnResult<T_amount> spreadUp(T_amount aAmount, Decimal aFromRate);
+    void spreadUpBatch(const std::vector<Decimal> & aAmounts,
+                       const std::vector<Decimal> & aFromRates,
+                       SpawnBatch & aOutput) const;
 
     const std::vector<Decimal> & getProportions(Decimal aFromRate) const;
 
-    Ladder ladder;
-    ProportionsMap maxRateToProportions;
+    /// \return The index of `aRate` in the ladder, throws if it is not a ladder stop.
+    std::size_t getStopIndex(Decimal aRate) const;
+
+    // Both are const, because the per-stop table is computed from them.
+    const Ladder ladder;
+    const ProportionsMap maxRateToProportions;
     Decimal amountTickSize{trade::gDefaultTickSize};
+
+private:
+    template <class T_amount>
+    void spreadBatch(const std::vector<Decimal> & aAmounts,
+                     const std::vector<Decimal> & aFromRates,
+                     bool aDown,
+                     SpawnBatch & aOutput) const;
+
+    /// \brief For each ladder stop, the index of its proportions in `maxRateToProportions`.
+    std::vector<std::size_t> stopProportions;
+
+    // Scaled values for the integer kernel, only present if all values are representable.
+    std::vector<std::optional<std::vector<std::uint64_t>>> fixedProportions;
+    std::optional<std::vector<std::uint64_t>> fixedLadder;
+    std::optional<std::vector<std::uint64_t>> reversedFixedLadder;
 };
 
 
+inline ProportionSpreader::ProportionSpreader(Ladder aLadder,
+                                              ProportionsMap aMaxRateToProportions,
+                                              Decimal aAmountTickSize) :
+    ladder{std::move(aLadder)},
+    maxRateToProportions{std::move(aMaxRateToProportions)},
+    amountTickSize{aAmountTickSize}
+{
+    if (maxRateToProportions.empty())
+    {
+        spdlog::critical("A proportion spreader requires at least one range of proportions.");
+        throw std::invalid_argument{"Proportion spreader without proportions."};
+    }
+    if (std::adjacent_find(ladder.begin(), ladder.end(), std::greater_equal<Decimal>{}) != ladder.end())
+    {
+        spdlog::critical("The ladder of a proportion spreader must be strictly increasing.");
+        throw std::invalid_argument{"Proportion spreader ladder is not strictly increasing."};
+    }
+
+    std::size_t stopsAbove = 0;
+    stopProportions.reserve(ladder.size());
+    for (const Decimal stop : ladder)
+    {
+        auto found = std::find_if(maxRateToProportions.begin(), maxRateToProportions.end(),
+                                  [stop](const auto & aRange){ return stop <= aRange.first; });
+        if (found == maxRateToProportions.end())
+        {
+            ++stopsAbove;
+            --found;
+        }
+        stopProportions.push_back(found - maxRateToProportions.begin());
+    }
+
+    if (stopsAbove != 0)
+    {
+        spdlog::warn("{} ladder stops are above the last proportions max rate {}. They use the last proportions.",
+                     stopsAbove,
+                     static_cast<float>(maxRateToProportions.back().first));
+    }
+
+    auto toFixedValues = [](const std::vector<Decimal> & aValues, std::uint64_t aMaximum)
+        -> std::optional<std::vector<std::uint64_t>>
+    {
+        std::vector<std::uint64_t> result;
+        result.reserve(aValues.size());
+        for (const Decimal value : aValues)
+        {
+            if (std::optional<fixed::Wide> scaled = fixed::toFixed(value, fixed::gScale, aMaximum))
+            {
+                result.push_back(static_cast<std::uint64_t>(*scaled));
+            }
+            else
+            {
+                return std::nullopt;
+            }
+        }
+        return result;
+    };
+
+    for (const auto & range : maxRateToProportions)
+    {
+        fixedProportions.push_back(toFixedValues(range.second, fixed::gMaxProportion));
+    }
+    if ((fixedLadder = toFixedValues(ladder, fixed::gMaxRate)))
+    {
+        reversedFixedLadder.emplace(fixedLadder->rbegin(), fixedLadder->rend());
+    }
+}
+
+
 inline const std::vector<Decimal> & ProportionSpreader::getProportions(Decimal aFromRate) const
 {
     for(const auto & [maxRate, proportions] : maxRateToProportions)
@@ -48,35 +164,142 @@ inline const std::vector<Decimal> & ProportionSpreader::getProportions(Decimal a
 }
 
 
-template <class T_amount>
-SpawnResult<T_amount> ProportionSpreader::spreadDown(T_amount aAmount, Decimal aFromRate)
+inline std::size_t ProportionSpreader::getStopIndex(Decimal aRate) const
 {
-    // reverseStop will never be ladder.rend(): getStopFor() throws when stop is not found.
-    auto reverseStop = getStopFor(ladder.crbegin(), ladder.crend(), aFromRate);
+    auto stop = std::lower_bound(ladder.begin(), ladder.end(), aRate);
+    if (stop == ladder.end() || *stop != aRate)
+    {
+        spdlog::critical("Cannot match a ladder stop to rate: '{}'.", static_cast<float>(aRate));
+        throw std::logic_error{"Target rate does not match a ladder stop."};
+    }
+    return stop - ladder.begin();
+}
+
 
-    auto proportions = getProportions(aFromRate);
+template <class T_amount>
+SpawnResult<T_amount> ProportionSpreader::spreadDown(T_amount aAmount, Decimal aFromRate) const
+{
+    std::size_t stopIndex = getStopIndex(aFromRate);
+    const std::vector<Decimal> & proportions = maxRateToProportions[stopProportions[stopIndex]].second;
     return trade::spawnProportions(aAmount,
-                                   // +1 because no fragment should be assigned to the current stop.
-                                   reverseStop+1, ladder.crend(),
+                                   // No fragment should be assigned to the current stop.
+                                   ladder.crend() - stopIndex, ladder.crend(),
                                    proportions.cbegin(), proportions.cend(),
                                    amountTickSize);
 }
 
 
 template <class T_amount>
-SpawnResult<T_amount> ProportionSpreader::spreadUp(T_amount aAmount, Decimal aFromRate)
+SpawnResult<T_amount> ProportionSpreader::spreadUp(T_amount aAmount, Decimal aFromRate) const
 {
-    // reverseStop will never be ladder.end(): getStopFor() throws when stop is not found.
-    auto forwardStop = getStopFor(ladder.cbegin(), ladder.cend(), aFromRate);
-
-    auto proportions = getProportions(aFromRate);
+    std::size_t stopIndex = getStopIndex(aFromRate);
+    const std::vector<Decimal> & proportions = maxRateToProportions[stopProportions[stopIndex]].second;
     return trade::spawnProportions(aAmount,
                                    // +1 because no fragment should be assigned to the current stop.
-                                   forwardStop+1, ladder.cend(),
+                                   ladder.cbegin() + stopIndex + 1, ladder.cend(),
                                    proportions.cbegin(), proportions.cend(),
                                    amountTickSize);
 }
 
 
+template <class T_amount>
+void ProportionSpreader::spreadDownBatch(const std::vector<Decimal> & aAmounts,
+                                         const std::vector<Decimal> & aFromRates,
+                                         SpawnBatch & aOutput) const
+{
+    spreadBatch<T_amount>(aAmounts, aFromRates, true, aOutput);
+}
+
+
+template <class T_amount>
+void ProportionSpreader::spreadUpBatch(const std::vector<Decimal> & aAmounts,
+                                       const std::vector<Decimal> & aFromRates,
+                                       SpawnBatch & aOutput) const
+{
+    spreadBatch<T_amount>(aAmounts, aFromRates, false, aOutput);
+}
+
+
+template <class T_amount>
+void ProportionSpreader::spreadBatch(const std::vector<Decimal> & aAmounts,
+                                     const std::vector<Decimal> & aFromRates,
+                                     bool aDown,
+                                     SpawnBatch & aOutput) const
+{
+    if (aAmounts.size() != aFromRates.size())
+    {
+        spdlog::critical("Spreading a batch of {} amounts with {} rates.", aAmounts.size(), aFromRates.size());
+        throw std::invalid_argument{"Batch amounts and rates must have the same size."};
+    }
+
+    const std::optional<fixed::TickSize> tickSize = fixed::TickSize::make(amountTickSize);
+    constexpr bool isQuote = std::is_same_v<T_amount, Quote>;
+
+    for (std::size_t fragmentId = 0; fragmentId != aAmounts.size(); ++fragmentId)
+    {
+        const T_amount amount{aAmounts[fragmentId]};
+        const std::size_t stopIndex = getStopIndex(aFromRates[fragmentId]);
+        const std::size_t rangeIndex = stopProportions[stopIndex];
+        const std::vector<Decimal> & proportions = maxRateToProportions[rangeIndex].second;
+        const std::size_t stopCount = aDown ? stopIndex : ladder.size() - stopIndex - 1;
+        const std::optional<fixed::Wide> fixedAmount =
+            fixed::toFixed(aAmounts[fragmentId], fixed::gAmountScale, fixed::gMaxAmount);
+
+        // The kernel does not handle the remaining proportions accumulated in the last spawn.
+        if (! tickSize
+            || ! fixedAmount
+            || ! fixedProportions[rangeIndex]
+            || (isQuote && ! fixedLadder)
+            || proportions.size() > stopCount)
+        {
+            auto [spawns, accumulation] = aDown ? spreadDown(amount, aFromRates[fragmentId])
+                                                : spreadUp(amount, aFromRates[fragmentId]);
+            aOutput.append(spawns, static_cast<Decimal>(accumulation));
+            continue;
+        }
+
+        const std::size_t count = proportions.size();
+        const std::uint64_t * fixedRates = nullptr;
+        if (fixedLadder)
+        {
+            fixedRates = aDown ? reversedFixedLadder->data() + (ladder.size() - stopIndex)
+                               : fixedLadder->data() + stopIndex + 1;
+        }
+        aOutput.tickCounts.resize(count);
+        aOutput.exact.resize(count);
+        fixed::computeTickCounts(T_amount{},
+                                 *fixedAmount,
+                                 fixedProportions[rangeIndex]->data(),
+                                 fixedRates,
+                                 count,
+                                 tickSize->scaled,
+                                 aOutput.tickCounts.data(),
+                                 aOutput.exact.data());
+
+        Decimal accumulation{0};
+        for (std::size_t spawnId = 0; spawnId != count; ++spawnId)
+        {
+            const Decimal rate = aDown ? ladder[stopIndex - 1 - spawnId] : ladder[stopIndex + 1 + spawnId];
+            Spawn spawn{rate, Base{0}};
+            if (aOutput.exact[spawnId])
+            {
+                // Same operation as applyTickSizeFloor().
+                spawn.base = tickSize->value * Decimal{aOutput.tickCounts[spawnId]};
+            }
+            else
+            {
+                spawn = makeProportionSpawn(amount, proportions[spawnId], rate, amountTickSize);
+                ++aOutput.decimalSpawns;
+            }
+            accumulation += spawn.getAmount<T_amount>();
+            aOutput.rates.push_back(spawn.rate);
+            aOutput.bases.push_back(spawn.base);
+        }
+        aOutput.offsets.push_back(aOutput.rates.size());
+        aOutput.accumulations.push_back(accumulation);
+    }
+}
+
+
 } // namespace trade
 } // namespace ad
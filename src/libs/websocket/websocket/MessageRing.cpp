@@ -0,0 +1,102 @@
+#include "MessageRing.h"
+
+#include <spdlog/spdlog.h>
+
+#include <cstdint>
+
+
+namespace ad {
+namespace net {
+
+
+namespace {
+
+
+std::size_t nextPowerOfTwo(std::size_t aValue)
+{
+    std::size_t result = 1;
+    while (result < aValue)
+    {
+        result <<= 1;
+    }
+    return result;
+}
+
+
+} // anonymous namespace
+
+
+MessageRing::MessageRing(std::size_t aCapacity, std::size_t aMessageReserve) :
+    mMask{nextPowerOfTwo(aCapacity) - 1},
+    mSlots{std::make_unique<Slot[]>(mMask + 1)}
+{
+    if (aCapacity < 2)
+    {
+        spdlog::critical("A message ring requires at least 2 slots, {} requested.", aCapacity);
+        throw std::invalid_argument{"Message ring capacity must be at least 2."};
+    }
+
+    for (std::size_t position = 0; position != capacity(); ++position)
+    {
+        mSlots[position].mSequence.store(position, std::memory_order_relaxed);
+        mSlots[position].mMessage.reserve(aMessageReserve);
+    }
+}
+
+
+bool MessageRing::push(std::string_view aMessage)
+{
+    std::size_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        Slot & slot = mSlots[position & mMask];
+        std::size_t sequence = slot.mSequence.load(std::memory_order_acquire);
+        auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+        if (difference == 0)
+        {
+            // The slot is free, try to claim it.
+            if (mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                slot.mMessage.assign(aMessage);
+                // Publishes the message to the consumer.
+                slot.mSequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+            // On failure, position was reloaded by compare_exchange.
+        }
+        else if (difference < 0)
+        {
+            // The slot still holds a message from the previous lap: full.
+            return false;
+        }
+        else
+        {
+            // Another producer claimed the slot.
+            position = mEnqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+const std::string * MessageRing::front()
+{
+    Slot & slot = mSlots[mDequeuePosition & mMask];
+    if (slot.mSequence.load(std::memory_order_acquire) == mDequeuePosition + 1)
+    {
+        return &slot.mMessage;
+    }
+    return nullptr;
+}
+
+
+void MessageRing::pop()
+{
+    Slot & slot = mSlots[mDequeuePosition & mMask];
+    // Makes the slot available to the producers of the next lap.
+    slot.mSequence.store(mDequeuePosition + mMask + 1, std::memory_order_release);
+    ++mDequeuePosition;
+}
+
+
+} // namespace net
+} // namespace ad
@@ -0,0 +1,59 @@
+#pragma once
+
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+
+
+namespace ad {
+namespace net {
+
+
+/// \brief Bounded lock-free queue of messages, for multiple producers and a single consumer.
+///
+/// Based on Dmitry Vyukov's bounded MPMC queue.
+/// Each slot owns a string whose capacity is reserved upfront, so pushing a message
+/// not larger than this reserve does not allocate.
+/// The consumer accesses the front message in place, then releases its slot with `pop()`
+/// (e.g. once the message has been written).
+class MessageRing
+{
+public:
+    /// \param aCapacity Number of slots, rounded up to the next power of two.
+    /// \param aMessageReserve Capacity reserved for the message of each slot.
+    MessageRing(std::size_t aCapacity, std::size_t aMessageReserve);
+
+    /// \brief Copies the message in the next free slot, thread safe.
+    /// \return `false` if the ring is full, the message is then not queued.
+    bool push(std::string_view aMessage);
+
+    /// \brief Consumer only.
+    /// \return The front message, or `nullptr` if the ring is empty.
+    const std::string * front();
+
+    /// \brief Consumer only, releases the front slot.
+    /// \attention Requires `front()` to have returned a message.
+    void pop();
+
+    std::size_t capacity() const
+    { return mMask + 1; }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::size_t> mSequence;
+        std::string mMessage;
+    };
+
+    std::size_t mMask;
+    std::unique_ptr<Slot[]> mSlots;
+    // Separate cache lines for the producers and the consumer positions.
+    alignas(64) std::atomic<std::size_t> mEnqueuePosition{0};
+    alignas(64) std::size_t mDequeuePosition{0};
+};
+
+
+} // namespace net
+} // namespace ad
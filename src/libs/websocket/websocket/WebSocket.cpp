@@ -1,5 +1,7 @@
 #include "WebSocket.h"
 
+#include "MessageRing.h"
+
 #include <boost/beast.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/beast/websocket/ssl.hpp>
@@ -68,61 +70,193 @@ void logFailure(beast::error_code aErrorCode, const std::string & aWhat)
 }
 
 
-struct WebSocket::Impl
+namespace {
+
+
+struct Counters
+{
+    std::atomic<std::uint64_t> messagesReceived{0};
+    std::atomic<std::uint64_t> messagesSent{0};
+    std::atomic<std::uint64_t> payloadBytesReceived{0};
+    std::atomic<std::uint64_t> payloadBytesSent{0};
+    std::atomic<std::uint64_t> wireBytesReceived{0};
+    std::atomic<std::uint64_t> wireBytesSent{0};
+};
+
+
+/// \brief Beast rate policy never limiting the transfers, only counting the bytes on the socket.
+class CountingRatePolicy
 {
-    void run(std::string aHost, const std::string & aPort, const std::string & aTarget);
+    friend class beast::rate_policy_access;
+
+    static constexpr std::size_t all = (std::numeric_limits<std::size_t>::max)();
+
+    std::size_t available_read_bytes() const noexcept
+    { return all; }
+
+    std::size_t available_write_bytes() const noexcept
+    { return all; }
+
+    void transfer_read_bytes(std::size_t aBytes) noexcept
+    { mCounters->wireBytesReceived.fetch_add(aBytes, std::memory_order_relaxed); }
+
+    void transfer_write_bytes(std::size_t aBytes) noexcept
+    { mCounters->wireBytesSent.fetch_add(aBytes, std::memory_order_relaxed); }
+
+    void on_timer() noexcept
+    {}
+
+public:
+    Counters * mCounters{nullptr};
+};
+
 
+using CountingTcpStream = beast::basic_stream<::net::ip::tcp, ::net::any_io_executor, CountingRatePolicy>;
+
+
+} // anonymous namespace
+
+
+struct WebSocket::Impl : public std::enable_shared_from_this<Impl>
+{
+    explicit Impl(::net::io_context * aSharedContext);
+
+    void async_run(std::string aHost, std::string aPort, std::string aTarget);
+
+    void onResolve(beast::error_code aErrorCode,
+                   ::net::ip::tcp::resolver::results_type aResults,
+                   std::string aHost,
+                   std::string aTarget);
+    void onConnect(beast::error_code aErrorCode,
+                   ::net::ip::tcp::endpoint aEndpoint,
+                   std::string aHost,
+                   std::string aTarget);
+    void onSslHandshake(beast::error_code aErrorCode, std::string aHost, std::string aTarget);
     void onHandshake(beast::error_code aErrorCode);
     void onWrite(beast::error_code aErrorCode, std::size_t aBytesTransferred);
     void onRead(beast::error_code aErrorCode, std::size_t aBytesTransferred);
     void onClose(beast::error_code aErrorCode);
 
-    void writeImplementation();
+    /// \brief Makes sure the writer is running, any thread.
+    void kickWriter();
+    /// \brief Writes the front message, if any (strand).
     void writeNext();
+    /// \brief Discards all queued messages (strand).
+    void discardOutbound();
 
     void readNext();
 
-    void async_send(const std::string & aMessage);
+    bool async_send(const std::string & aMessage);
     void async_close();
+    void closeImplementation();
+
+    /// \brief Invoked once the websocket stopped running (closed, or failed to connect).
+    void finish();
 
-    static const std::string gFifoGuard;
+    static constexpr std::size_t gOutboundCapacity{256};
+    static constexpr std::size_t gOutboundMessageReserve{512};
 
-    ::net::io_context mIoc;
+    // Only set when the websocket does not run on a shared io_context.
+    std::unique_ptr<::net::io_context> mOwnedIoc;
+    ::net::io_context & mIoc;
+    // Serializes all handlers of this websocket, even if the io_context is run by several threads.
+    ::net::strand<::net::io_context::executor_type> mStrand;
+    ::net::ip::tcp::resolver mResolver{mStrand};
     ::net::ssl::context mSslCtx{::net::ssl::context::tlsv12_client};
-    beast::websocket::stream<beast::ssl_stream<beast::tcp_stream>> mStream{mIoc, mSslCtx};
+    beast::websocket::stream<beast::ssl_stream<CountingTcpStream>> mStream{mStrand, mSslCtx};
     beast::flat_buffer mBuffer;
 
-    std::mutex mWriteMutex;
-    // The initial value prevents call to async_send before connection is established
-    // from trying to send immediatly.
-    std::queue<std::string> mMessageFifo{{gFifoGuard}};
+    // Messages queued before the connection is established are sent once connected.
+    MessageRing mOutbound{gOutboundCapacity, gOutboundMessageReserve};
+    // Set while the writer is running (or scheduled), so only one producer schedules it.
+    std::atomic<bool> mWriting{false};
 
     std::atomic<bool> mClosing{false};
+    std::atomic<bool> mConnected{false};
+    // Only accessed from the strand.
+    bool mWritePending{false};
+    bool mFinished{false};
 
     WebSocket::ConnectCallback mConnectCallback{[](){}};
     WebSocket::ReceiveCallback mReceiveCallback{[](const std::string &){}};
+    WebSocket::CloseCallback mCloseCallback{[](){}};
+
+    WebSocket::Compression mCompression;
+    Counters mCounters;
 };
 
 
-const std::string WebSocket::Impl::gFifoGuard{"NOT-CONNECTED-GUARD"};
+WebSocket::Impl::Impl(::net::io_context * aSharedContext) :
+    mOwnedIoc{aSharedContext ? nullptr : std::make_unique<::net::io_context>()},
+    mIoc{aSharedContext ? *aSharedContext : *mOwnedIoc},
+    mStrand{::net::make_strand(mIoc)}
+{
+    beast::get_lowest_layer(mStream).rate_policy().mCounters = &mCounters;
+}
+
+
+void WebSocket::Impl::async_run(std::string aHost, std::string aPort, std::string aTarget)
+{
+    // The resolver is only accessed from the strand.
+    ::net::dispatch(
+        mStrand,
+        [self = shared_from_this(), host = std::move(aHost), port = std::move(aPort), target = std::move(aTarget)]
+        () mutable
+        {
+            self->mFinished = false;
+            self->mResolver.async_resolve(
+                host,
+                port,
+                [self, host, target](beast::error_code aErrorCode,
+                                     ::net::ip::tcp::resolver::results_type aResults)
+                {
+                    self->onResolve(aErrorCode, std::move(aResults), std::move(host), std::move(target));
+                });
+        });
+}
 
 
-void WebSocket::Impl::run(std::string aHost, const std::string & aPort, const std::string & aTarget)
+void WebSocket::Impl::onResolve(beast::error_code aErrorCode,
+                                ::net::ip::tcp::resolver::results_type aResults,
+                                std::string aHost,
+                                std::string aTarget)
 {
-    ::net::ip::tcp::resolver resolver{mIoc};
+    if (aErrorCode || mClosing)
+    {
+        logFailure(aErrorCode, "Resolve");
+        return finish();
+    }
+
+    // Set a timeout on the connection and SSL handshake
+    beast::get_lowest_layer(mStream).expires_after(std::chrono::seconds(20));
 
     // Connect the socket to the IP address returned from performing a name lookup
-    ::net::ip::tcp::endpoint endpoint =
-        get_lowest_layer(mStream).connect(resolver.resolve(aHost, aPort));
-    spdlog::debug("Connected to '{}' on port {}.", aHost, aPort);
+    beast::get_lowest_layer(mStream).async_connect(
+        aResults,
+        [self = shared_from_this(), host = std::move(aHost), target = std::move(aTarget)]
+        (beast::error_code aErrorCode, ::net::ip::tcp::endpoint aEndpoint)
+        {
+            self->onConnect(aErrorCode, aEndpoint, std::move(host), std::move(target));
+        });
+}
+
+
+void WebSocket::Impl::onConnect(beast::error_code aErrorCode,
+                                ::net::ip::tcp::endpoint aEndpoint,
+                                std::string aHost,
+                                std::string aTarget)
+{
+    if (aErrorCode || mClosing)
+    {
+        logFailure(aErrorCode, "Connect");
+        return finish();
+    }
+    spdlog::debug("Connected to '{}' on port {}.", aHost, aEndpoint.port());
 
     // Update the host string. This will provide the value of the
     // Host HTTP header during the WebSocket handshake.
     // See https://tools.ietf.org/html/rfc7230#section-5.4
-    aHost += ':' + std::to_string(endpoint.port());
-
-    // Set a timeout on the operation
-    beast::get_lowest_layer(mStream).expires_after(std::chrono::seconds(20));
+    aHost += ':' + std::to_string(aEndpoint.port());
 
     // Set SNI Hostname (many hosts need this to handshake successfully)
     // Binance does require it
@@ -132,11 +266,28 @@ void WebSocket::Impl::run(std::string aHost, const std::string & aPort, const st
     {
         auto ec = beast::error_code(static_cast<int>(::ERR_get_error()),
                                     ::net::error::get_ssl_category());
-        return logFailure(ec, "Connect");
+        logFailure(ec, "Connect");
+        return finish();
     }
 
     // SSL handshake
-    mStream.next_layer().handshake(::net::ssl::stream_base::client);
+    mStream.next_layer().async_handshake(
+        ::net::ssl::stream_base::client,
+        [self = shared_from_this(), host = std::move(aHost), target = std::move(aTarget)]
+        (beast::error_code aErrorCode)
+        {
+            self->onSslHandshake(aErrorCode, std::move(host), std::move(target));
+        });
+}
+
+
+void WebSocket::Impl::onSslHandshake(beast::error_code aErrorCode, std::string aHost, std::string aTarget)
+{
+    if (aErrorCode || mClosing)
+    {
+        logFailure(aErrorCode, "SSL handshake");
+        return finish();
+    }
     spdlog::trace("SSL handshake complete.");
 
     // Turn off the timeout on the tcp_stream, because
@@ -146,37 +297,51 @@ void WebSocket::Impl::run(std::string aHost, const std::string & aPort, const st
     // Set suggested timeout settings for the websocket
     mStream.set_option(beast::websocket::stream_base::timeout::suggested(beast::role_type::client));
 
+    // The extension is negotiated during the handshake.
+    beast::websocket::permessage_deflate deflate;
+    deflate.client_enable = mCompression.enabled;
+    deflate.client_max_window_bits = mCompression.windowBits;
+    deflate.server_max_window_bits = mCompression.windowBits;
+    deflate.client_no_context_takeover = mCompression.noContextTakeover;
+    deflate.server_no_context_takeover = mCompression.noContextTakeover;
+    deflate.compLevel = mCompression.compressionLevel;
+    deflate.memLevel = mCompression.memoryLevel;
+    mStream.set_option(deflate);
+
     // Do the websocket handshake in the client role, on the connected stream.
     // The implementation only uses the Host parameter to set the HTTP "Host" field,
     // it does not perform any DNS lookup. That must be done first, as shown above.
     mStream.async_handshake(
         aHost,  // The Host field
         aTarget,     // The request-target
-        std::bind(&Impl::onHandshake, this, std::placeholders::_1)
+        std::bind(&Impl::onHandshake, shared_from_this(), std::placeholders::_1)
     );
 }
 
 
 void WebSocket::Impl::onHandshake(beast::error_code aErrorCode)
 {
-    if(aErrorCode)
+    // A close requested during the handshake only cancelled the socket,
+    // the handshake might still have completed before the cancellation.
+    if(aErrorCode || mClosing)
     {
         logFailure(aErrorCode, "Websocket handshake");
+        finish();
     }
     else
     {
         spdlog::trace("Websocket handshake complete.");
 
         spdlog::info("Websocket connection established.");
+        mConnected = true;
 
         // Start reading incoming messages
         readNext();
 
         mConnectCallback();
 
-        // Pop the initial guard from the message queue
-        // then tries to send if other were queued by client
-        writeNext();
+        // Sends the messages queued by the client before the connection.
+        kickWriter();
     }
 }
 
@@ -191,10 +356,27 @@ void WebSocket::Impl::onClose(beast::error_code aErrorCode)
     {
         spdlog::info("Websocket closed.");
     }
+    // The outstanding read completes with an error, which finishes the websocket.
+}
+
+
+void WebSocket::Impl::finish()
+{
+    if (mFinished)
+    {
+        return;
+    }
+    mFinished = true;
+    mConnected = false;
 
-    // Clear the fifo and reset the guard for next connection.
-    mMessageFifo = decltype(mMessageFifo){{gFifoGuard}};
+    // Discard the messages of this connection. A pending write will discard once completed.
+    if (! mWritePending)
+    {
+        discardOutbound();
+    }
     mClosing = false;
+
+    mCloseCallback();
 }
 
 
@@ -203,6 +385,7 @@ void WebSocket::Impl::onRead(beast::error_code aErrorCode, std::size_t aBytesTra
     if(aErrorCode)
     {
         logFailure(aErrorCode, "Websocket read");
+        finish();
     }
     else
     {
@@ -211,7 +394,21 @@ void WebSocket::Impl::onRead(beast::error_code aErrorCode, std::size_t aBytesTra
         //              aBytesTransferred,
         //              beast::buffers_to_string(mBuffer.cdata()));
 
-        mReceiveCallback(beast::buffers_to_string(mBuffer.cdata()));
+        mCounters.messagesReceived.fetch_add(1, std::memory_order_relaxed);
+        mCounters.payloadBytesReceived.fetch_add(aBytesTransferred, std::memory_order_relaxed);
+
+        try
+        {
+            mReceiveCallback(beast::buffers_to_string(mBuffer.cdata()));
+        }
+        catch (std::exception & aException)
+        {
+            // Would otherwise escape into the (potentially shared) io_context run.
+            spdlog::error("Websocket receive callback raised an exception: {}. Closing.",
+                          aException.what());
+            mClosing = true;
+            closeImplementation();
+        }
         mBuffer.consume(aBytesTransferred);
         readNext();
     }
@@ -222,50 +419,100 @@ void WebSocket::Impl::readNext()
 {
     mStream.async_read(
         mBuffer,
-        std::bind(&Impl::onRead, this, std::placeholders::_1, std::placeholders::_2));
+        std::bind(&Impl::onRead, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
 }
 
 
 void WebSocket::Impl::onWrite(beast::error_code aErrorCode, std::size_t aBytesTransferred)
 {
+    mWritePending = false;
+    mOutbound.pop(); // pop the message corresponding to this completion handler
+
     if(aErrorCode)
     {
         logFailure(aErrorCode, "Websocket write");
+        mWriting = false;
     }
     else
     {
         spdlog::trace("Successfully wrote {} bytes.", aBytesTransferred);
+        mCounters.messagesSent.fetch_add(1, std::memory_order_relaxed);
+        mCounters.payloadBytesSent.fetch_add(aBytesTransferred, std::memory_order_relaxed);
+        // Drains the queued messages back-to-back, without going through the io_context queue.
         writeNext();
     }
+
+    if (mFinished)
+    {
+        discardOutbound();
+    }
 }
 
 
 void WebSocket::Impl::writeNext()
 {
-    std::scoped_lock queueLock{mWriteMutex};
-    mMessageFifo.pop(); // pop the message corresponding to this completion handler
-    if (! mMessageFifo.empty())
+    if (const std::string * message = (mConnected ? mOutbound.front() : nullptr))
+    {
+        // The message stays in its slot, which is popped by the completion handler.
+        mWritePending = true;
+        mStream.async_write(
+                ::net::buffer(*message),
+                std::bind(&Impl::onWrite, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+        return;
+    }
+
+    mWriting = false;
+    // A producer might have pushed after front() returned nothing, but before mWriting was reset,
+    // in which case it did not schedule the writer.
+    if (mConnected && mOutbound.front() && ! mWriting.exchange(true))
     {
-        writeImplementation();
+        writeNext();
     }
 }
 
 
-void WebSocket::Impl::async_send(const std::string & aMessage)
+void WebSocket::Impl::discardOutbound()
 {
+    while (mOutbound.front())
     {
-        std::scoped_lock queueLock{mWriteMutex};
-        mMessageFifo.push(aMessage);
-        // If the queue was empty, there is no async_write already going on
-        if (mMessageFifo.size() > 1)
-        {
-            return;
-        }
+        mOutbound.pop();
+    }
+}
+
 
-        // Note: It might be possible to take this call out of the critical section
-        // **if** it is safe to read the front of a std::queue while pushing concurrently.
-        writeImplementation();
+void WebSocket::Impl::kickWriter()
+{
+    if (! mWriting.exchange(true))
+    {
+        // The stream must only be accessed from its strand.
+        // Weak, so a handler left pending in an owned io_context does not keep its owner alive.
+        ::net::post(mStrand,
+                    [weak = weak_from_this()]
+                    {
+                        if (auto self = weak.lock())
+                        {
+                            self->writeNext();
+                        }
+                    });
+    }
+}
+
+
+bool WebSocket::Impl::async_send(const std::string & aMessage)
+{
+    if (! mOutbound.push(aMessage))
+    {
+        spdlog::error("Websocket outbound queue is full ({} messages), message is dropped.",
+                      mOutbound.capacity());
+        return false;
     }
+
+    // Before connection, the messages stay queued until the handshake completes.
+    if (mConnected)
+    {
+        kickWriter();
+    }
+    return true;
 }
 
 
@@ -274,9 +521,14 @@ void WebSocket::Impl::async_close()
     if (! mClosing.exchange(true))
     {
         spdlog::trace("Request for websocket to close.");
-        mStream.async_close(
-            beast::websocket::close_code::normal,
-            std::bind(&Impl::onClose, this, std::placeholders::_1));
+        ::net::post(mStrand,
+                    [weak = weak_from_this()]
+                    {
+                        if (auto self = weak.lock())
+                        {
+                            self->closeImplementation();
+                        }
+                    });
     }
     else
     {
@@ -285,17 +537,31 @@ void WebSocket::Impl::async_close()
 }
 
 
-void WebSocket::Impl::writeImplementation()
+void WebSocket::Impl::closeImplementation()
 {
-    // The message will be popped by the completion handler
-    mStream.async_write(
-            ::net::buffer(mMessageFifo.front()),
-            std::bind(&Impl::onWrite, this, std::placeholders::_1, std::placeholders::_2));
+    if (mConnected)
+    {
+        mStream.async_close(
+            beast::websocket::close_code::normal,
+            std::bind(&Impl::onClose, shared_from_this(), std::placeholders::_1));
+    }
+    else if (! mFinished)
+    {
+        // Still connecting: aborts the pending operation, whose handler will finish the websocket.
+        mResolver.cancel();
+        beast::get_lowest_layer(mStream).cancel();
+    }
 }
 
 
 WebSocket::WebSocket() :
-        mImpl{std::make_unique<Impl>()}
+    // Explicitly typed, otherwise the receive handler constructor template is a better match.
+    WebSocket{static_cast<::net::io_context *>(nullptr)}
+{}
+
+
+WebSocket::WebSocket(::net::io_context * aSharedContext) :
+    mImpl{std::make_shared<Impl>(aSharedContext)}
 {}
 
 
@@ -305,15 +571,29 @@ WebSocket::~WebSocket()
 
 void WebSocket::run(const std::string & aHost, const std::string & aPort, const std::string & aTarget)
 {
-    mImpl->run(aHost, aPort, aTarget);
+    if (! mImpl->mOwnedIoc)
+    {
+        spdlog::critical("Blocking run() is not available on a websocket sharing its io_context.");
+        throw std::logic_error{"Cannot run a websocket sharing its io_context."};
+    }
+
+    mImpl->async_run(aHost, aPort, aTarget);
     mImpl->mIoc.run();
+    // Allows to run again
+    mImpl->mIoc.restart();
     spdlog::trace("Websocket run completed.");
 }
 
 
-void WebSocket::async_send(const std::string & aMessage)
+void WebSocket::async_run(const std::string & aHost, const std::string & aPort, const std::string & aTarget)
+{
+    mImpl->async_run(aHost, aPort, aTarget);
+}
+
+
+bool WebSocket::async_send(const std::string & aMessage)
 {
-    mImpl->async_send(aMessage);
+    return mImpl->async_send(aMessage);
 }
 
 
@@ -335,6 +615,48 @@ void WebSocket::setReceiveCallback(ReceiveCallback aOnReceive)
 }
 
 
+void WebSocket::setCloseCallback(CloseCallback aOnClose)
+{
+    mImpl->mCloseCallback = std::move(aOnClose);
+}
+
+
+void WebSocket::setCompression(Compression aCompression)
+{
+    if (aCompression.windowBits < 9 || aCompression.windowBits > 15)
+    {
+        spdlog::critical("Websocket compression window bits {} outside of [9, 15].", aCompression.windowBits);
+        throw std::invalid_argument{"Invalid websocket compression window bits."};
+    }
+    if (aCompression.memoryLevel < 1 || aCompression.memoryLevel > 9)
+    {
+        spdlog::critical("Websocket compression memory level {} outside of [1, 9].", aCompression.memoryLevel);
+        throw std::invalid_argument{"Invalid websocket compression memory level."};
+    }
+    if (aCompression.compressionLevel < 0 || aCompression.compressionLevel > 9)
+    {
+        spdlog::critical("Websocket compression level {} outside of [0, 9].", aCompression.compressionLevel);
+        throw std::invalid_argument{"Invalid websocket compression level."};
+    }
+
+    mImpl->mCompression = aCompression;
+}
+
+
+WebSocket::Statistics WebSocket::getStatistics() const
+{
+    const Counters & counters = mImpl->mCounters;
+    return Statistics{
+        counters.messagesReceived.load(std::memory_order_relaxed),
+        counters.messagesSent.load(std::memory_order_relaxed),
+        counters.payloadBytesReceived.load(std::memory_order_relaxed),
+        counters.payloadBytesSent.load(std::memory_order_relaxed),
+        counters.wireBytesReceived.load(std::memory_order_relaxed),
+        counters.wireBytesSent.load(std::memory_order_relaxed),
+    };
+}
+
+
 ::net::io_context & WebSocket::exposeContextDetail()
 {
     return mImpl->mIoc;
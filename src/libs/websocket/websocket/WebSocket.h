@@ -6,10 +6,10 @@
 #include <experimental/propagate_const>
 #endif
 
+#include <cstdint>
 #include <functional>
 #include <memory>
-#include <mutex>
-#include <queue>
+#include <string>
 
 
 // Some nasty forward declaration to support nasty violations of encapsulation.
@@ -30,14 +30,54 @@ class WebSocket
 {
     using ConnectCallback = std::function<void()>;
     using ReceiveCallback = std::function<void(const std::string &)>;
+    using CloseCallback = std::function<void()>;
 
 public:
+    /// \brief Settings of the permessage-deflate extension (RFC 7692), offered during the handshake.
+    ///
+    /// The server might decline the extension, in which case messages are not compressed.
+    struct Compression
+    {
+        bool enabled{false};
+        /// \brief Maximum LZ77 window bits [9, 15], offered for both directions.
+        /// Smaller windows use less memory, at the cost of the compression ratio.
+        int windowBits{15};
+        /// \brief zlib memory level [1, 9], memory used by the compression state.
+        int memoryLevel{4};
+        /// \brief Deflate compression level [0, 9] of the sent messages.
+        int compressionLevel{8};
+        /// \brief Requests to reset the compression context after each message (both directions).
+        bool noContextTakeover{false};
+    };
+
+    /// \brief Cumulative traffic of the websocket.
+    ///
+    /// Payload bytes are the application messages (after decompression),
+    /// wire bytes are transferred on the TCP socket (compressed, TLS and framing overheads).
+    struct Statistics
+    {
+        std::uint64_t messagesReceived{0};
+        std::uint64_t messagesSent{0};
+        std::uint64_t payloadBytesReceived{0};
+        std::uint64_t payloadBytesSent{0};
+        std::uint64_t wireBytesReceived{0};
+        std::uint64_t wireBytesSent{0};
+    };
+
     WebSocket();
 
+    /// \brief Constructor for a websocket running on a shared io_context.
+    ///
+    /// \param aSharedContext The io_context running the websocket handlers,
+    /// which are serialized through a strand. If `nullptr`, the websocket owns its io_context,
+    /// which is run by `run()`.
+    explicit WebSocket(boost::asio::io_context * aSharedContext);
+
     /// \brief Constructor accepting a receive callback.
     /// \param aOnReceive Callback invoked when a message is received.
     /// \important All handlers are running in a single thread (implicit strand),
     /// the thread in which `run()` has been called.
+    /// When running on a shared io_context, handlers are serialized through an explicit strand.
     template <class T_receiveHandler>
     explicit WebSocket(T_receiveHandler && aOnReceive);
 
@@ -53,19 +93,47 @@ public:
     template <class T_connectHandler, class T_receiveHandler>
     WebSocket(T_connectHandler && aOnConnect, T_receiveHandler && aOnReceive);
 
+    /// \brief Constructor accepting a connect, a receive and a close callback.
+    ///
+    /// \param aSharedContext See `WebSocket(boost::asio::io_context *)`.
+    /// \param aOnClose Callback invoked exactly once when the websocket stopped running,
+    /// be it because it closed, or because it failed to connect.
+    /// No other callback is invoked after it.
+    template <class T_connectHandler, class T_receiveHandler, class T_closeHandler>
+    WebSocket(boost::asio::io_context * aSharedContext,
+              T_connectHandler && aOnConnect,
+              T_receiveHandler && aOnReceive,
+              T_closeHandler && aOnClose);
+
+    /// \attention When running on a shared io_context, the websocket must have stopped running
+    /// (close callback invoked) before it is destroyed.
     ~WebSocket();
 
     /// \brief Connects the websocket, which will start sending and receiving messages.
     /// \attention Blocks the calling thread until the websocket is closed.
+    /// Only available when the websocket owns its io_context.
     void run(const std::string & aHost, const std::string & aPort, const std::string & aTarget = "/");
 
-    /// \brief Queue a message to be sent at first opportunity, thread safe.
+    /// \brief Starts connecting the websocket and returns immediately.
+    ///
+    /// The handlers are executed by the threads running the io_context.
+    void async_run(const std::string & aHost, const std::string & aPort, const std::string & aTarget = "/");
+
+    /// \brief Queue a message to be sent at first opportunity, thread safe and lock-free.
     /// \note Can be called while the WebSocket is running, or not running.
-    void async_send(const std::string & aMessage);
+    /// \return `false` if the bounded outbound queue is full, the message is then dropped.
+    bool async_send(const std::string & aMessage);
 
     /// \brief Queue a message, thread safe.
     void async_close();
 
+    /// \brief Configures the permessage-deflate extension for the next connections.
+    /// \attention Must not be called while the websocket is running.
+    void setCompression(Compression aCompression);
+
+    /// \brief Thread safe.
+    Statistics getStatistics() const;
+
     /// \brief Return the associated ASIO io_context.
     ///
     /// \attention This method violates encapsulation, but is a convenience
@@ -75,13 +143,16 @@ public:
 private:
     void setConnectCallback(ConnectCallback aOnConnect);
     void setReceiveCallback(ReceiveCallback aOnReceive);
+    void setCloseCallback(CloseCallback aOnClose);
 
 private:
     struct Impl;
+    // Shared with the pending asynchronous operations, which might complete
+    // after the WebSocket is destroyed when running on a shared io_context.
 #if not defined(_MSC_VER)
-    std::experimental::propagate_const<std::unique_ptr<Impl>> mImpl;
+    std::experimental::propagate_const<std::shared_ptr<Impl>> mImpl;
 #else
-    std::unique_ptr<Impl> mImpl;
+    std::shared_ptr<Impl> mImpl;
 #endif
 };
 
@@ -103,5 +174,18 @@ WebSocket::WebSocket(T_connectHandler && aOnConnect, T_receiveHandler && aOnRece
 }
 
 
+template <class T_connectHandler, class T_receiveHandler, class T_closeHandler>
+WebSocket::WebSocket(boost::asio::io_context * aSharedContext,
+                     T_connectHandler && aOnConnect,
+                     T_receiveHandler && aOnReceive,
+                     T_closeHandler && aOnClose) :
+    WebSocket{aSharedContext}
+{
+    setConnectCallback(std::forward<T_connectHandler>(aOnConnect));
+    setReceiveCallback(std::forward<T_receiveHandler>(aOnReceive));
+    setCloseCallback(std::forward<T_closeHandler>(aOnClose));
+}
+
+
 } // namespace net
 } // namespace ad